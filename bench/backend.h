@@ -0,0 +1,185 @@
+/**
+@file backend.h
+
+Common adapter used by mapbench to run one MapTester workload (a binary
+trace, see project2/tracefile.h) against different map implementations.
+
+Every backend is compiled in its own file (hash_backends.cc, tree_backend.cc,
+list_backend.cc), because ListMap.h and TreeMap.h can't be included together.
+The loop over operations is instantiated inside each of them, so the only
+indirect call is one per whole run, not one per operation.
+*******************************************************************************/
+
+#ifndef MAP_BENCH_BACKEND_H_
+#define MAP_BENCH_BACKEND_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include "../project2/tracefile.h"
+
+/// One map implementation under test.
+class MapBackend
+{
+public:
+	virtual ~MapBackend() {}
+	virtual const char* name() const = 0;
+	/// Builds whatever the backend derives from the keys of the trace. Called
+	/// once, before any measurement, so neither its time nor its memory count.
+	virtual void prepare(const TraceFile& t) = 0;
+	/// Destroys the old map (if any) and creates a new, empty one. Called
+	/// outside the timed region, so tearing down is never measured.
+	virtual void reset() = 0;
+	/// Runs ops [from,to) of the trace, after prepare(). If lat != NULL, stores
+	/// the duration of every operation in nanoseconds there.
+	virtual unsigned long run(const TraceFile& t, uint64_t from, uint64_t to, uint32_t* lat) = 0;
+	virtual size_t size() = 0;
+};
+
+typedef MapBackend* (*MapBackendFactory)();
+
+MapBackend* makeAISDIHashMapBackend();
+MapBackend* makeAISDIPow2HashMapBackend();
+MapBackend* makeAISDIPrimeHashMapBackend();
+MapBackend* makeAISDICompactHashMapBackend();
+MapBackend* makeStdMapBackend();
+MapBackend* makeStdUnorderedMapBackend();
+MapBackend* makeTreeMapBackend();
+MapBackend* makeBPTreeMapBackend();
+MapBackend* makePersistentTreeMapBackend();
+MapBackend* makeListMapBackend();
+
+/// Drives an adapter A with the MapTester operations of a trace.
+/// A has insert/remove/modifyOrAdd/read/find taking the key index.
+template<class A>
+unsigned long runTrace(A& a, const TraceFile& t, uint64_t from, uint64_t to, uint32_t* lat)
+{
+	typedef std::chrono::steady_clock zegar;
+	unsigned long wyn = 0;
+	const TraceOp* o = t.begin() + from;
+	const TraceOp* koniec = t.begin() + to;
+	for(; o != koniec; ++o){
+		zegar::time_point start;
+		if(lat != NULL) start = zegar::now();
+		uint32_t k = o->key();
+		switch(o->op()){
+		case OP_INSERT: wyn += a.insert(k, o->val); break;
+		case OP_REMOVE: wyn += 3*a.remove(k); break;
+		case OP_MODIFY: a.modifyOrAdd(k, o->val); break;
+		case OP_READ: wyn = wyn*31 + a.read(k); break;
+		case OP_FIND: wyn += 7*a.find(k); break;
+		}
+		if(lat != NULL)
+			*lat++ = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(zegar::now() - start).count());
+	}
+	return wyn;
+}
+
+/// Adapter for maps keyed by std::string with int values (AISDIHashMap, std::map, ...).
+template<class Map>
+class StringKeyBackend : public MapBackend
+{
+public:
+	StringKeyBackend(const char* n):nazwa(n),m(NULL){}
+	~StringKeyBackend(){ delete m; }
+
+	const char* name() const { return nazwa; }
+	size_t size() { return m->size(); }
+
+	void prepare(const TraceFile& tf){
+		keys.resize(tf.keyCount());
+		for(uint32_t i=0; i<tf.keyCount(); i++) keys[i].first = tf.key(i);
+	}
+
+	void reset(){
+		delete m;
+		m = new Map();
+	}
+
+	unsigned long run(const TraceFile& tf, uint64_t from, uint64_t to, uint32_t* lat){
+		return runTrace(*this, tf, from, to, lat);
+	}
+
+	inline bool insert(uint32_t k, int v){
+		keys[k].second = v;
+		return m->insert(keys[k]).second;
+	}
+	inline unsigned remove(uint32_t k) { return static_cast<unsigned>(m->erase(keys[k].first)); }
+	inline void modifyOrAdd(uint32_t k, int v) { (*m)[keys[k].first] = v; }
+	inline int read(uint32_t k) { return (*m)[keys[k].first]; }
+	inline bool find(uint32_t k) { return m->find(keys[k].first) != m->end(); }
+
+private:
+	const char* nazwa;
+	Map* m;
+	std::vector<std::pair<std::string, int> > keys;	//gotowe pary - insert bez kopiowania klucza
+};
+
+/// Adapter for the int -> std::string maps of the labs (TreeMap, ListMap).
+/// A trace key becomes its rank among all keys of the trace, so the int keys
+/// are ordered the same way as the strings (sequential string keys stay
+/// sequential, random ones stay random). Values come from a pool of short strings.
+template<class Map>
+class IntKeyBackend : public MapBackend
+{
+public:
+	enum { POOL = 1024 };
+
+	IntKeyBackend(const char* n):nazwa(n),m(NULL){
+		for(int i=0; i<POOL; i++){
+			char buf[16];
+			snprintf(buf, sizeof(buf), "%d", i);
+			vals[i].second = buf;
+		}
+	}
+
+	~IntKeyBackend(){ delete m; }
+
+	const char* name() const { return nazwa; }
+	size_t size() { return m->size(); }
+
+	void prepare(const TraceFile& tf){
+		std::vector<uint32_t> kolejnosc(tf.keyCount());
+		for(uint32_t i=0; i<tf.keyCount(); i++) kolejnosc[i] = i;
+		std::sort(kolejnosc.begin(), kolejnosc.end(), PorownajKlucze(tf));
+		rank.resize(tf.keyCount());
+		for(uint32_t i=0; i<tf.keyCount(); i++) rank[kolejnosc[i]] = static_cast<int>(i);
+	}
+
+	void reset(){
+		delete m;
+		m = new Map();
+	}
+
+	unsigned long run(const TraceFile& tf, uint64_t from, uint64_t to, uint32_t* lat){
+		return runTrace(*this, tf, from, to, lat);
+	}
+
+	inline bool insert(uint32_t k, int v){
+		std::pair<int, std::string>& p = vals[v & (POOL-1)];
+		p.first = rank[k];
+		return m->insert(p).second;
+	}
+	inline unsigned remove(uint32_t k) { return static_cast<unsigned>(m->erase(rank[k])); }
+	inline void modifyOrAdd(uint32_t k, int v) { (*m)[rank[k]] = vals[v & (POOL-1)].second; }
+	inline int read(uint32_t k) { return static_cast<int>((*m)[rank[k]].size()); }
+	inline bool find(uint32_t k) { return m->find(rank[k]) != m->end(); }
+
+private:
+	struct PorownajKlucze{
+		const TraceFile& t;
+		PorownajKlucze(const TraceFile& tf):t(tf){}
+		bool operator()(uint32_t a, uint32_t b) const { return t.key(a) < t.key(b); }
+	};
+
+	const char* nazwa;
+	Map* m;
+	std::pair<int, std::string> vals[POOL];
+	std::vector<int> rank;		//klucz int dla kazdego klucza sladu
+};
+
+#endif
@@ -0,0 +1,144 @@
+//
+// concbench - przepustowosc wspolbieznej mapy (ConcurrentTreeMap) i TreeMap pod jednym muteksem
+// dla 1..T watkow przy mieszanym obciazeniu odczyt/zapis.
+//
+// uzycie: concbench [-n kluczy] [-o operacji na watek] [-t max watkow] [-r % odczytow] [-s ziarno]
+//
+// Obie mapy startuja z co druga liczba z [0, n). Kazdy watek losuje klucze z [0, n) i wykonuje
+// find (r% operacji), a reszte po rowno insert i erase, wiec rozmiar mapy sie nie zmienia.
+// Liczba watkow rosnie dwukrotnie od 1 do T (ostatni wiersz zawsze T). Wynik to miliony
+// operacji na sekunde wszystkich watkow razem; na maszynie z mniejsza liczba rdzeni niz
+// watkow wzrostu nie bedzie - hardware_concurrency jest wypisane w naglowku.
+// Domyslne T to liczba rdzeni, ale najwyzej MAX_THREADS - 1 ConcurrentTreeMap (jeden slot
+// zajmuje watek glowny, ktory wypelnia mape).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define test treemap_test
+#define print treemap_print
+#include "../project3/asd.cc"
+#undef test
+#undef print
+#include "../project3/ConcurrentTreeMap.h"
+#include "losowe.h"
+
+using namespace std;
+
+int CCount::count = 0;
+
+typedef chrono::steady_clock zegar;
+
+/// TreeMap z jednym muteksem na wszystkie operacje.
+struct ZMuteksem
+{
+	TreeMap m;
+	mutex mx;
+
+	bool find(int k){
+		lock_guard<mutex> l(mx);
+		return m.find(k) != m.end();
+	}
+	void insert(int k, const string& v){
+		lock_guard<mutex> l(mx);
+		m.insert(make_pair(k, v));
+	}
+	void erase(int k){
+		lock_guard<mutex> l(mx);
+		m.erase(k);
+	}
+};
+
+/// ConcurrentTreeMap z tym samym interfejsem.
+struct Wspolbiezna
+{
+	ConcurrentTreeMap m;
+
+	bool find(int k) { return m.find(k); }
+	void insert(int k, const string& v) { m.insert(make_pair(k, v)); }
+	void erase(int k) { m.erase(k); }
+};
+
+struct Parametry
+{
+	int n;
+	uint64_t operacje;
+	int odczyty;
+	uint64_t ziarno;
+};
+
+template<class M>
+static void watek(M& m, const Parametry& par, int nr, long& trafienia)
+{
+	uint64_t stan = par.ziarno + 1000003ULL*nr;
+	const string v("wartosc");
+	long z = 0;
+	for(uint64_t i=0; i<par.operacje; i++){
+		uint64_t x = losowa(stan);
+		int k = static_cast<int>(x % par.n);
+		int rodzaj = static_cast<int>((x >> 32) % 200);		//0..199: polowki procenta
+		if(rodzaj < 2*par.odczyty) z += m.find(k);
+		else if(rodzaj & 1) m.insert(k, v);
+		else m.erase(k);
+	}
+	trafienia = z;
+}
+
+/// Mops/s dla t watkow na swiezo wypelnionej mapie.
+template<class M>
+static double mierz(const Parametry& par, int t)
+{
+	M m;
+	for(int k=0; k<par.n; k+=2) m.insert(k, "wartosc");
+	vector<long> trafienia(t);
+	vector<thread> watki;
+	zegar::time_point start = zegar::now();
+	for(int i=0; i<t; i++) watki.push_back(thread(watek<M>, ref(m), cref(par), i, ref(trafienia[i])));
+	for(int i=0; i<t; i++) watki[i].join();
+	double s = chrono::duration<double>(zegar::now() - start).count();
+	return par.operacje*t/s/1e6;
+}
+
+int main(int argc, char* argv[])
+{
+	Parametry par = { 1000000, 1000000, 90, 1 };
+	const int limit = ConcurrentTreeMap::MAX_THREADS - 1;
+	int maxWatkow = static_cast<int>(thread::hardware_concurrency());
+	if(maxWatkow < 1) maxWatkow = 1;
+	if(maxWatkow > limit) maxWatkow = limit;
+	int c;
+	while((c = getopt(argc, argv, "n:o:t:r:s:")) != -1){
+		switch(c){
+		case 'n': par.n = atoi(optarg); break;
+		case 'o': par.operacje = strtoull(optarg, NULL, 10); break;
+		case 't': maxWatkow = atoi(optarg); break;
+		case 'r': par.odczyty = atoi(optarg); break;
+		case 's': par.ziarno = strtoull(optarg, NULL, 10); break;
+		default:
+			fprintf(stderr, "uzycie: %s [-n kluczy] [-o operacji na watek] [-t max watkow] [-r %% odczytow] [-s ziarno]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if(par.n <= 0 || par.operacje == 0 || maxWatkow < 1 || maxWatkow > limit
+	   || par.odczyty < 0 || par.odczyty > 100){
+		fprintf(stderr, "niepoprawne parametry (watkow najwyzej %d)\n", limit);
+		return EXIT_FAILURE;
+	}
+
+	printf("klucze %d, operacji na watek %llu, odczyty %d%%, rdzenie %u\n", par.n,
+	       static_cast<unsigned long long>(par.operacje), par.odczyty, thread::hardware_concurrency());
+	printf("%7s %12s %12s %8s\n", "watki", "muteks Mop/s", "olc Mop/s", "olc/mut");
+	for(int t=1; ; t = (2*t < maxWatkow) ? 2*t : maxWatkow){
+		double mut = mierz<ZMuteksem>(par, t);
+		double olc = mierz<Wspolbiezna>(par, t);
+		printf("%7d %12.2f %12.2f %8.2f\n", t, mut, olc, olc/mut);
+		if(t == maxWatkow) break;
+	}
+	return EXIT_SUCCESS;
+}
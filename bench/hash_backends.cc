@@ -0,0 +1,48 @@
+//
+// Backendy mapbench z kluczem std::string: AISDIHashMap (z domyslna polityka
+// i z kilkoma innymi), AISDICompactHashMap, std::map i std::unordered_map.
+
+#include <map>
+#include <unordered_map>
+
+#include "../project2/aisdihashmap.h"
+#include "../project2/aisdicompactmap.h"
+#include "backend.h"
+
+typedef AISDIHashMap<std::string, int, hashF, _compFunc> AISDIMap;
+//2^16 komorek, hash zapamietany w wezlach
+typedef AISDIHashMap<std::string, int, hashRaw, _compFunc,
+                     AISDIHashPolicy<AISDIPow2Buckets<16>, true> > AISDIPow2Map;
+//65521 komorek (najwieksza liczba pierwsza < 2^16), modulo przez fastmod
+typedef AISDIHashMap<std::string, int, hashRaw, _compFunc,
+                     AISDIHashPolicy<AISDIPrimeBuckets<65521> > > AISDIPrimeMap;
+
+MapBackend* makeAISDIHashMapBackend()
+{
+	return new StringKeyBackend<AISDIMap>("AISDIHashMap");
+}
+
+MapBackend* makeAISDIPow2HashMapBackend()
+{
+	return new StringKeyBackend<AISDIPow2Map>("AISDIHashMap/pow2");
+}
+
+MapBackend* makeAISDIPrimeHashMapBackend()
+{
+	return new StringKeyBackend<AISDIPrimeMap>("AISDIHashMap/prime");
+}
+
+MapBackend* makeAISDICompactHashMapBackend()
+{
+	return new StringKeyBackend<AISDICompactHashMap<std::string, int> >("AISDICompactHashMap");
+}
+
+MapBackend* makeStdMapBackend()
+{
+	return new StringKeyBackend<std::map<std::string, int> >("std::map");
+}
+
+MapBackend* makeStdUnorderedMapBackend()
+{
+	return new StringKeyBackend<std::unordered_map<std::string, int> >("std::unordered_map");
+}
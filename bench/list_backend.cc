@@ -0,0 +1,19 @@
+//
+// Backend mapbench dla ListMap z project1. ListMap.h i TreeMap.h definiuja
+// wlasne klasy CCount, wiec tutaj nazywa sie ona ListCCount.
+
+#define CCount ListCCount
+#define test listmap_test
+#define print listmap_print
+#include "../project1/asd.cc"
+#undef test
+#undef print
+
+#include "backend.h"
+
+int ListCCount::count = 0;
+
+MapBackend* makeListMapBackend()
+{
+	return new IntKeyBackend<ListMap>("ListMap");
+}
@@ -0,0 +1,120 @@
+//
+// lookupbench - czas wyszukiwania w duzej AISDIHashMap<string,int>: zwykly find,
+// find_batch (grupowy prefetch) i find_interleaved (korutyny C++20) dla roznych
+// rozmiarow grupy.
+//
+// uzycie: lookupbench [-n kluczy] [-L dlugosc_klucza] [-q wyszukan] [-t procent_trafien] [-s ziarno]
+//
+// Klucze dluzsze niz 15 znakow nie mieszcza sie w samym std::string, wiec kazde wyszukanie
+// czeka na trzy zalezne odczyty: pole tablicy, wezel i bufor klucza.
+// Kluczy nie powinno byc wiecej niz okolo 4*MAX - przy dluzszych minilistach
+// komorki zamieniaja sie w drzewa i wyszukania nie sa juz przeplatane.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../project2/aisdihashmap.h"
+#include "losowe.h"
+
+using namespace std;
+
+typedef AISDIHashMap<string, int, hashF, _compFunc> AISDIMap;
+
+/// Klucz numer nr: L pseudolosowych liter. Napisy z kolejnymi numerami
+/// (jak w workgen) hashF rozrzuca zle, a tu chodzi o krotkie minilisty.
+static string klucz(uint64_t nr, unsigned L)
+{
+	uint64_t stan = nr * 0x2545f4914f6cdd1dULL;
+	string s(L, ' ');
+	for(unsigned i=0; i<L; i+=10){
+		uint64_t r = losowa(stan);
+		for(unsigned j=i; j<L && j<i+10; j++, r >>= 6) s[j] = static_cast<char>('A' + (r & 63) % 58);
+	}
+	return s;
+}
+
+/// Suma kontrolna wynikow - wszystkie metody musza dac ta sama.
+static long suma(AISDIMap& m, vector<AISDIMap::iterator>& wyn)
+{
+	long s = 0;
+	for(size_t i=0; i<wyn.size(); i++)
+		if(wyn[i] != m.end()) s += wyn[i]->second + 1;
+	return s;
+}
+
+static void wypisz(const char* metoda, int grupa, double sekundy, size_t q, long s, long wzorzec)
+{
+	printf("%-18s %6d %10.1f%s\n", metoda, grupa, sekundy*1e9/q, s == wzorzec ? "" : "   ZLY WYNIK");
+}
+
+int main(int argc, char* argv[])
+{
+	uint64_t n = 250000, q = 2000000, ziarno = 1;
+	unsigned L = 40, trafienia = 100;
+	int c;
+	while((c = getopt(argc, argv, "n:L:q:t:s:")) != -1){
+		switch(c){
+		case 'n': n = strtoull(optarg, NULL, 10); break;
+		case 'L': L = static_cast<unsigned>(atoi(optarg)); break;
+		case 'q': q = strtoull(optarg, NULL, 10); break;
+		case 't': trafienia = static_cast<unsigned>(atoi(optarg)); break;
+		case 's': ziarno = strtoull(optarg, NULL, 10); break;
+		default:
+			fprintf(stderr, "uzycie: %s [-n kluczy] [-L dlugosc] [-q wyszukan] [-t procent_trafien] [-s ziarno]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if(n == 0 || q == 0 || trafienia > 100){
+		fprintf(stderr, "niepoprawne parametry\n");
+		return EXIT_FAILURE;
+	}
+
+	//wstawianie w losowej kolejnosci, zeby sasiednie wezly nie lezaly obok siebie w pamieci
+	uint64_t stan = ziarno;
+	vector<uint64_t> kolejnosc(n);
+	for(uint64_t i=0; i<n; i++) kolejnosc[i] = i;
+	for(uint64_t i=n-1; i>0; i--) swap(kolejnosc[i], kolejnosc[losowa(stan) % (i+1)]);
+	AISDIMap* m = new AISDIMap();
+	for(uint64_t i=0; i<n; i++) m->insert(make_pair(klucz(kolejnosc[i], L), static_cast<int>(kolejnosc[i])));
+
+	vector<string> pytania(q);
+	for(uint64_t i=0; i<q; i++){
+		uint64_t nr = losowa(stan) % n;
+		if(losowa(stan) % 100 >= trafienia) nr += n;		//klucz spoza mapy
+		pytania[i] = klucz(nr, L);
+	}
+	vector<AISDIMap::iterator> wyn(q);
+
+	printf("%llu kluczy dlugosci %u, %llu wyszukan, %u%% trafien\n",
+	       (unsigned long long)n, L, (unsigned long long)q, trafienia);
+	printf("%-18s %6s %10s\n", "metoda", "grupa", "ns/klucz");
+
+	typedef chrono::steady_clock zegar;
+	zegar::time_point t = zegar::now();
+	for(uint64_t i=0; i<q; i++) wyn[i] = m->find(pytania[i]);
+	double sek = chrono::duration<double>(zegar::now() - t).count();
+	long wzorzec = suma(*m, wyn);
+	wypisz("find", 1, sek, q, wzorzec, wzorzec);
+
+	t = zegar::now();
+	m->find_batch(&pytania[0], static_cast<unsigned>(q), &wyn[0]);
+	sek = chrono::duration<double>(zegar::now() - t).count();
+	wypisz("find_batch", 16, sek, q, suma(*m, wyn), wzorzec);
+
+#ifdef AISDI_COROUTINES
+	for(int g=1; g<=64; g*=2){
+		t = zegar::now();
+		m->find_interleaved(&pytania[0], static_cast<unsigned>(q), &wyn[0], g);
+		sek = chrono::duration<double>(zegar::now() - t).count();
+		wypisz("find_interleaved", g, sek, q, suma(*m, wyn), wzorzec);
+	}
+#else
+	printf("find_interleaved wymaga kompilacji z -std=c++20\n");
+#endif
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,23 @@
+/**
+@file losowe.h
+
+splitmix64 shared by the bench programs: a small generator whose output
+doesn't depend on the standard library, so the same seed gives the same
+trace and the same keys on every machine.
+*******************************************************************************/
+
+#ifndef MAP_BENCH_LOSOWE_H_
+#define MAP_BENCH_LOSOWE_H_
+
+#include <stdint.h>
+
+/// Next number of the sequence; stan is the whole generator state.
+static inline uint64_t losowa(uint64_t& stan)
+{
+	uint64_t z = (stan += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+#endif
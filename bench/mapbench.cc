@@ -0,0 +1,219 @@
+//
+// mapbench - uruchamia ten sam slad operacji MapTester (plik binarny z trace2bin)
+// na wszystkich mapach: AISDIHashMap (trzy polityki), AISDICompactHashMap, TreeMap,
+// BPTreeMap, PersistentTreeMap, ListMap, std::map, std::unordered_map.
+//
+// uzycie: mapbench [-j] [-n liczba_operacji] [-b nazwa[,nazwa...]] slad.bin
+// -j - wyniki w formacie JSON
+//
+// Kazda mapa dziala w osobnym procesie (fork), wiec szczytowe zuzycie pamieci
+// jednej mapy nie wplywa na pomiar nastepnej, a zawieszenie sie lub blad
+// jednej implementacji nie przerywa calego porownania.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "backend.h"
+
+using namespace std;
+
+struct Backend
+{
+	const char* opcja;		//nazwa dla -b
+	MapBackendFactory fabryka;
+};
+
+static const Backend backendy[] = {
+	{ "hash", makeAISDIHashMapBackend },
+	{ "hash-pow2", makeAISDIPow2HashMapBackend },
+	{ "hash-prime", makeAISDIPrimeHashMapBackend },
+	{ "compact", makeAISDICompactHashMapBackend },
+	{ "tree", makeTreeMapBackend },
+	{ "bptree", makeBPTreeMapBackend },
+	{ "ptree", makePersistentTreeMapBackend },
+	{ "list", makeListMapBackend },
+	{ "map", makeStdMapBackend },
+	{ "umap", makeStdUnorderedMapBackend },
+};
+static const int ILE_BACKENDOW = sizeof(backendy)/sizeof(backendy[0]);
+
+/// Wynik jednego backendu, przesylany z procesu potomnego przez potok.
+struct Wynik
+{
+	char nazwa[32];
+	uint64_t ops;
+	double sekundy;
+	double p50, p90, p99, p999, pmax;
+	long pamiecKB;		//przyrost szczytowego RSS w czasie pierwszego przebiegu
+	uint64_t rozmiar;	//rozmiar mapy po calym sladzie - powinien byc wszedzie taki sam
+	int ok;
+};
+
+static long szczytRSS()
+{
+	struct rusage r;
+	getrusage(RUSAGE_SELF, &r);
+	return r.ru_maxrss;		//w KB pod Linuksem
+}
+
+static double percentyl(const vector<uint32_t>& posortowane, double p)
+{
+	if(posortowane.empty()) return 0;
+	size_t i = static_cast<size_t>(p*(posortowane.size()-1));
+	return posortowane[i];
+}
+
+/// Czas samego pomiaru (dwa odczyty zegara), odejmowany od czasow operacji.
+static uint32_t narzutZegara()
+{
+	typedef std::chrono::steady_clock zegar;
+	vector<uint32_t> t(10001);
+	for(size_t i=0; i<t.size(); i++){
+		zegar::time_point s = zegar::now();
+		t[i] = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(zegar::now() - s).count());
+	}
+	nth_element(t.begin(), t.begin()+t.size()/2, t.end());
+	return t[t.size()/2];
+}
+
+/// Wykonywane w procesie potomnym: przebieg na przepustowosc, potem drugi,
+/// na swiezej mapie, z pomiarem czasu kazdej operacji.
+static Wynik zmierz(MapBackend* b, const TraceFile& slad, uint64_t n)
+{
+	Wynik w;
+	memset(&w, 0, sizeof(w));
+	strncpy(w.nazwa, b->name(), sizeof(w.nazwa)-1);
+	w.ops = n;
+
+	vector<uint32_t> lat(n);		//alokowane przed pomiarem pamieci
+	for(uint64_t i=0; i<n; i++) lat[i] = 0;
+	b->prepare(slad);				//klucze sladu tez - przygotowanie nie wchodzi ani w czas, ani w pamiec
+
+	long rss = szczytRSS();
+	b->reset();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	b->run(slad, 0, n, NULL);
+	w.sekundy = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	w.pamiecKB = szczytRSS() - rss;
+	w.rozmiar = b->size();
+
+	b->reset();
+	b->run(slad, 0, n, n ? &lat[0] : NULL);
+	uint32_t narzut = narzutZegara();
+	for(uint64_t i=0; i<n; i++) lat[i] = lat[i] > narzut ? lat[i] - narzut : 0;
+	sort(lat.begin(), lat.end());
+	w.p50 = percentyl(lat, 0.50);
+	w.p90 = percentyl(lat, 0.90);
+	w.p99 = percentyl(lat, 0.99);
+	w.p999 = percentyl(lat, 0.999);
+	w.pmax = n ? lat[n-1] : 0;
+	w.ok = 1;
+	return w;
+}
+
+static int uzycie(const char* program)
+{
+	fprintf(stderr, "uzycie: %s [-j] [-n ops] [-b ", program);
+	for(int i=0; i<ILE_BACKENDOW; i++) fprintf(stderr, "%s%s", i ? "," : "", backendy[i].opcja);
+	fprintf(stderr, "] slad.bin\n");
+	return EXIT_FAILURE;
+}
+
+static bool wybrany(const string& lista, const char* nazwa)
+{
+	if(lista.empty()) return true;
+	string l = "," + lista + ",";
+	return l.find(string(",") + nazwa + ",") != string::npos;
+}
+
+int main(int argc, char* argv[])
+{
+	bool json = false;
+	uint64_t limit = 0;
+	string lista;
+	int c;
+	while((c = getopt(argc, argv, "jn:b:")) != -1){
+		switch(c){
+		case 'j': json = true; break;
+		case 'n': limit = strtoull(optarg, NULL, 10); break;
+		case 'b': lista = optarg; break;
+		default: return uzycie(argv[0]);
+		}
+	}
+	if(optind != argc-1) return uzycie(argv[0]);
+	TraceFile slad;
+	if(!slad.open(argv[optind])){
+		fprintf(stderr, "niepoprawny plik sladu: %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	uint64_t n = slad.size();
+	if(limit != 0 && limit < n) n = limit;
+
+	vector<Wynik> wyniki;
+	for(int i=0; i<ILE_BACKENDOW; i++){
+		if(!wybrany(lista, backendy[i].opcja)) continue;
+		int potok[2];
+		if(pipe(potok) != 0){
+			perror("pipe");
+			return EXIT_FAILURE;
+		}
+		fflush(stdout);
+		pid_t pid = fork();
+		if(pid == 0){
+			close(potok[0]);
+			Wynik w = zmierz(backendy[i].fabryka(), slad, n);
+			ssize_t zapisane = write(potok[1], &w, sizeof(w));
+			_exit(zapisane == sizeof(w) ? 0 : 1);	//bez niszczenia map - sprzatanie nie jest mierzone
+		}
+		close(potok[1]);
+		Wynik w;
+		memset(&w, 0, sizeof(w));
+		if(read(potok[0], &w, sizeof(w)) != sizeof(w)){
+			MapBackend* b = backendy[i].fabryka();
+			strncpy(w.nazwa, b->name(), sizeof(w.nazwa)-1);
+			delete b;
+			w.ok = 0;
+		}
+		close(potok[0]);
+		int status;
+		waitpid(pid, &status, 0);
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) w.ok = 0;
+		wyniki.push_back(w);
+	}
+
+	if(json){
+		printf("{\"trace\": \"%s\", \"ops\": %llu, \"backends\": [\n", argv[optind], (unsigned long long)n);
+		for(size_t i=0; i<wyniki.size(); i++){
+			const Wynik& w = wyniki[i];
+			printf("  {\"name\": \"%s\", \"ok\": %s", w.nazwa, w.ok ? "true" : "false");
+			if(w.ok)
+				printf(", \"ops_per_sec\": %.0f, \"ns_p50\": %.0f, \"ns_p90\": %.0f, \"ns_p99\": %.0f, \"ns_p999\": %.0f, \"ns_max\": %.0f, \"peak_rss_kb\": %ld, \"final_size\": %llu",
+				       w.sekundy > 0 ? w.ops/w.sekundy : 0, w.p50, w.p90, w.p99, w.p999, w.pmax, w.pamiecKB, (unsigned long long)w.rozmiar);
+			printf("}%s\n", i+1 < wyniki.size() ? "," : "");
+		}
+		printf("]}\n");
+	}
+	else{
+		printf("%llu operacji, %u kluczy\n", (unsigned long long)n, slad.keyCount());
+		printf("%-20s %12s %8s %8s %8s %8s %10s %12s %10s\n", "backend", "ops/s", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "max ns", "pamiec KB", "rozmiar");
+		for(size_t i=0; i<wyniki.size(); i++){
+			const Wynik& w = wyniki[i];
+			if(!w.ok){
+				printf("%-20s %12s\n", w.nazwa, "BLAD");
+				continue;
+			}
+			printf("%-20s %12.0f %8.0f %8.0f %8.0f %8.0f %10.0f %12ld %10llu\n", w.nazwa,
+			       w.sekundy > 0 ? w.ops/w.sekundy : 0, w.p50, w.p90, w.p99, w.p999, w.pmax, w.pamiecKB, (unsigned long long)w.rozmiar);
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,30 @@
+//
+// Backendy mapbench dla TreeMap, BPTreeMap i PersistentTreeMap z project3. asd.cc jest wlaczany w calosci,
+// jego wlasne funkcje testowe dostaja inne nazwy, zeby nie kolidowaly z ListMap.
+
+#define test treemap_test
+#define print treemap_print
+#include "../project3/asd.cc"
+#undef test
+#undef print
+#include "../project3/BPTreeMap.h"
+#include "../project3/PersistentTreeMap.h"
+
+#include "backend.h"
+
+int CCount::count = 0;
+
+MapBackend* makeTreeMapBackend()
+{
+	return new IntKeyBackend<TreeMap>("TreeMap");
+}
+
+MapBackend* makeBPTreeMapBackend()
+{
+	return new IntKeyBackend<BPTreeMap>("BPTreeMap");
+}
+
+MapBackend* makePersistentTreeMapBackend()
+{
+	return new IntKeyBackend<PersistentTreeMap>("PersistentTreeMap");
+}
@@ -0,0 +1,214 @@
+//
+// treebench - czas find, kopiowania (konstruktor kopiujacy), porownania struct_eq i clear
+// dla glebokich drzew TreeMap z project3.
+//
+// uzycie: treebench [-n kluczy] [-q wyszukan] [-s ziarno]
+//
+// Mierzone sa dwa ksztalty drzewa:
+//  - avl:  n kluczy wstawionych rosnaco przez insert - najwyzsze drzewo, jakie daje wywazanie,
+//  - lista: n wezlow polaczonych recznie w jedna sciezke (zygzak 0, n-1, 1, n-2, ...),
+//          jak drzewo bez wywazania po posortowanym wstawianiu. Przy rekurencyjnym
+//          kopiowaniu i czyszczeniu taka glebokosc przepelnia stos.
+// Wiersz freeze to migawka drzewa avl (TreeMap::freeze()): find w tablicy w kolejnosci
+// Eytzingera, w kolumnie kopii - czas zamrozenia na wezel.
+// Wiersz trwale to te same klucze w PersistentTreeMap: kopia to migawka O(1) (wspolne wezly),
+// a clear zwalnia wezly dopiero po usunieciu migawki.
+// Linia suma to merge_union drzewa avl z mapa n/100 losowych kluczy z [0, 2n) w porownaniu
+// z wstawianiem tych kluczy po kolei przez insert.
+// Linia rownolegle: build_balanced z posortowanej tablicy (i to samo przez unsafe_insert)
+// oraz parallel_for_each (i zwykla iteracja) na tylu watkach, ile ma sprzet; czasy na wezel.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define test treemap_test
+#define print treemap_print
+#include "../project3/asd.cc"
+#undef test
+#undef print
+#include "../project3/PersistentTreeMap.h"
+#include "losowe.h"
+
+using namespace std;
+
+int CCount::count = 0;
+
+/// Dostep do straznika, zeby zbudowac drzewo z pominieciem wywazania i zmierzyc wysokosc.
+class GlebokieDrzewo : public TreeMap
+{
+public:
+	/// Dopina do pustego drzewa n wezlow w jednej sciezce.
+	void sciezka(int n){
+		clear();
+		TreeNode* p = root;
+		TreeNode** miejsce = &root->left;
+		for(int i=0; i<n; i++){
+			int k = (i%2) ? n-1-i/2 : i/2;
+			*miejsce = new TreeNode(std::make_pair(k, std::string("x")), p);
+			p = *miejsce;
+			miejsce = (i%2) ? &p->left : &p->right;
+		}
+		TreeMapDetail::thread_all(root);
+	}
+
+	/// Wysokosc liczona obchodem po wskaznikach parent (b w sciezce nie jest ustawione).
+	int wysokosc() const{
+		int h = 0, d = 0;
+		const TreeNode* prev = root;
+		const TreeNode* n = root->left;
+		while(n != NULL && n != root){
+			const TreeNode* nast;
+			if(prev == n->parent){		//pierwsze wejscie do wezla
+				if(++d > h) h = d;
+				nast = (n->left != NULL) ? n->left : (n->right != NULL) ? n->right : n->parent;
+			}
+			else if(prev == n->left && n->right != NULL) nast = n->right;
+			else nast = n->parent;
+			if(nast == n->parent) --d;
+			prev = n;
+			n = nast;
+		}
+		return h;
+	}
+};
+
+typedef chrono::steady_clock zegar;
+
+static double sekundy(zegar::time_point t)
+{
+	return chrono::duration<double>(zegar::now() - t).count();
+}
+
+static void mierz(const char* nazwa, GlebokieDrzewo& m, int n, const vector<int>& pytania)
+{
+	zegar::time_point t = zegar::now();
+	long z = 0;
+	for(size_t i=0; i<pytania.size(); i++) z += m.find(pytania[i]) != m.end();
+	double tFind = sekundy(t);
+
+	t = zegar::now();
+	TreeMap* kopia = new TreeMap(m);
+	double tKopia = sekundy(t);
+
+	t = zegar::now();
+	bool rowne = kopia->struct_eq(m);
+	double tPorownanie = sekundy(t);
+
+	t = zegar::now();
+	kopia->clear();
+	double tClear = sekundy(t);
+	delete kopia;
+
+	printf("%-6s %8d %8d %10.1f %10.1f %10.1f %10.1f%s\n", nazwa, n, m.wysokosc(),
+	       tFind*1e9/pytania.size(), tKopia*1e9/n, tPorownanie*1e9/n, tClear*1e9/n,
+	       (rowne && z == static_cast<long>(pytania.size())) ? "" : "   ZLY WYNIK");
+}
+
+int main(int argc, char* argv[])
+{
+	int n = 1000000;
+	uint64_t q = 1000000, ziarno = 1;
+	int c;
+	while((c = getopt(argc, argv, "n:q:s:")) != -1){
+		switch(c){
+		case 'n': n = atoi(optarg); break;
+		case 'q': q = strtoull(optarg, NULL, 10); break;
+		case 's': ziarno = strtoull(optarg, NULL, 10); break;
+		default:
+			fprintf(stderr, "uzycie: %s [-n kluczy] [-q wyszukan] [-s ziarno]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if(n <= 0 || q == 0){
+		fprintf(stderr, "niepoprawne parametry\n");
+		return EXIT_FAILURE;
+	}
+
+	uint64_t stan = ziarno;
+	vector<int> pytania(q);
+	for(uint64_t i=0; i<q; i++) pytania[i] = static_cast<int>(losowa(stan) % n);
+
+	printf("%-6s %8s %8s %10s %10s %10s %10s\n", "drzewo", "wezly", "wysokosc",
+	       "find ns", "kopia ns", "eq ns", "clear ns");
+	printf("%-6s %8s %8s %10s %10s %10s %10s\n", "", "", "", "/klucz", "/wezel", "/wezel", "/wezel");
+
+	GlebokieDrzewo m;
+	for(int i=0; i<n; i++) m.insert(std::make_pair(i, std::string("x")));
+	mierz("avl", m, n, pytania);
+
+	zegar::time_point t = zegar::now();
+	FrozenTreeMap f = m.freeze();
+	double tZamrozenie = sekundy(t);
+	t = zegar::now();
+	long z = 0;
+	for(size_t i=0; i<pytania.size(); i++) z += f.find(pytania[i]) != NULL;
+	double tFind = sekundy(t);
+	printf("%-6s %8d %8s %10.1f %10.1f %10s %10s%s\n", "freeze", n, "-", tFind*1e9/pytania.size(),
+	       tZamrozenie*1e9/n, "-", "-", z == static_cast<long>(pytania.size()) ? "" : "   ZLY WYNIK");
+	printf("pamiec: wezly %.1f MB, migawka %.1f MB (bez znakow napisow)\n",
+	       static_cast<double>(n)*sizeof(TreeNode)/1e6, f.memory()/1e6);
+
+	PersistentTreeMap p;
+	for(int i=0; i<n; i++) p.insert(std::make_pair(i, std::string("x")));
+	t = zegar::now();
+	z = 0;
+	for(size_t i=0; i<pytania.size(); i++) z += p.find(pytania[i]) != p.end();
+	tFind = sekundy(t);
+	t = zegar::now();
+	PersistentTreeMap* migawka = new PersistentTreeMap(p);
+	double tKopia = sekundy(t);
+	t = zegar::now();
+	bool rowne = (*migawka == p);
+	double tPorownanie = sekundy(t);
+	p.clear();			//wezly zostaja w migawce
+	t = zegar::now();
+	delete migawka;
+	double tClear = sekundy(t);
+	printf("%-6s %8d %8s %10.1f %10.1f %10.1f %10.1f%s\n", "trwale", n, "-", tFind*1e9/pytania.size(),
+	       tKopia*1e9/n, tPorownanie*1e9/n, tClear*1e9/n,
+	       (rowne && z == static_cast<long>(pytania.size())) ? "" : "   ZLY WYNIK");
+
+	TreeMap inne;
+	for(int i=0; i<n/100; i++) inne.insert(std::make_pair(static_cast<int>(losowa(stan) % (2*static_cast<uint64_t>(n))), std::string("x")));
+	TreeMap suma(m), wstawione(m);
+	t = zegar::now();
+	suma.merge_union(inne);
+	double tSuma = sekundy(t);
+	t = zegar::now();
+	for(TreeMap::const_iterator i = inne.begin(); i != inne.end(); ++i) wstawione.insert(*i);
+	double tWstawianie = sekundy(t);
+	printf("suma: %d + %d kluczy - merge_union %.2f ms, insert %.2f ms%s\n", n, static_cast<int>(inne.size()),
+	       tSuma*1e3, tWstawianie*1e3, (suma == wstawione) ? "" : "   ZLY WYNIK");
+
+	vector<TreeMap::P> posortowane;
+	for(TreeMap::const_iterator i = m.begin(); i != m.end(); ++i) posortowane.push_back(*i);
+	TreeMap zbudowane;
+	t = zegar::now();
+	zbudowane.build_balanced(posortowane.data(), posortowane.data() + posortowane.size());
+	double tBudowa = sekundy(t);
+	TreeMap wstawiane;
+	t = zegar::now();
+	for(size_t i=0; i<posortowane.size(); i++) wstawiane.unsafe_insert(posortowane[i]);
+	double tWstawiane = sekundy(t);
+	atomic<long> suma1(0);
+	t = zegar::now();
+	zbudowane.parallel_for_each([&](const TreeMap::P& p){ suma1.fetch_add(p.first, memory_order_relaxed); });
+	double tKazdy = sekundy(t);
+	long suma2 = 0;
+	t = zegar::now();
+	for(TreeMap::const_iterator i = zbudowane.begin(); i != zbudowane.end(); ++i) suma2 += i->first;
+	double tIteracja = sekundy(t);
+	printf("rownolegle (%u watkow): build_balanced %.1f ns (unsafe_insert %.1f), parallel_for_each %.1f ns (iteracja %.1f)%s\n",
+	       thread::hardware_concurrency(), tBudowa*1e9/n, tWstawiane*1e9/n, tKazdy*1e9/n, tIteracja*1e9/n,
+	       (suma1 == suma2 && zbudowane == wstawiane) ? "" : "   ZLY WYNIK");
+
+	//w sciezce kazde wyszukanie przechodzi srednio n/2 wezlow - tylko 100 pytan
+	m.sciezka(n);
+	pytania.resize(q < 100 ? q : 100);
+	mierz("lista", m, n, pytania);
+	return EXIT_SUCCESS;
+}
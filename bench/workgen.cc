@@ -0,0 +1,215 @@
+//
+// workgen - deterministyczny generator obciazen dla map (MapTester, ListMap, TreeMap).
+//
+// uzycie: workgen [-s ziarno] [-n operacji] [-k kluczy] [-d rozklad] [-z theta]
+//                 [-m insert:remove:modify:read:find] [-L dlugosc] [-o slad.bin]
+//
+// Rozklady kluczy (-d):
+//   uniform  - kazdy z k kluczy z tym samym prawdopodobienstwem
+//   zipf     - rozklad Zipfa z parametrem theta (-z, domyslnie 0.99); najczestsze
+//              klucze sa rozrzucone po calej przestrzeni, nie leza obok siebie
+//   seq      - insert i modify biora kolejne liczby 0,1,2,...; pozostale operacje
+//              losuja sposrod kluczy juz wydanych
+//   long     - jak uniform, ale klucze maja dlugosc L (-L, domyslnie 200)
+//   collide  - wszystkie klucze maja ten sam hashF (patrz project2/aisdihashmap.h),
+//              czyli trafiaja do jednej komorki tablicy AISDIHashMap
+//
+// Wszystkie klucze maja jednakowa dlugosc i sa dopelnione zerami, wiec porzadek
+// napisow jest taki sam jak porzadek liczb - mapbench zamienia je na klucze int
+// dla ListMap i TreeMap bez zmiany kolejnosci.
+//
+// Bez -o slad tekstowy (format z project2/tracefile.h) idzie na standardowe wyjscie,
+// z -o od razu powstaje plik binarny dla replay i mapbench.
+// Ten sam zestaw parametrow i ziarno daja zawsze ten sam slad.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../project2/tracefile.h"
+#include "losowe.h"
+
+using namespace std;
+
+/// splitmix64 (losowe.h) z losowaniem z przedzialu.
+class Losowanie
+{
+	uint64_t stan;
+public:
+	Losowanie(uint64_t ziarno):stan(ziarno){}
+	uint64_t nastepna(){
+		return losowa(stan);
+	}
+	/// liczba z przedzialu [0, n)
+	uint64_t ponizej(uint64_t n){
+		return static_cast<uint64_t>((static_cast<unsigned __int128>(nastepna()) * n) >> 64);
+	}
+	/// liczba z przedzialu [0, 1)
+	double ulamek(){
+		return (nastepna() >> 11) * (1.0/9007199254740992.0);
+	}
+};
+
+/// Rozklad Zipfa na [0, n) - dystrybuanta liczona raz, losowanie przez wyszukiwanie binarne.
+class Zipf
+{
+	vector<double> cdf;
+public:
+	Zipf(uint64_t n, double theta):cdf(n){
+		double suma = 0;
+		for(uint64_t i=0; i<n; i++){
+			suma += 1.0/pow(static_cast<double>(i+1), theta);
+			cdf[i] = suma;
+		}
+		for(uint64_t i=0; i<n; i++) cdf[i] /= suma;
+	}
+	uint64_t losuj(Losowanie& r) const{
+		double u = r.ulamek();
+		uint64_t i = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+		return i < cdf.size() ? i : cdf.size()-1;
+	}
+};
+
+enum Rozklad { D_UNIFORM, D_ZIPF, D_SEQ, D_LONG, D_COLLIDE };
+static const char* const nazwyRozkladow[] = { "uniform", "zipf", "seq", "long", "collide" };
+
+/// Zamienia numer klucza na napis.
+class Klucze
+{
+	Rozklad d;
+	unsigned dlugosc;
+	string prefiks;
+public:
+	Klucze(Rozklad r, unsigned L, Losowanie& los):d(r),dlugosc(L){
+		//wspolny poczatek dlugich kluczy - porownania musza przejsc caly prefiks
+		if(d == D_LONG && dlugosc > 20){
+			for(unsigned i=0; i<dlugosc-20; i++)
+				prefiks += static_cast<char>('a' + los.ponizej(26));
+		}
+	}
+	string operator()(uint64_t nr) const{
+		char buf[40];
+		switch(d){
+		case D_LONG:
+			snprintf(buf, sizeof(buf), "%020llu", (unsigned long long)nr);
+			return prefiks + buf;
+		case D_COLLIDE:{
+			//hashF to h = rotl(h,5) ^ k[i], a rotacja o 5*32 bitow jest identycznoscia,
+			//wiec znaki na pozycjach i oraz i+32 wchodza do hasha tak samo i sie znosza.
+			//Kazdy napis postaci XX, |X| = 32, ma wiec ten sam hash.
+			snprintf(buf, sizeof(buf), "%032llu", (unsigned long long)nr);
+			return string(buf) + buf;
+		}
+		default:
+			snprintf(buf, sizeof(buf), "%010llu", (unsigned long long)nr);
+			return buf;
+		}
+	}
+};
+
+static void uzycie(const char* prog)
+{
+	fprintf(stderr, "uzycie: %s [-s ziarno] [-n operacji] [-k kluczy] [-d uniform|zipf|seq|long|collide]\n"
+	                "          [-z theta] [-m insert:remove:modify:read:find] [-L dlugosc] [-o slad.bin]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[])
+{
+	uint64_t ziarno = 1, n = 1000000, k = 100000;
+	Rozklad d = D_UNIFORM;
+	double theta = 0.99;
+	unsigned L = 200;
+	unsigned wagi[OP_COUNT] = { 30, 5, 10, 25, 30 };
+	const char* wyjscie = NULL;
+
+	int c;
+	while((c = getopt(argc, argv, "s:n:k:d:z:m:L:o:")) != -1){
+		switch(c){
+		case 's': ziarno = strtoull(optarg, NULL, 10); break;
+		case 'n': n = strtoull(optarg, NULL, 10); break;
+		case 'k': k = strtoull(optarg, NULL, 10); break;
+		case 'z': theta = atof(optarg); break;
+		case 'L': L = static_cast<unsigned>(atoi(optarg)); break;
+		case 'o': wyjscie = optarg; break;
+		case 'd':
+			if(!strcmp(optarg, "uniform")) d = D_UNIFORM;
+			else if(!strcmp(optarg, "zipf")) d = D_ZIPF;
+			else if(!strcmp(optarg, "seq")) d = D_SEQ;
+			else if(!strcmp(optarg, "long")) d = D_LONG;
+			else if(!strcmp(optarg, "collide")) d = D_COLLIDE;
+			else uzycie(argv[0]);
+			break;
+		case 'm':
+			if(sscanf(optarg, "%u:%u:%u:%u:%u", &wagi[0], &wagi[1], &wagi[2], &wagi[3], &wagi[4]) != OP_COUNT)
+				uzycie(argv[0]);
+			break;
+		default:
+			uzycie(argv[0]);
+		}
+	}
+	unsigned sumaWag = 0;
+	for(int i=0; i<OP_COUNT; i++) sumaWag += wagi[i];
+	if(optind != argc || k == 0 || sumaWag == 0 || (d == D_LONG && L < 21)) uzycie(argv[0]);
+
+	Losowanie los(ziarno);
+	Klucze klucz(d, L, los);
+	Zipf* zipf = d == D_ZIPF ? new Zipf(k, theta) : NULL;
+	//permutacja numerow kluczy dla Zipfa - gorace klucze nie sa sasiadami w mapie
+	vector<uint64_t> perm;
+	if(zipf != NULL){
+		perm.resize(k);
+		for(uint64_t i=0; i<k; i++) perm[i] = i;
+		for(uint64_t i=k-1; i>0; i--) swap(perm[i], perm[los.ponizej(i+1)]);
+	}
+
+	TraceBuilder bin;
+	if(wyjscie == NULL)
+		printf("# workgen -s %llu -n %llu -k %llu -d %s -z %g -m %u:%u:%u:%u:%u -L %u\n",
+		       (unsigned long long)ziarno, (unsigned long long)n, (unsigned long long)k, nazwyRozkladow[d], theta,
+		       wagi[0], wagi[1], wagi[2], wagi[3], wagi[4], L);
+
+	uint64_t wydane = 0;		//dla seq: ile kolejnych kluczy juz wydano
+	for(uint64_t i=0; i<n; i++){
+		unsigned w = static_cast<unsigned>(los.ponizej(sumaWag));
+		int op = 0;
+		while(w >= wagi[op]) w -= wagi[op++];
+
+		uint64_t nr;
+		if(d == D_SEQ){
+			if(op == OP_INSERT || op == OP_MODIFY || wydane == 0) nr = wydane++ % k;
+			else nr = los.ponizej(wydane < k ? wydane : k);
+		}
+		else if(zipf != NULL) nr = perm[zipf->losuj(los)];
+		else nr = los.ponizej(k);
+
+		int val = static_cast<int>(los.ponizej(1000000));
+		if(op != OP_INSERT && op != OP_MODIFY) val = 0;		//tak jak po trace2bin
+		string s = klucz(nr);
+		if(wyjscie != NULL){
+			if(!bin.add(op, s, val)){
+				fprintf(stderr, "za duzo roznych kluczy\n");
+				return EXIT_FAILURE;
+			}
+		}
+		else if(op == OP_INSERT || op == OP_MODIFY)
+			printf("%s %s %d\n", traceOpNames[op], s.c_str(), val);
+		else
+			printf("%s %s\n", traceOpNames[op], s.c_str());
+	}
+	delete zipf;
+
+	if(wyjscie != NULL){
+		if(!bin.write(wyjscie)){
+			fprintf(stderr, "blad zapisu %s\n", wyjscie);
+			return EXIT_FAILURE;
+		}
+		fprintf(stderr, "%llu operacji, %u kluczy\n", (unsigned long long)bin.size(), bin.keyCount());
+	}
+	return EXIT_SUCCESS;
+}
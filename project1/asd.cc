@@ -218,6 +218,7 @@ ListMap::iterator ListMap::erase(ListMap::iterator i)
 {
 	if(i == end()) return i;
 	//sprawdzamy, w ktorym miejscu mapy jest iterator. 
+	Node* nastepny = i.node->next;	//zapamietany przed delete
 	if(i.node == first){	//musimy rozwazyc ten przypadek, zeby na nowo ustawic firsta po usunieciu elementu
 		first = first->next;
 		first->prev = i.node->prev;
@@ -229,7 +230,7 @@ ListMap::iterator ListMap::erase(ListMap::iterator i)
 		i.node->prev->next = i.node->next;
 		delete i.node;
 	}
-	return ++i;
+	return iterator(nastepny);
 }
 
 
@@ -240,10 +241,8 @@ ListMap::iterator ListMap::erase(ListMap::iterator i)
 // @returns iterator adresujacy pierwszy element za usuwanym.
 ListMap::iterator ListMap::erase(ListMap::iterator f, ListMap::iterator l)
 {
-	if(f==l) return erase(l);
-	while(f != l)	erase(f);
-	if(f==end())	return f;
-	return erase(f);
+	while(f != l)	f = erase(f);
+	return f;
 }
 
 
@@ -301,10 +300,10 @@ bool ListMap::info_eq(const ListMap& another) const
 
 
 // preincrementacja
+//za ostatnim elementem jest straznik, czyli end() - na niego tez trzeba moc przejsc
 ListMap::const_iterator& ListMap::const_iterator::operator++()
 {
-	if(node->next->internalDataPointer == NULL)
-		node = node->next;
+	node = node->next;
 	return *this;
 }
 
@@ -312,8 +311,7 @@ ListMap::const_iterator& ListMap::const_iterator::operator++()
 ListMap::const_iterator ListMap::const_iterator::operator++(int)
 {
 	const_iterator tensam(*this);
-	if(node->next->internalDataPointer == NULL)
-		node = node->next;
+	node = node->next;
 	return tensam;
 }
 
@@ -0,0 +1,293 @@
+/**
+@file aisdicompactmap.h
+
+AISDICompactHashMap - a hash map laid out like CPython's compact dict.
+
+The entries live contiguously, in insertion order, in one vector; the hash
+table itself only holds 4-byte indices into that vector (open addressing).
+Iterating is a linear scan of the entry array instead of chasing the
+pnext ring of AISDIHashMap through scattered nodes.
+
+Erasing leaves a hole in the entry array and a tombstone in the table; both
+are compacted away on the next resize. Inserting may resize, which
+invalidates iterators.
+*******************************************************************************/
+
+#ifndef AISDI_COMPACT_MAP_H_
+#define AISDI_COMPACT_MAP_H_
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include <type_traits>
+#include "aisdihashmap.h"
+
+/// A map with a similar interface to std::map, iterated in insertion order.
+template<class K, class V,
+         unsigned long long hashFunc(const K&) = &_fullHash<K> >
+class AISDICompactHashMap
+{
+public:
+	typedef K key_type;
+	typedef V value_type;
+	typedef unsigned size_type;
+	typedef std::pair<key_type,value_type> Para;
+
+	//element tablicy wpisow. Hash jest zapamietany, zeby przebudowa tablicy indeksow
+	//nie musiala liczyc go od nowa
+	struct Entry{
+		Para dane;
+		unsigned long long hash;
+		bool zywy;			//false - dziura po usunietym elemencie
+		Entry(const Para& d, unsigned long long h):dane(d),hash(h),zywy(true){}
+	};
+
+protected:
+	enum { PUSTY = -1, USUNIETY = -2, MIN_ROZMIAR = 8 };
+
+	std::vector<Entry> wpisy;		//elementy w kolejnosci wstawiania
+	std::vector<int32_t> indeksy;	//tablica haszujaca: numery wpisow, PUSTY albo USUNIETY
+	size_type ile;					//liczba zywych elementow
+
+	//numer pola tablicy indeksow z kluczem k albo pierwszego wolnego pola, jak w CPythonie:
+	//i = 5*i + 1 + perturb, kazde pole jest w koncu odwiedzone
+	size_t szukaj(const K& k, unsigned long long h, bool doWstawienia) const{
+		size_t maska = indeksy.size()-1;
+		size_t i = static_cast<size_t>(h) & maska;
+		unsigned long long perturb = h;
+		size_t wolne = static_cast<size_t>(-1);
+		for(;;){
+			int32_t ix = indeksy[i];
+			if(ix == PUSTY)
+				return (doWstawienia && wolne != static_cast<size_t>(-1)) ? wolne : i;
+			if(ix == USUNIETY){
+				if(wolne == static_cast<size_t>(-1)) wolne = i;
+			}
+			else if(wpisy[ix].hash == h && wpisy[ix].dane.first == k)
+				return i;
+			perturb >>= 5;
+			i = (5*i + 1 + static_cast<size_t>(perturb)) & maska;
+		}
+	}
+
+	//nowa tablica indeksow dla n elementow; wpisy sa przy tym scalane (znikaja dziury)
+	void przebuduj(size_type n){
+		size_t rozmiar = MIN_ROZMIAR;
+		while(rozmiar*2 < static_cast<size_t>(n)*3) rozmiar <<= 1;
+		if(ile != wpisy.size()){
+			size_t j = 0;
+			for(size_t i=0; i<wpisy.size(); i++)
+				if(wpisy[i].zywy){
+					if(i != j) wpisy[j] = std::move(wpisy[i]);
+					++j;
+				}
+			wpisy.erase(wpisy.begin()+j, wpisy.end());
+		}
+		indeksy.assign(rozmiar, PUSTY);
+		size_t maska = rozmiar-1;
+		for(size_t e=0; e<wpisy.size(); e++){
+			unsigned long long perturb = wpisy[e].hash;
+			size_t i = static_cast<size_t>(perturb) & maska;
+			while(indeksy[i] != PUSTY){
+				perturb >>= 5;
+				i = (5*i + 1 + static_cast<size_t>(perturb)) & maska;
+			}
+			indeksy[i] = static_cast<int32_t>(e);
+		}
+	}
+
+public:
+	AISDICompactHashMap():indeksy(MIN_ROZMIAR, PUSTY),ile(0){}
+
+	/// const_iterator. Walks the entry array, skipping holes. Stepping back
+	/// from the first element gives end(), as in the ring of AISDIHashMap.
+	class const_iterator : public std::iterator<std::bidirectional_iterator_tag, Para>
+	{
+		friend class AISDICompactHashMap;
+	protected:
+		const AISDICompactHashMap* mapa;
+		size_t poz;
+		const_iterator(const AISDICompactHashMap* m, size_t p):mapa(m),poz(p){}
+	public:
+		typedef Para T;
+		const_iterator():mapa(NULL),poz(0){}
+
+		inline const T& operator*() const { return mapa->wpisy[poz].dane; }
+		inline const T* operator->() const { return &(mapa->wpisy[poz].dane); }
+		inline bool operator==(const const_iterator& a) const { return poz == a.poz && mapa == a.mapa; }
+		inline bool operator!=(const const_iterator& a) const { return !(*this == a); }
+
+		const_iterator& operator++(){
+			do ++poz; while(poz < mapa->wpisy.size() && !mapa->wpisy[poz].zywy);
+			return *this;
+		}
+		const_iterator operator++(int){
+			const_iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+		const_iterator& operator--(){
+			size_t p = poz;
+			while(p > 0)
+				if(mapa->wpisy[--p].zywy){
+					poz = p;
+					return *this;
+				}
+			poz = mapa->wpisy.size();		//przed pierwszym zywym (byc moze za dziurami) nie ma nic
+			return *this;
+		}
+		const_iterator operator--(int){
+			const_iterator tmp = *this;
+			--*this;
+			return tmp;
+		}
+	};
+
+	/// iterator.
+	class iterator : public const_iterator
+	{
+		friend class AISDICompactHashMap;
+		iterator(const AISDICompactHashMap* m, size_t p):const_iterator(m, p){}
+	public:
+		using const_iterator::mapa;
+		using const_iterator::poz;
+		typedef Para T;
+		iterator(){}
+		iterator(const const_iterator& a):const_iterator(a){}
+
+		inline T& operator*() const { return const_cast<AISDICompactHashMap*>(mapa)->wpisy[poz].dane; }
+		inline T* operator->() const { return &(const_cast<AISDICompactHashMap*>(mapa)->wpisy[poz].dane); }
+
+		iterator& operator++(){
+			++(*(const_iterator*)this);
+			return *this;
+		}
+		iterator operator++(int){
+			iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+		iterator& operator--(){
+			--(*(const_iterator*)this);
+			return *this;
+		}
+		iterator operator--(int){
+			iterator tmp = *this;
+			--*this;
+			return tmp;
+		}
+	};
+
+	/// Returns an iterator addressing the first (oldest) element in the map.
+	iterator begin(){
+		size_t p = 0;
+		while(p < wpisy.size() && !wpisy[p].zywy) ++p;
+		return iterator(this, p);
+	}
+	const_iterator begin() const{
+		size_t p = 0;
+		while(p < wpisy.size() && !wpisy[p].zywy) ++p;
+		return const_iterator(this, p);
+	}
+
+	/// Returns an iterator that addresses the location succeeding the last element in a map.
+	iterator end() { return iterator(this, wpisy.size()); }
+	const_iterator end() const { return const_iterator(this, wpisy.size()); }
+
+	/// Inserts an element into the map.
+	/// @returns A pair whose bool component is true if an insertion was
+	///          made and false if the map already contained an element
+	///          associated with that key, and whose iterator component coresponds to
+	///          the address where a new element was inserted or where the element
+	///          was already located.
+	std::pair<iterator, bool> insert(const Para& entry){
+		unsigned long long h = hashFunc(entry.first);
+		size_t i = szukaj(entry.first, h, true);
+		if(indeksy[i] >= 0) return std::make_pair(iterator(this, indeksy[i]), false);
+		//tablica zapelniona w 2/3 (razem z dziurami) - przebudowa i szukamy miejsca jeszcze raz.
+		//Nowa tablica ma miejsce na drugie tyle elementow (jak used*3 w CPythonie) - bez zapasu
+		//przy ile tuz pod 2/3 rozmiaru kazda para erase+insert przebudowywalaby cala tablice
+		if((wpisy.size()+1)*3 > indeksy.size()*2){
+			przebuduj(2*ile+1);
+			i = szukaj(entry.first, h, true);
+		}
+		indeksy[i] = static_cast<int32_t>(wpisy.size());
+		wpisy.push_back(Entry(entry, h));
+		++ile;
+		return std::make_pair(iterator(this, wpisy.size()-1), true);
+	}
+
+	/// Returns an iterator addressing the location of the entry in the map
+	/// that has a key equivalent to the specified one or end().
+	iterator find(const K& k){
+		int32_t ix = indeksy[szukaj(k, hashFunc(k), false)];
+		return iterator(this, ix >= 0 ? static_cast<size_t>(ix) : wpisy.size());
+	}
+	const_iterator find(const K& k) const{
+		int32_t ix = indeksy[szukaj(k, hashFunc(k), false)];
+		return const_iterator(this, ix >= 0 ? static_cast<size_t>(ix) : wpisy.size());
+	}
+
+	/// Inserts an element into a map with a specified key value
+	/// if one with such a key value does not exist.
+	/// @returns Reference to the value component of the element defined by the key.
+	V& operator[](const K& k){
+		return insert(std::make_pair(k, V())).first->second;
+	}
+
+	bool empty() const { return ile == 0; }
+	size_type size() const { return ile; }
+
+	size_type count(const K& k) const { return find(k) != end(); }
+
+	/// Removes an element from the map. Leaves a hole in the entry array.
+	/// @returns The iterator that designates the first element remaining beyond the removed one.
+	iterator erase(iterator it){
+		if(it.poz >= wpisy.size()) return it;
+		Entry& e = wpisy[it.poz];
+		size_t i = szukaj(e.dane.first, e.hash, false);
+		indeksy[i] = USUNIETY;
+		e.zywy = false;
+		e.dane = Para();	//zwolnienie pamieci klucza i wartosci od razu
+		--ile;
+		return ++it;
+	}
+
+	/// Removes a range of elements from the map.
+	iterator erase(iterator first, iterator last){
+		while(first != last) first = erase(first);
+		return last;
+	}
+
+	/// Removes an element from the map.
+	/// @returns The number of elements that have been removed from the map (1 or 0).
+	size_type erase(const K& key){
+		iterator it = find(key);
+		if(it == end()) return 0;
+		erase(it);
+		return 1;
+	}
+
+	/// Erases all the elements of a map.
+	void clear(){
+		wpisy.clear();
+		indeksy.assign(MIN_ROZMIAR, PUSTY);
+		ile = 0;
+	}
+};
+
+/// Picks the map for a policy: AISDIHashMap for chaining, AISDICompactHashMap
+/// when Policy::OPEN_ADDRESSING is set. The open-addressing map always keeps
+/// the full 64-bit _fullHash of every entry and sizes its power-of-two table
+/// itself, so hashFunc and Policy::Buckets only matter for chaining.
+template<class K, class V,
+         unsigned hashFunc(const K&),
+         class Policy = AISDIDefaultPolicy>
+struct AISDIHashMapFor
+{
+	typedef typename std::conditional<Policy::OPEN_ADDRESSING,
+		AISDICompactHashMap<K, V>,
+		AISDIHashMap<K, V, hashFunc, &_compFunc<K>, Policy> >::type type;
+};
+
+#endif
@@ -15,11 +15,27 @@ Copyright (c) 2006 Instytut Informatyki, Politechnika Warszawska
 ALL RIGHTS RESERVED
 *******************************************************************************/
 
+#ifndef AISDI_HASH_MAP_H_
+#define AISDI_HASH_MAP_H_
 
 #include <utility>
 #include <string>
 #include <iostream>
 #include <iterator>
+#include <vector>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <new>
+#include <string.h>
+#include <stdint.h>
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+ #include <coroutine>
+ #include <exception>
+ #define AISDI_COROUTINES 1
+#endif
 
 #define PRINT(x) std::cout << #x"\n";
 
@@ -36,16 +52,490 @@ inline int _compFunc(const Key& key1,const Key& key2)
 };
 
 
+/// Full-width 64-bit hash of a key (FNV-1a), for the places where hashFunc,
+/// usually reduced modulo MAX, is not enough: the Bloom filter in front of
+/// AISDIHashMap and the tables of AISDICompactHashMap.
+template<class K>
+inline unsigned long long _fullHash(const K& k)
+{
+	unsigned long long h = 14695981039346656037ULL;
+	for(unsigned i=0; i<static_cast<unsigned>(k.size()); i++){
+		h ^= static_cast<unsigned char>(k[i]);
+		h *= 1099511628211ULL;
+	}
+	//dodatkowe wymieszanie, zeby gorne bity (numer bloku) zalezaly od calego klucza
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+};
+
+
+/// Blocked Bloom filter: every key sets all of its bits inside a single
+/// 64-byte block, so a query touches exactly one cache line.
+/// It only answers "definitely absent" or "maybe present".
+class AISDIBloomFilter
+{
+public:
+	typedef unsigned size_type;
+	enum { BITS_PER_KEY = 10, PROBES = 6, BLOCK_BITS = 512 };
+
+	struct alignas(64) Block{
+		unsigned long long w[BLOCK_BITS/64];
+	};
+
+	AISDIBloomFilter():blocks(NULL),mask(0),cap(0){}
+	~AISDIBloomFilter(){ delete[] blocks; }
+
+	/// Discards the contents and resizes the filter for the given number of keys.
+	void reset(size_type expected){
+		size_type n = 1;
+		while(n*BLOCK_BITS < static_cast<unsigned long long>(expected)*BITS_PER_KEY) n <<= 1;
+		if(n-1 != mask || blocks == NULL){
+			delete[] blocks;
+			blocks = new Block[n];
+			mask = n-1;
+		}
+		for(size_type i=0; i<n; i++)
+			for(int j=0; j<BLOCK_BITS/64; j++) blocks[i].w[j] = 0;
+		cap = n*BLOCK_BITS/BITS_PER_KEY;
+	}
+
+	/// Makes this filter an exact copy of a.
+	void assign(const AISDIBloomFilter& a){
+		if(mask != a.mask || blocks == NULL){
+			delete[] blocks;
+			blocks = new Block[a.mask+1];
+			mask = a.mask;
+		}
+		memcpy(blocks, a.blocks, (a.mask+1)*sizeof(Block));
+		cap = a.cap;
+	}
+
+	/// Number of keys the filter was sized for.
+	size_type capacity() const{
+		return cap;
+	}
+
+	void add(unsigned long long h){
+		Block& b = blocks[static_cast<size_type>(h>>32) & mask];
+		unsigned h1 = static_cast<unsigned>(h), h2 = (h1>>17)|(h1<<15);
+		for(int i=0; i<PROBES; i++, h1+=h2)
+			b.w[(h1>>6)&7] |= 1ULL<<(h1&63);
+	}
+
+	bool mayContain(unsigned long long h) const{
+		const Block& b = blocks[static_cast<size_type>(h>>32) & mask];
+		unsigned h1 = static_cast<unsigned>(h), h2 = (h1>>17)|(h1<<15);
+		for(int i=0; i<PROBES; i++, h1+=h2)
+			if(!(b.w[(h1>>6)&7] & (1ULL<<(h1&63)))) return false;
+		return true;
+	}
+
+private:
+	Block* blocks;
+	size_type mask;		//liczba blokow - 1 (liczba blokow jest potega dwojki)
+	size_type cap;
+	AISDIBloomFilter(const AISDIBloomFilter&);
+	AISDIBloomFilter& operator=(const AISDIBloomFilter&);
+};
+
+
+/// Address of the bytes of a key that a comparison reads. For std::string
+/// that is its character buffer, which for long keys is a separate allocation.
+template<class K>
+inline const void* _keyBuffer(const K& k)
+{
+	return &k;
+};
+
+inline const void* _keyBuffer(const std::string& k)
+{
+	return k.data();
+};
+
+
+#ifdef AISDI_COROUTINES
+/// Frames of the lookup coroutines are all the same size, so instead of
+/// going to the heap for every lookup they are recycled through a per-thread list.
+class AISDIFramePool
+{
+	struct Lista{
+		void* glowa;
+		size_t rozmiar;
+		Lista():glowa(NULL),rozmiar(0){}
+		~Lista(){
+			while(glowa != NULL){
+				void* nast = *static_cast<void**>(glowa);
+				::operator delete(glowa);
+				glowa = nast;
+			}
+		}
+	};
+	static Lista& lista(){
+		thread_local Lista l;
+		return l;
+	}
+public:
+	static void* get(size_t n){
+		Lista& l = lista();
+		if(l.glowa == NULL || l.rozmiar != n) return ::operator new(n);
+		void* p = l.glowa;
+		l.glowa = *static_cast<void**>(p);
+		return p;
+	}
+	static void put(void* p, size_t n){
+		Lista& l = lista();
+		if(l.glowa == NULL) l.rozmiar = n;
+		if(n != l.rozmiar){
+			::operator delete(p);
+			return;
+		}
+		*static_cast<void**>(p) = l.glowa;
+		l.glowa = p;
+	}
+};
+
+/// One suspended lookup of AISDIHashMap::find_interleaved. It starts running
+/// as soon as it is created and stays around after finishing until destroyed.
+struct AISDILookup
+{
+	struct promise_type{
+		AISDILookup get_return_object(){
+			return AISDILookup(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+		std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+		void return_void(){}
+		void unhandled_exception(){ std::terminate(); }
+		static void* operator new(size_t n){ return AISDIFramePool::get(n); }
+		static void operator delete(void* p, size_t n){ AISDIFramePool::put(p, n); }
+	};
+
+	std::coroutine_handle<promise_type> h;
+	AISDILookup(){}
+	explicit AISDILookup(std::coroutine_handle<promise_type> a):h(a){}
+};
+#endif
+
+
+/// Fixed-size blocks for map nodes, carved out of CHUNK-sized chunks (or
+/// bigger ones, a power of two, when a single block would not fit in CHUNK).
+/// Freed blocks go on a free list and are handed out again before any new
+/// memory is taken; shrink() returns the chunks none of whose blocks is in use.
+/// Chunks are numbered, so after copyLayoutFrom() an address from the source
+/// pool is translated by rebase() in O(1).
+/// Not safe for use from several threads at once.
+class AISDINodePool
+{
+public:
+	enum { CHUNK = 64*1024 };
+
+	/// Pool of blocks of (at least) rozmiar bytes, aligned to wyrownanie
+	/// (a power of two; never less than a pointer, which the free list keeps in a block).
+	explicit AISDINodePool(size_t rozmiar, size_t wyrownanie = alignof(void*)):
+		wyr(wyrownanie < alignof(void*) ? alignof(void*) : wyrownanie),
+		blok((rozmiar + wyr-1) & ~(wyr-1)),naglowek((sizeof(Chunk) + wyr-1) & ~(wyr-1)),
+		kawalek(CHUNK),wolne(NULL),cur(NULL),last(NULL){
+		while(kawalek < naglowek + blok) kawalek *= 2;		//kazdy kawalek miesci co najmniej jeden blok
+	}
+	~AISDINodePool(){ release(); }
+
+	size_t blockSize() const{
+		return blok;
+	}
+
+	size_t alignment() const{
+		return wyr;
+	}
+
+	/// Raw memory for one block.
+	void* alloc(){
+		void* p;
+		if(wolne != NULL){
+			p = wolne;
+			wolne = *static_cast<void**>(p);
+		}
+		else{
+			if(cur == last) grow();
+			p = cur;
+			cur += blok;
+		}
+		++chunkOf(p)->zajete;
+		return p;
+	}
+
+	/// Up to k never used blocks lying one after another, taken in O(1) - for
+	/// a caller that hands them out itself. Sets k to the number given (at
+	/// least 1); all of them count as in use until they are free()d.
+	char* allocRun(size_t& k){
+		if(cur == last) grow();
+		size_t jest = static_cast<size_t>(last - cur)/blok;
+		if(k > jest) k = jest;
+		char* p = cur;
+		cur += k*blok;
+		chunkOf(p)->zajete += k;
+		return p;
+	}
+
+	/// Gives back a block from alloc(); whatever lived in it must already be destroyed.
+	void free(void* p){
+		--chunkOf(p)->zajete;
+		*static_cast<void**>(p) = wolne;
+		wolne = p;
+	}
+
+	/// Returns to the system every chunk that has no block in use.
+	void shrink(){
+		std::vector<Chunk*> zostaja;
+		for(size_t i=0; i<chunks.size(); i++)
+			if(chunks[i]->zajete != 0) zostaja.push_back(chunks[i]);
+		if(zostaja.size() == chunks.size()) return;
+		//z listy wolnych znikaja bloki zwalnianych kawalkow
+		void** ogon = &wolne;
+		for(void* p = wolne; p != NULL; p = *static_cast<void**>(p))
+			if(chunkOf(p)->zajete != 0){
+				*ogon = p;
+				ogon = static_cast<void**>(p);
+			}
+		*ogon = NULL;
+		if(cur != NULL && chunkOf(cur - blok)->zajete == 0) cur = last = NULL;
+		for(size_t i=0; i<chunks.size(); i++)
+			if(chunks[i]->zajete == 0) ::operator delete(chunks[i], std::align_val_t(kawalek));
+		chunks.swap(zostaja);
+		for(size_t i=0; i<chunks.size(); i++) chunks[i]->nr = i;
+	}
+
+	/// Makes this pool a copy of the layout of a: as many chunks, with the
+	/// same blocks in use and the same ones free. Block contents are not
+	/// copied - the owner constructs its copies at rebase() of the originals.
+	void copyLayoutFrom(const AISDINodePool& a){
+		release();
+		wyr = a.wyr;
+		blok = a.blok;
+		naglowek = a.naglowek;
+		kawalek = a.kawalek;
+		chunks.reserve(a.chunks.size());
+		for(size_t i=0; i<a.chunks.size(); i++){
+			Chunk* c = static_cast<Chunk*>(::operator new(kawalek, std::align_val_t(kawalek)));
+			c->zajete = a.chunks[i]->zajete;
+			c->nr = i;
+			chunks.push_back(c);
+		}
+		void** ogon = &wolne;
+		for(void* p = a.wolne; p != NULL; p = *static_cast<void**>(p)){
+			*ogon = rebase(p);
+			ogon = static_cast<void**>(*ogon);
+		}
+		*ogon = NULL;
+		//biezacy kawalek jest zawsze ostatni; cur moze wskazywac tuz za jego koniec
+		if(a.cur != NULL){
+			cur = reinterpret_cast<char*>(chunks.back()) + (a.cur - reinterpret_cast<const char*>(a.chunks.back()));
+			last = reinterpret_cast<char*>(chunks.back()) + (a.last - reinterpret_cast<const char*>(a.chunks.back()));
+		}
+	}
+
+	/// Translates the address of a block of the pool this one copied its
+	/// layout from into the same block of this pool. NULL stays NULL.
+	template<class T>
+	T* rebase(const T* p) const{
+		if(p == NULL) return NULL;
+		const Chunk* z = chunkOf(p);
+		return reinterpret_cast<T*>(reinterpret_cast<char*>(chunks[z->nr])
+			+ (reinterpret_cast<const char*>(p) - reinterpret_cast<const char*>(z)));
+	}
+
+	/// Frees all chunks at once, whether their blocks are in use or not.
+	void release(){
+		for(size_t i=0; i<chunks.size(); i++)
+			::operator delete(chunks[i], std::align_val_t(kawalek));
+		chunks.clear();
+		wolne = NULL;
+		cur = last = NULL;
+	}
+
+	/// Bytes taken from the system.
+	size_t bytesReserved() const{
+		return chunks.size()*kawalek;
+	}
+
+private:
+	struct Chunk{
+		size_t zajete;		//liczba wydanych blokow
+		size_t nr;			//numer kawalka w chunks
+	};
+	size_t wyr;
+	size_t blok;
+	size_t naglowek;	//naglowek kawalka zaokraglony do wyr - od tego miejsca zaczynaja sie bloki
+	size_t kawalek;		//rozmiar i wyrownanie kawalka: CHUNK albo wiecej dla duzych blokow
+	std::vector<Chunk*> chunks;
+	void* wolne;		//lista wolnych blokow, polaczona przez ich pierwsze slowo
+	char* cur;			//nastepny nigdy nie wydany blok biezacego kawalka
+	char* last;			//koniec miejsca na bloki w biezacym kawalku
+
+	//kawalki sa wyrownane do swojego rozmiaru, wiec naglowek kawalka to adres bloku wyrownany w dol
+	Chunk* chunkOf(const void* p) const{
+		return reinterpret_cast<Chunk*>(reinterpret_cast<uintptr_t>(p) & ~static_cast<uintptr_t>(kawalek-1));
+	}
+
+	void grow(){
+		Chunk* c = static_cast<Chunk*>(::operator new(kawalek, std::align_val_t(kawalek)));
+		c->zajete = 0;
+		c->nr = chunks.size();
+		chunks.push_back(c);
+		cur = reinterpret_cast<char*>(c) + naglowek;
+		last = cur + (kawalek - naglowek)/blok*blok;
+	}
+
+	AISDINodePool(const AISDINodePool&);
+	AISDINodePool& operator=(const AISDINodePool&);
+};
+
+/// Allocator handing out single objects from an AISDINodePool (larger
+/// requests, or no pool, go to operator new), so a std::set can keep its
+/// nodes in the pool of the map that owns it.
+template<class T>
+struct AISDIPoolAllocator
+{
+	typedef T value_type;
+	AISDINodePool* pula;
+
+	explicit AISDIPoolAllocator(AISDINodePool* p = NULL):pula(p){}
+	template<class U> AISDIPoolAllocator(const AISDIPoolAllocator<U>& a):pula(a.pula){}
+
+	T* allocate(size_t n){
+		if(fromPool(n)) return static_cast<T*>(pula->alloc());
+		return static_cast<T*>(::operator new(n*sizeof(T)));
+	}
+	void deallocate(T* p, size_t n){
+		if(fromPool(n)) pula->free(p);
+		else ::operator delete(p);
+	}
+	bool fromPool(size_t n) const{
+		return pula != NULL && n == 1 && sizeof(T) <= pula->blockSize() && alignof(T) <= pula->alignment();
+	}
+
+	template<class U> bool operator==(const AISDIPoolAllocator<U>& a) const { return pula == a.pula; }
+	template<class U> bool operator!=(const AISDIPoolAllocator<U>& a) const { return pula != a.pula; }
+};
 
 
 #define MAX 64000
 
+/// Bucket sizing policies for AISDIHashPolicy. Each one fixes the number of
+/// buckets at compile time and turns the value of hashFunc into a bucket number.
+
+/// N buckets, bucket = h % N. A constant divisor is compiled into a
+/// multiplication, not a division. With N == MAX and hashF, which already
+/// returns h % MAX, this is the original layout of AISDIHashMap.
+template<unsigned N>
+struct AISDIFixedBuckets
+{
+	enum { BUCKETS = N };
+	static inline unsigned index(unsigned h){ return h % N; }
+};
+
+/// 2^BITS buckets, bucket = low bits of h after folding the high half into
+/// them (as in java.util.HashMap), so weak hashes still use every bucket.
+template<unsigned BITS>
+struct AISDIPow2Buckets
+{
+	enum { BUCKETS = 1u << BITS };
+	static inline unsigned index(unsigned h){ return (h ^ (h >> 16)) & (BUCKETS-1); }
+};
+
+constexpr bool _isPrime(unsigned n)
+{
+	if(n < 2) return false;
+	for(unsigned d=2; d*d<=n; d++)
+		if(n % d == 0) return false;
+	return true;
+}
+
+/// P buckets, P prime, bucket = h mod P computed with Lemire's fastmod:
+/// two multiplications and no division.
+template<unsigned P>
+struct AISDIPrimeBuckets
+{
+	static_assert(_isPrime(P), "AISDIPrimeBuckets needs a prime number of buckets");
+	enum { BUCKETS = P };
+	static const unsigned long long M = ~0ULL / P + 1;
+	static inline unsigned index(unsigned h){
+		return static_cast<unsigned>((static_cast<unsigned __int128>(M * h) * P) >> 64);
+	}
+};
+
+/// Compile-time configuration of AISDIHashMap.
+/// @param Sizing AISDIFixedBuckets, AISDIPow2Buckets or AISDIPrimeBuckets.
+/// @param CACHE Keep the value of hashFunc in every node: chains compare it
+///        before the keys and erase/copy never hash again.
+/// @param OPEN Open addressing instead of chaining; see AISDIHashMapFor in
+///        aisdicompactmap.h. AISDIHashMap itself always chains.
+/// @param CLOCK Give every node the reference bit of the CLOCK cache mode
+///        (see AISDIHashMap::setCapacity); without it CLOCK falls back to LRU.
+template<class Sizing, bool CACHE = false, bool OPEN = false, bool CLOCK = false>
+struct AISDIHashPolicy
+{
+	typedef Sizing Buckets;
+	enum { CACHE_HASH = CACHE, OPEN_ADDRESSING = OPEN, CLOCK_BIT = CLOCK };
+};
+
+typedef AISDIHashPolicy<AISDIFixedBuckets<MAX> > AISDIDefaultPolicy;
+
+/// The value of hashFunc kept in a node, or nothing if the policy says so.
+template<bool CACHE>
+struct AISDINodeHash
+{
+	inline void setHash(unsigned){}
+	inline void copyHash(const AISDINodeHash&){}
+	inline bool hashDiffers(unsigned) const { return false; }
+};
+
+template<>
+struct AISDINodeHash<true>
+{
+	unsigned hash;
+	inline void setHash(unsigned h){ hash = h; }
+	inline void copyHash(const AISDINodeHash& a){ hash = a.hash; }
+	inline bool hashDiffers(unsigned h) const { return hash != h; }
+};
+
+/// The CLOCK reference bit of a node, or nothing if the policy says so.
+template<bool CLOCK>
+struct AISDINodeClock
+{
+	inline void setUsed(bool){}
+	inline void copyUsed(const AISDINodeClock&){}
+	inline bool used() const { return false; }
+};
+
+template<>
+struct AISDINodeClock<true>
+{
+	bool uzyty;
+	AISDINodeClock():uzyty(false){}
+	inline void setUsed(bool u){ uzyty = u; }
+	inline void copyUsed(const AISDINodeClock& a){ uzyty = a.uzyty; }
+	inline bool used() const { return uzyty; }
+};
+
 /// A map with a similar interface to std::map.
+/// A bucket whose chain grows past TREEIFY_THRESHOLD also gets a balanced
+/// tree ordered by _fullHash and then by operator< of K, so even keys that
+/// all land in one bucket are found in O(log n).
+/// The number of buckets and whether nodes cache their hash are set by
+/// Policy (AISDIHashPolicy); the default is MAX buckets and no cache.
 template<class K, class V,
          unsigned hashFunc(const K&),
-         int compFunc(const K&,const K&)=&_compFunc<K> >
+         int compFunc(const K&,const K&)=&_compFunc<K>,
+         class Policy = AISDIDefaultPolicy>
 class AISDIHashMap
 {
+	static_assert(!Policy::OPEN_ADDRESSING, "AISDIHashMap chains - use AISDIHashMapFor for open addressing");
+	typedef typename Policy::Buckets Buckets;
+	enum { BUCKETS = Buckets::BUCKETS };
+	typedef std::integral_constant<bool, Policy::CACHE_HASH> CacheHash;
+
 public:
 	typedef K key_type;
 	typedef V value_type;
@@ -54,8 +544,9 @@ public:
 	
 	
 	//struktura opakowujaca element hashmapy. Kazdy element przechowuje wskaznik na nastepny i poprzedni w piercieniu
-	//oraz nastepny i poprzedni w miniliscie hashmapy
-	struct HNode{
+	//oraz nastepny i poprzedni w miniliscie hashmapy (i, jesli tak chce Policy, wartosc hashFunc klucza
+	//oraz bit odwolania dla trybu CLOCK - patrz setCapacity).
+	struct HNode : public AISDINodeHash<Policy::CACHE_HASH>, public AISDINodeClock<Policy::CLOCK_BIT>{
 		HNode* pnext;
 		HNode* pprev;
 		HNode* lnext;
@@ -66,29 +557,175 @@ public:
 	};
 	
 protected:
-	HNode* tablica[MAX];	//tablica wskaznikow na wezly pierscienia
+	//wpis drzewa dlugiej minilisty: pelny hash klucza, sam klucz (w wezle) i wezel
+	struct TreeEntry{
+		unsigned long long hash;
+		const K* klucz;
+		HNode* node;
+		TreeEntry(unsigned long long h, const K* k, HNode* n):hash(h),klucz(k),node(n){}
+	};
+	//porzadek w drzewie: najpierw pelny hash, przy rownych hashach klucz (operator<)
+	struct TreeOrder{
+		bool operator()(const TreeEntry& a, const TreeEntry& b) const{
+			if(a.hash != b.hash) return a.hash < b.hash;
+			return *a.klucz < *b.klucz;
+		}
+	};
+	typedef AISDIPoolAllocator<TreeEntry> TreeAlloc;
+	typedef std::set<TreeEntry, TreeOrder, TreeAlloc> Tree;
+	//wezel std::set to kolor i trzy wskazniki oraz wpis - na tyle bajtow sa bloki puli drzew
+	enum { TREE_NODE = 4*sizeof(void*) + sizeof(TreeEntry) };
+
+	HNode* tablica[BUCKETS];	//tablica wskaznikow na wezly pierscienia
+	Tree** drzewa;			//drzewa dla komorek z dluga minilista (NULL - zadna komorka nie ma drzewa)
 	HNode* Sentinel;		//straznik pierscienia
+	AISDINodePool wezly;	//pamiec na wezly; usuniete wezly wracaja na jej liste wolnych
+	AISDINodePool wezlyDrzew;	//pamiec na wezly drzew komorek
+	size_type ile;			//liczba elementow mapy
+	AISDIBloomFilter* bloom;	//opcjonalny filtr Blooma przed tablica (NULL - wylaczony)
+	size_type bloomStale;	//liczba kluczy usunietych od ostatniej przebudowy filtra
 
 public: 
+	/// Bloom filter counters, see bloomStats().
+	struct BloomStats{
+		unsigned long lookups;			///< find() calls that consulted the filter
+		unsigned long rejected;			///< definite misses answered by the filter alone
+		unsigned long falsePositives;	///< filter said "maybe", the chain did not have the key
+	};
+
+	/// Replacement policies of the bounded cache mode, see setCapacity().
+	enum CacheMode { LRU, CLOCK };
+
+	/// Cache counters, see cacheStats().
+	struct CacheStats{
+		unsigned long hits;			///< find()/operator[] found the key
+		unsigned long misses;		///< find()/operator[] did not find the key
+		unsigned long evictions;	///< elements removed to stay within the capacity
+	};
+
+protected:
+	mutable BloomStats bstats;
+	size_type pojemnosc;	//najwieksza liczba elementow w trybie cache (0 - bez ograniczenia)
+	CacheMode tryb;
+	CacheStats cstats;
+
+public:
 	//konstruktor domyslny HashMapy. Ustawia odpowiednio straznika
-	AISDIHashMap(){
+	AISDIHashMap():drzewa(NULL),wezly(sizeof(HNode), alignof(HNode)),wezlyDrzew(TREE_NODE),ile(0),bloom(NULL),bloomStale(0),pojemnosc(0),tryb(LRU){
 		//PRINT(konstruktor);
 		//utworzenie nowego elementu
 		Sentinel = new HNode();
 		Sentinel->pnext = Sentinel;
 		Sentinel->pprev = Sentinel;
-		for(size_type i=0; i<MAX; i++) tablica[i] = NULL;
+		for(size_type i=0; i<BUCKETS; i++) tablica[i] = NULL;
+		resetBloomStats();
+		resetCacheStats();
+#ifdef AISDI_BLOOM
+		enableBloom();
+#endif
 	}
 	
 	//destruktor HashMapy. Wywoluje clear
 	~AISDIHashMap(){
 		//PRINT(~AISDIHashMap);
 		if(!empty()) clear();
+		if(drzewa != NULL){
+			for(size_type i=0; i<BUCKETS; i++) delete drzewa[i];
+			delete[] drzewa;
+		}
 		delete Sentinel;
+		delete bloom;
+	}
+
+	/// Puts a blocked Bloom filter in front of the table. Lookups of keys
+	/// the filter rejects return end() without touching the buckets.
+	/// Defining AISDI_BLOOM turns it on in every map by default.
+	void enableBloom(){
+		if(bloom == NULL){
+			bloom = new AISDIBloomFilter();
+			rebuildBloom();
+		}
 	}
 
-	/// Coping constructor.
-	explicit AISDIHashMap(const AISDIHashMap<K, V, hashFunc, compFunc>& a);
+	/// Removes the Bloom filter.
+	void disableBloom(){
+		delete bloom;
+		bloom = NULL;
+	}
+
+	/// Returns the Bloom filter counters. falsePositives/(lookups-rejected)
+	/// is the measured false-positive rate of the misses that got past the filter.
+	const BloomStats& bloomStats() const{
+		return bstats;
+	}
+
+	void resetBloomStats(){
+		bstats.lookups = bstats.rejected = bstats.falsePositives = 0;
+	}
+
+	/// Turns the map into a cache of at most n elements (0 - no bound, the
+	/// default). The ring of all nodes is the recency list: inserting a new
+	/// key into a full map first evicts the element at the end of the ring.
+	/// In LRU mode every hit of find(), operator[] or insert() moves the node
+	/// to the front of the ring. In CLOCK mode a hit only sets the node's
+	/// reference bit; eviction gives nodes with the bit set a second chance.
+	/// The bit is only there with a Policy that sets CLOCK; with any other
+	/// policy CLOCK mode is LRU. Both are O(1) (CLOCK amortized). A smaller
+	/// n evicts at once.
+	/// const find(), find_batch() and find_interleaved() do not count as hits.
+	void setCapacity(size_type n, CacheMode m = LRU){
+		pojemnosc = n;
+		tryb = Policy::CLOCK_BIT ? m : LRU;
+		if(pojemnosc != 0) evict(pojemnosc);
+	}
+
+	/// Returns the capacity set by setCapacity() (0 - no bound).
+	size_type capacity() const{
+		return pojemnosc;
+	}
+
+	/// Returns the cache counters. They only change while a capacity is set.
+	const CacheStats& cacheStats() const{
+		return cstats;
+	}
+
+	void resetCacheStats(){
+		cstats.hits = cstats.misses = cstats.evictions = 0;
+	}
+
+	/// Coping constructor. The node pool is copied chunk by chunk: every
+	/// node is constructed at the same place in the copy's pool as in a's,
+	/// so links are translated in O(1) and no key is hashed again (trees keep
+	/// their stored hashes, the Bloom filter is copied bit for bit).
+	/// The copy iterates in the same order as a, so a cache keeps its
+	/// capacity, mode, recency order and CLOCK reference bits.
+	explicit AISDIHashMap(const AISDIHashMap<K, V, hashFunc, compFunc, Policy>& a):drzewa(NULL),wezly(sizeof(HNode), alignof(HNode)),wezlyDrzew(TREE_NODE),
+		ile(a.ile),bloom(NULL),bloomStale(a.bloomStale),pojemnosc(a.pojemnosc),tryb(a.tryb){
+		Sentinel = new HNode();
+		wezly.copyLayoutFrom(a.wezly);
+		//kazdy wezel a jest na pierscieniu - jedno przejscie po nim tworzy wszystkie kopie
+		for(const HNode* z = a.Sentinel->pnext; z != a.Sentinel; z = z->pnext){
+			HNode* tmp = new(wezly.rebase(z)) HNode(z->dane);
+			tmp->copyHash(*z);
+			tmp->copyUsed(*z);
+			tmp->pnext = rebase(a, z->pnext);
+			tmp->pprev = rebase(a, z->pprev);
+			tmp->lnext = wezly.rebase(z->lnext);
+			tmp->lprev = wezly.rebase(z->lprev);
+		}
+		Sentinel->pnext = rebase(a, a.Sentinel->pnext);
+		Sentinel->pprev = rebase(a, a.Sentinel->pprev);
+		for(size_type i=0; i<BUCKETS; i++){
+			tablica[i] = wezly.rebase(a.tablica[i]);
+			if(a.drzewa != NULL && a.drzewa[i] != NULL) copyTree(a, i);
+		}
+		resetBloomStats();
+		resetCacheStats();
+		if(a.bloom != NULL){
+			bloom = new AISDIBloomFilter();
+			bloom->assign(*a.bloom);
+		}
+	}
 
 	/// const_iterator.
 	class const_iterator : public std::iterator<std::forward_iterator_tag, Para >
@@ -114,32 +751,32 @@ public:
 			return node != a.node;
 		}
 		
+		//pierscien zamyka sie na strazniku, wiec po ostatnim elemencie dochodzimy do end()
 		const_iterator& operator++(){
-			if(node->pnext != Sentinel)
-				node = node->pnext;
+			node = node->pnext;
 			return *this;
 		}
 		const_iterator operator++(int){
-			if(node->pnext != Sentinel){
-				HNode* temp = new HNode();
-				temp = node;
-				node = node->pnext;
-				return temp;
-			}
-			return this;
+			HNode* temp = node;
+			node = node->pnext;
+			return temp;
 		}	
 		const_iterator& operator--(){
-			if(node->pprev !=Sentinel)
-				return const_iterator(node->pprev);
+			node = node->pprev;
+			return *this;
+		}
+		const_iterator operator--(int){
+			HNode* temp = node;
+			node = node->pprev;
+			return temp;
 		}
-		const_iterator operator--(int);
 	};
 	/// iterator.
 	class iterator : public const_iterator
 	{
 	public:
 		friend class AISDIHashMap;
-		HNode* node;
+		using const_iterator::node;
 		typedef std::pair<key_type, value_type> T;
 		iterator(){}
 		iterator(HNode* x):const_iterator(x){}
@@ -159,25 +796,21 @@ public:
 			return node != a.node;
 		}
 		iterator& operator++(){
-			if(node->pnext != Sentinel)
-				node = node->pnext;
+			node = node->pnext;
 			return *this;
 		}
 		iterator operator++(int){
 			HNode* tmp = node;
-			if(node->pnext != Sentinel)
-				node = node->pnext;
+			node = node->pnext;
 			return tmp;
 		}
 		iterator& operator--(){
-			if(node->pprev != Sentinel)
-				node = node->pprev;
+			node = node->pprev;
 			return *this;
 		}
 		iterator operator--(int){
 			HNode* tmp = node;
-			if(node->pprev != Sentinel)
-				node = node->pprev;
+			node = node->pprev;
 			return tmp;
 		}
 	};
@@ -216,63 +849,271 @@ public:
 	///          the address where a new element was inserted or where the element
 	///          was already located.
 	std::pair<iterator, bool> insert(const std::pair<K, V>& entry){
-		iterator it = find(entry.first);
-		if(it.node != Sentinel){
-			return std::make_pair(it,false);
+		unsigned h = hashFunc(entry.first);
+		HNode* jest = findNode(entry.first, h);
+		if(jest != Sentinel){
+			if(pojemnosc != 0) touch(jest);
+			return std::make_pair(iterator(jest),false);
 		}
-		else{
-			//utworzenie nowego elementu
-			HNode* tmp = new HNode(entry);
-			//wstawienie go na poczatku pierscienia
-			Sentinel->pnext->pprev = tmp;
-			tmp->pnext = Sentinel->pnext;
-			Sentinel->pnext = tmp;
-			tmp->pprev = Sentinel;
-			//wstawianie do minilisty
-			size_type Index = hashFunc(entry.first);		//znajduje miejsce w tablicy hashujacej
-			//nastepna wartosc na miniliscie po wstawianym elemencie to ten akurat znajdujacy sie w danym polu tablicy
-			tmp->lnext = tablica[Index];					
-			tablica[Index] = tmp;							//nowy element zostaje wpisany w pole tablicy
-			if(tmp->lnext != NULL)							//jesli w polu tablicy jakis element sie znajdowal
-				tmp->lnext->lprev = tmp;					//...to jego poprzednim elementem na miniliscie bedzie ten wstawiany
-			return std::make_pair(iterator(tmp), true);
+		else
+			return std::make_pair(iterator(insertNew(entry, h)), true);
+	}
+
+	/// Inserts all pairs of [first, last) - a random access range - using
+	/// several threads (0 - as many as the hardware has).
+	/// Every thread hashes its part of the input and counts the pairs for
+	/// each range of buckets; after a prefix sum of those counts the threads
+	/// scatter their pairs to the ranges, and then every thread links the
+	/// nodes of its own range of buckets without any locking. Node memory is
+	/// taken from the pool in runs of BUILD_RUN blocks, the only step done
+	/// under a lock; runs are fresh memory, so blocks freed by earlier erases
+	/// are not reused by this call. Serial work left is O(threads^2 + duplicates) plus the
+	/// pairs falling into buckets that were already treeified before the
+	/// call: those trees share the node pool, so one thread links them at the end.
+	/// Like insert(), the first pair with a given key wins.
+	/// @returns The number of elements inserted.
+	template<class RandomIt>
+	size_type build_from(RandomIt first, RandomIt last, unsigned watki = 0){
+		size_type n = static_cast<size_type>(last - first);
+		if(watki == 0) watki = std::thread::hardware_concurrency();
+		if(watki == 0) watki = 1;
+		if(watki > n/BUILD_MIN_PER_THREAD) watki = n/BUILD_MIN_PER_THREAD;
+		if(watki <= 1){
+			size_type przed = ile;
+			for(; first != last; ++first) insert(*first);
+			return ile - przed;
+		}
+
+		//1. hashe wszystkich kluczy i numery ich komorek; kazdy watek liczy swoj kawalek wejscia
+		//i ile jego par trafia do przedzialu komorek kazdego watku. Watek p dostaje komorki
+		//[BUCKETS*p/watki, BUCKETS*(p+1)/watki). Tablice n elementow nie sa zerowane
+		std::unique_ptr<unsigned[]> hashe(new unsigned[n]);
+		std::unique_ptr<size_type[]> idx(new size_type[n]);
+		std::unique_ptr<size_type[]> kolejnosc(new size_type[n]);
+		std::vector<size_type> licznik(watki*watki, 0);		//[kawalek wejscia*watki + przedzial]
+		auto kawalek = [&](unsigned t){ return n/watki*t; };
+		auto koniecKawalka = [&](unsigned t){ return t+1 == watki ? n : n/watki*(t+1); };
+		std::vector<std::thread> pula;
+		for(unsigned t=0; t<watki; t++)
+			pula.push_back(std::thread([&, t]{
+				size_type* l = &licznik[t*watki];
+				for(size_type i = kawalek(t); i < koniecKawalka(t); i++){
+					hashe[i] = hashFunc(first[i].first);
+					idx[i] = Buckets::index(hashe[i]);
+					++l[czescDla(idx[i], watki)];
+				}
+			}));
+		for(unsigned t=0; t<watki; t++) pula[t].join();
+		pula.clear();
+
+		//2. sortowanie przez zliczanie: sumy prefiksowe licznikow (po przedzialach, a w przedziale
+		//po kawalkach wejscia) daja kazdemu watkowi jego miejsca w kazdym przedziale, wiec kolejnosc
+		//wejscia wewnatrz przedzialu zostaje zachowana
+		std::vector<size_type> poczatek(watki+1, 0);
+		size_type suma = 0;
+		for(unsigned p=0; p<watki; p++){
+			poczatek[p] = suma;
+			for(unsigned t=0; t<watki; t++){
+				size_type ile_t = licznik[t*watki + p];
+				licznik[t*watki + p] = suma;
+				suma += ile_t;
+			}
+		}
+		poczatek[watki] = suma;
+		for(unsigned t=0; t<watki; t++)
+			pula.push_back(std::thread([&, t]{
+				size_type* wolne = &licznik[t*watki];
+				for(size_type i = kawalek(t); i < koniecKawalka(t); i++)
+					kolejnosc[wolne[czescDla(idx[i], watki)]++] = i;
+			}));
+		for(unsigned t=0; t<watki; t++) pula[t].join();
+		pula.clear();
+
+		//3. kazdy watek wiaze wezly tylko w swoich komorkach i buduje wlasny kawalek pierscienia.
+		//Tablica drzew musi byc gotowa wczesniej - watki zmieniaja tylko swoje pola. Pula wezlow
+		//nie jest bezpieczna dla watkow: watek bierze z niej pod blokada cale serie blokow
+		if(drzewa == NULL) allocTrees();
+		std::mutex blokadaPuli;
+		std::vector<char*> seria(watki, (char*)NULL);
+		std::vector<size_t> wSerii(watki, 0);
+		auto miejsce = [&](unsigned p) -> void*{
+			if(wSerii[p] == 0){
+				std::lock_guard<std::mutex> l(blokadaPuli);
+				wSerii[p] = BUILD_RUN;
+				seria[p] = wezly.allocRun(wSerii[p]);
+			}
+			return seria[p];
+		};
+		std::vector<HNode*> glowa(watki, (HNode*)NULL), ogon(watki, (HNode*)NULL);
+		std::vector<size_type> dodane(watki, 0);
+		auto wiaz = [&](unsigned p, size_type j){
+			size_type i = kolejnosc[j];
+			if(findInBucket(idx[i], hashe[i], first[i].first) != NULL) return;		//duplikat - zostaje pierwszy
+			HNode* tmp = new(miejsce(p)) HNode(first[i]);
+			seria[p] += wezly.blockSize();
+			--wSerii[p];
+			tmp->setHash(hashe[i]);
+			tmp->lnext = tablica[idx[i]];
+			if(tmp->lnext != NULL) tmp->lnext->lprev = tmp;
+			tablica[idx[i]] = tmp;
+			if(drzewa[idx[i]] != NULL)
+				drzewa[idx[i]]->insert(TreeEntry(_fullHash(tmp->dane.first), &tmp->dane.first, tmp));
+			else if(chainLonger(tmp, TREEIFY_THRESHOLD))
+				treeify(idx[i], false);
+			if(glowa[p] == NULL) glowa[p] = tmp;
+			else{
+				ogon[p]->pnext = tmp;
+				tmp->pprev = ogon[p];
+			}
+			ogon[p] = tmp;
+			++dodane[p];
+		};
+		//drzewa komorek sprzed wywolania biora wezly ze wspolnej puli wezlyDrzew - pary do tych
+		//komorek watki tylko odkladaja, a wiaze je jeden watek po zakonczeniu pozostalych
+		std::vector<std::vector<size_type> > odlozone(watki);
+		for(unsigned p=0; p<watki; p++)
+			pula.push_back(std::thread([&, p]{
+				for(size_type j = poczatek[p]; j < poczatek[p+1]; j++){
+					const Tree* t = drzewa[idx[kolejnosc[j]]];
+					if(t != NULL && t->get_allocator().pula != NULL) odlozone[p].push_back(j);
+					else wiaz(p, j);
+				}
+			}));
+		for(unsigned p=0; p<watki; p++) pula[p].join();
+		for(unsigned p=0; p<watki; p++)
+			for(size_type j : odlozone[p]) wiaz(p, j);
+		for(unsigned p=0; p<watki; p++)		//niewykorzystane konce serii
+			for(; wSerii[p] > 0; --wSerii[p], seria[p] += wezly.blockSize()) wezly.free(seria[p]);
+
+		//4. doklejenie kawalkow pierscienia na jego poczatek
+		size_type przed = ile;
+		for(unsigned p=watki; p-- > 0; ){
+			if(glowa[p] == NULL) continue;
+			ogon[p]->pnext = Sentinel->pnext;
+			Sentinel->pnext->pprev = ogon[p];
+			Sentinel->pnext = glowa[p];
+			glowa[p]->pprev = Sentinel;
+			ile += dodane[p];
 		}
+		if(bloom != NULL) rebuildBloom();
+		if(pojemnosc != 0) evict(pojemnosc);
+		return ile - przed;
 	}
 
 	/// Returns an iterator addressing the location of the entry in the map
 	/// that has a key equivalent to the specified one or the location succeeding the
 	/// last element in the map if there is no match for the key.
 	iterator find(const K& k){
-		size_type Index = hashFunc(k);
-		iterator it;
-		it.node = tablica[Index];
-		while(it.node != NULL){
-			if(it->first == k)
-				return it;
-			else
-				it.node = it.node->lnext;
-		}
-		return end();
+		HNode* w = findNode(k);
+		if(pojemnosc != 0) cacheLookup(w);
+		return iterator(w);
 	}
 	const_iterator find(const K& k) const{
-		size_type Index = hashFunc(k);
-		const_iterator it;
-		it.node = tablica[Index];
-		while(it.node != NULL){
-			if(it->first == k)
-				return it;
-			else
-				it.node = it.node->lnext;
-		}
-		return end();
+		return const_iterator(findNode(k));
 	}
  
+	/// Looks up n keys in groups of BATCH_GROUP. For the whole group first
+	/// the bucket slots are prefetched, then the first nodes, then the key
+	/// buffers, and only then the chains are compared, so the cache misses
+	/// of one group overlap. Sets out[i] to find(keys[i]).
+	void find_batch(const K* keys, size_type n, iterator* out){
+		if(bloom != NULL){		//filtr to jeden odczyt na klucz - grupowanie nic nie daje
+			for(size_type i=0; i<n; i++) out[i] = find(keys[i]);
+			return;
+		}
+		unsigned hashe[BATCH_GROUP];
+		size_type idx[BATCH_GROUP];
+		for(size_type b=0; b<n; b+=BATCH_GROUP){
+			size_type g = n-b < BATCH_GROUP ? n-b : static_cast<size_type>(BATCH_GROUP);
+			for(size_type j=0; j<g; j++){
+				hashe[j] = hashFunc(keys[b+j]);
+				idx[j] = Buckets::index(hashe[j]);
+				__builtin_prefetch(&tablica[idx[j]]);
+			}
+			for(size_type j=0; j<g; j++)
+				if(tablica[idx[j]] != NULL) __builtin_prefetch(tablica[idx[j]]);
+			for(size_type j=0; j<g; j++)
+				if(tablica[idx[j]] != NULL) __builtin_prefetch(_keyBuffer(tablica[idx[j]]->dane.first));
+			for(size_type j=0; j<g; j++){
+				HNode* w = findInBucket(idx[j], hashe[j], keys[b+j]);
+				out[b+j] = iterator(w != NULL ? w : Sentinel);
+			}
+		}
+	}
+
+#ifdef AISDI_COROUTINES
+	/// Looks up n keys with up to grupa lookups in flight at once (C++20).
+	/// Every lookup is a coroutine that prefetches the next thing it needs
+	/// (bucket slot, node, key buffer) and suspends; meanwhile the other
+	/// lookups of the group run. Sets out[i] to find(keys[i]).
+	void find_interleaved(const K* keys, size_type n, iterator* out, unsigned grupa = 8){
+		if(grupa > MAX_INTERLEAVE) grupa = MAX_INTERLEAVE;
+		if(grupa <= 1 || bloom != NULL){
+			for(size_type i=0; i<n; i++) out[i] = find(keys[i]);
+			return;
+		}
+		AISDILookup zadania[MAX_INTERLEAVE];
+		size_type nastepny = 0;
+		unsigned aktywne = 0;
+		for(; aktywne < grupa && nastepny < n; ++aktywne, ++nastepny)
+			zadania[aktywne] = lookupStep(keys[nastepny], out[nastepny]);
+		while(aktywne > 0)
+			for(unsigned g=0; g<aktywne; ){
+				AISDILookup& z = zadania[g];
+				if(!z.h.done()) z.h.resume();
+				if(!z.h.done()){
+					++g;
+					continue;
+				}
+				z.h.destroy();
+				if(nastepny < n){
+					z = lookupStep(keys[nastepny], out[nastepny]);
+					++nastepny;
+					++g;
+				}
+				else z = zadania[--aktywne];	//na miejsce skonczonego ostatni z grupy
+			}
+	}
+#endif
+
+	/// Incremental iteration, like SCAN in Redis: visits the elements of a
+	/// few buckets, calling f(pair&) for each, and returns the cursor for the
+	/// next call; start with 0, 0 returned means the scan is over. Stops
+	/// after the buckets holding at least count elements or after 10*count
+	/// buckets, whichever comes first. The cursor is the only state, so the
+	/// map may change between calls: an element present for the whole scan
+	/// is visited exactly once, one inserted or erased meanwhile maybe.
+	/// With a power-of-two number of buckets the cursor is incremented in
+	/// reverse bit order, as in Redis, so it would stay valid across a change
+	/// of the table size. f must not insert or erase elements.
+	template<class F>
+	unsigned long scan(unsigned long cursor, size_type count, F f){
+		if(cursor >= static_cast<unsigned long>(BUCKETS)) return 0;
+		size_type znalezione = 0;
+		unsigned long puste = 10UL*(count == 0 ? 1 : count);
+		do{
+			HNode* w = tablica[cursor];
+			if(w == NULL) --puste;
+			for(; w != NULL; w = w->lnext){
+				f(w->dane);
+				++znalezione;
+			}
+			cursor = nextCursor(cursor, std::integral_constant<bool, (BUCKETS & (BUCKETS-1)) == 0>());
+		}while(cursor != 0 && znalezione < count && puste > 0);
+		return cursor;
+	}
+
 	/// Inserts an element into a map with a specified key value
 	/// if one with such a key value does not exist.
 	/// @returns Reference to the value component of the element defined by the key.
 	V& operator[](const K& k){
-		(insert(std::make_pair(k,0)).first)->second;
-		return (insert(std::make_pair(k,0)).first)->second;
+		if(pojemnosc == 0)
+			return (insert(std::make_pair(k,V())).first)->second;
+		unsigned h = hashFunc(k);
+		HNode* w = findNode(k, h);
+		cacheLookup(w);
+		if(w == Sentinel) w = insertNew(std::make_pair(k,V()), h);
+		return w->dane.second;
 	}
 
 	/// Tests if a map is empty.
@@ -282,8 +1123,6 @@ public:
 
 	/// Returns the number of elements in the map.
 	size_type size() const{
-		size_type ile;
-		for(HNode* skoczek = Sentinel->pnext; skoczek != Sentinel; skoczek = skoczek->pnext) ile++;
 		return ile;
 	}
 
@@ -295,6 +1134,13 @@ public:
 	iterator erase(iterator i){
 		//sprawdzenie, czy nie chcemy usunac straznika
 		if(i==end()) return i;
+		size_type Index = Buckets::index(nodeHash(i.node, CacheHash()));
+		if(drzewa != NULL){
+			if(drzewa[Index] != NULL){
+				drzewa[Index]->erase(TreeEntry(_fullHash(i->first), &i->first, i.node));
+				if(drzewa[Index]->size() <= UNTREEIFY_THRESHOLD) untreeify(Index);
+			}
+		}
 		//dla elementow, ktore nie sa na koncu minilisty
 		if(i.node->lnext != NULL)
 			i.node->lnext->lprev = i.node->lprev;
@@ -302,12 +1148,15 @@ public:
 		if(i.node->lprev != NULL)
 			i.node->lprev->lnext = i.node->lnext;
 		else	//jesli pierwsze na miniliscie , to trzeba przepisac do tablicy
-			tablica[hashFunc(i->first)] = i.node->lnext;
+			tablica[Index] = i.node->lnext;
 		//dla wszystkich elementow
 		i.node->pprev->pnext = i.node->pnext;
 		i.node->pnext->pprev = i.node->pprev;
+		HNode* usuwany = i.node;
 		i.node = i.node->pnext;
-		//delete i.node;
+		freeNode(usuwany);
+		--ile;
+		++bloomStale;		//filtr Blooma nie umie usuwac - bity zostaja do najblizszej przebudowy
 		return i;
 	}
    
@@ -318,17 +1167,16 @@ public:
 	iterator erase(iterator first, iterator last){
 		if(first.node==last.node)
 			return last;
-		while(first.node != last.node){
-				first = erase(first);
+		while(first.node != last.node)
+			first = erase(first);
 		return last;
-		}
 	}
    
 	/// Removes an element from the map.
 	/// @returns The number of elements that have been removed from the map.
 	///          Since this is not a multimap itshould be 1 or 0.
 	size_type erase(const K& key){
-		iterator it = find(key);
+		iterator it(findNode(key));		//nie find() - usuniecie to nie trafienie cache
 		if(it == end())	return 0;
 		erase(it);
 		return 1;	
@@ -337,15 +1185,290 @@ public:
 	/// Erases all the elements of a map.
 	void clear( ){
 		erase(begin(),end());
+		if(bloom != NULL) rebuildBloom();
 	};
+
+	/// Returns to the system the node memory no element uses any more, the
+	/// array of per-bucket trees if no bucket has a tree, and resizes the
+	/// Bloom filter to the current number of elements. The bucket array
+	/// itself has the fixed size set by Policy.
+	void shrink_to_fit(){
+		wezly.shrink();
+		wezlyDrzew.shrink();
+		if(drzewa != NULL){
+			size_type i = 0;
+			while(i < BUCKETS && drzewa[i] == NULL) ++i;
+			if(i == BUCKETS){
+				delete[] drzewa;
+				drzewa = NULL;
+			}
+		}
+		if(bloom != NULL) rebuildBloom();
+	}
+
+	/// Bytes of node memory (elements and bucket trees) taken from the
+	/// system, whether in use or on the free lists.
+	size_t memoryUsed() const{
+		return wezly.bytesReserved() + wezlyDrzew.bytesReserved();
+	}
+
+protected:
+	enum { BUILD_MIN_PER_THREAD = 4096 };	//ponizej tylu par na watek build_from wstawia po kolei
+	enum { BUILD_RUN = 256 };				//blokow puli branych naraz przez watek build_from
+	//minilista dluzsza niz TREEIFY_THRESHOLD dostaje drzewo, a traci je, gdy skurczy sie do UNTREEIFY_THRESHOLD
+	enum { TREEIFY_THRESHOLD = 8, UNTREEIFY_THRESHOLD = 6 };
+	enum { BATCH_GROUP = 16, MAX_INTERLEAVE = 64 };
+
+	//numer watku build_from, ktory odpowiada za dana komorke tablicy
+	static inline unsigned czescDla(size_type Index, unsigned watki){
+		return static_cast<unsigned>(static_cast<unsigned long long>(Index)*watki/BUCKETS);
+	}
+
+	//wyszukanie wezla o danym kluczu. Zwraca straznika, jesli klucza nie ma w mapie
+	HNode* findNode(const K& k) const{
+		return findNode(k, hashFunc(k));
+	}
+
+	//j.w., gdy hashFunc(k) jest juz policzone
+	HNode* findNode(const K& k, unsigned h) const{
+		if(bloom != NULL){
+			++bstats.lookups;
+			if(!bloom->mayContain(_fullHash(k))){
+				++bstats.rejected;		//na pewno nie ma - nie dotykamy tablicy
+				return Sentinel;
+			}
+		}
+		HNode* wynik = findInBucket(Buckets::index(h), h, k);
+		if(wynik != NULL) return wynik;
+		if(bloom != NULL) ++bstats.falsePositives;
+		return Sentinel;
+	}
+
+	//wyszukanie klucza w komorce Index (h - jego hashFunc): w drzewie, jesli je ma, wpp. na miniliscie.
+	//NULL, jesli nie ma
+	HNode* findInBucket(size_type Index, unsigned h, const K& k) const{
+		if(drzewa != NULL && drzewa[Index] != NULL){
+			typename Tree::const_iterator it = drzewa[Index]->find(TreeEntry(_fullHash(k), &k, NULL));
+			return it != drzewa[Index]->end() ? it->node : NULL;
+		}
+		for(HNode* skoczek = tablica[Index]; skoczek != NULL; skoczek = skoczek->lnext)
+			if(!skoczek->hashDiffers(h) && skoczek->dane.first == k)
+				return skoczek;
+		return NULL;
+	}
+
+	//hashFunc klucza wezla: zapamietany w wezle albo liczony od nowa - wybor w czasie kompilacji
+	static inline unsigned nodeHash(const HNode* w, std::true_type){
+		return w->hash;
+	}
+	static inline unsigned nodeHash(const HNode* w, std::false_type){
+		return hashFunc(w->dane.first);
+	}
+
+#ifdef AISDI_COROUTINES
+	//jedno wyszukanie find_interleaved. Przed kazdym odczytem, ktory moze nie trafic
+	//w pamiec podreczna, zleca prefetch i oddaje sterowanie nastepnemu wyszukaniu
+	AISDILookup lookupStep(const K& k, iterator& wynik){
+		unsigned h = hashFunc(k);
+		size_type Index = Buckets::index(h);
+		__builtin_prefetch(&tablica[Index]);
+		co_await std::suspend_always();
+		if(drzewa != NULL && drzewa[Index] != NULL){
+			HNode* w = findInBucket(Index, h, k);
+			wynik = iterator(w != NULL ? w : Sentinel);
+			co_return;
+		}
+		for(HNode* w = tablica[Index]; w != NULL; w = w->lnext){
+			__builtin_prefetch(w);
+			co_await std::suspend_always();
+			if(w->hashDiffers(h)) continue;
+			//krotkie napisy leza w samym wezle - wtedy nie ma na co czekac
+			const char* bufor = static_cast<const char*>(_keyBuffer(w->dane.first));
+			if(bufor < reinterpret_cast<const char*>(w) || bufor >= reinterpret_cast<const char*>(w+1)){
+				__builtin_prefetch(bufor);
+				co_await std::suspend_always();
+			}
+			if(w->dane.first == k){
+				wynik = iterator(w);
+				co_return;
+			}
+		}
+		wynik = iterator(Sentinel);
+	}
+#endif
+
+	//wstawienie nowego elementu (klucza nie ma w mapie, h - jego hashFunc). W trybie cache
+	//najpierw usuwa element z konca pierscienia, jesli mapa jest pelna
+	HNode* insertNew(const std::pair<K, V>& entry, unsigned h){
+		if(pojemnosc != 0 && ile >= pojemnosc) evict(pojemnosc-1);
+		//utworzenie nowego elementu
+		HNode* tmp = newNode(entry);
+		tmp->setHash(h);
+		//wstawienie go na poczatku pierscienia
+		Sentinel->pnext->pprev = tmp;
+		tmp->pnext = Sentinel->pnext;
+		Sentinel->pnext = tmp;
+		tmp->pprev = Sentinel;
+		//wstawianie do minilisty
+		size_type Index = Buckets::index(h);			//znajduje miejsce w tablicy hashujacej
+		//nastepna wartosc na miniliscie po wstawianym elemencie to ten akurat znajdujacy sie w danym polu tablicy
+		tmp->lnext = tablica[Index];					
+		tablica[Index] = tmp;							//nowy element zostaje wpisany w pole tablicy
+		if(tmp->lnext != NULL)							//jesli w polu tablicy jakis element sie znajdowal
+			tmp->lnext->lprev = tmp;					//...to jego poprzednim elementem na miniliscie bedzie ten wstawiany
+		if(drzewa != NULL && drzewa[Index] != NULL)
+			drzewa[Index]->insert(TreeEntry(_fullHash(tmp->dane.first), &tmp->dane.first, tmp));
+		else if(chainLonger(tmp, TREEIFY_THRESHOLD)){
+			if(drzewa == NULL) allocTrees();
+			treeify(Index);
+		}
+		++ile;
+		if(bloom != NULL){
+			//filtr przepelniony (takze kluczami juz usunietymi) - budujemy go od nowa, wiekszy
+			if(ile + bloomStale > bloom->capacity()) rebuildBloom();
+			else bloom->add(_fullHash(entry.first));
+		}
+		return tmp;
+	}
+
+	//nastepny kursor scan(): odwrocone bity + 1 (tablica 2^k) albo nastepna komorka. 0 - koniec
+	static unsigned long nextCursor(unsigned long v, std::true_type){
+		v |= ~static_cast<unsigned long>(BUCKETS-1);	//bity ponad maska ustawione - przeniesienie przez nie przejdzie
+		v = reverseBits(v);
+		++v;
+		return reverseBits(v);
+	}
+	static unsigned long nextCursor(unsigned long v, std::false_type){
+		return v+1 == static_cast<unsigned long>(BUCKETS) ? 0 : v+1;
+	}
+	static unsigned long reverseBits(unsigned long v){
+		unsigned long s = 8*sizeof(v);
+		unsigned long maska = ~0UL;
+		while((s >>= 1) > 0){
+			maska ^= (maska << s);
+			v = ((v >> s) & maska) | ((v << s) & ~maska);
+		}
+		return v;
+	}
+
+	//przeniesienie wezla na poczatek pierscienia
+	void moveToFront(HNode* w){
+		w->pprev->pnext = w->pnext;
+		w->pnext->pprev = w->pprev;
+		w->pnext = Sentinel->pnext;
+		w->pprev = Sentinel;
+		Sentinel->pnext->pprev = w;
+		Sentinel->pnext = w;
+	}
+
+	//trafienie w trybie cache: LRU - wezel na poczatek pierscienia, CLOCK - tylko bit odwolania
+	void touch(HNode* w){
+		if(tryb == CLOCK) w->setUsed(true);
+		else if(Sentinel->pnext != w) moveToFront(w);
+	}
+
+	//wynik wyszukiwania w trybie cache (straznik - chybienie)
+	void cacheLookup(HNode* w){
+		if(w == Sentinel) ++cstats.misses;
+		else{
+			++cstats.hits;
+			touch(w);
+		}
+	}
+
+	//usuwa elementy z konca pierscienia, az zostanie ich najwyzej limit.
+	//W trybie CLOCK straznik jest wskazowka zegara: przeniesienie ostatniego wezla na poczatek
+	//to przesuniecie wskazowki o jeden wezel, bez zmiany cyklicznej kolejnosci
+	void evict(size_type limit){
+		while(ile > limit){
+			HNode* ofiara = Sentinel->pprev;
+			if(tryb == CLOCK)
+				while(ofiara->used()){		//druga szansa
+					ofiara->setUsed(false);
+					moveToFront(ofiara);
+					ofiara = Sentinel->pprev;
+				}
+			erase(iterator(ofiara));
+			++cstats.evictions;
+		}
+	}
+
+	HNode* newNode(const Para& d){
+		return new(wezly.alloc()) HNode(d);
+	}
+
+	void freeNode(HNode* w){
+		w->~HNode();
+		wezly.free(w);
+	}
+
+	//czy minilista od wezla w dalej ma wiecej niz n elementow (przechodzi najwyzej n+1 wezlow)
+	static bool chainLonger(const HNode* w, size_type n){
+		for(; w != NULL; w = w->lnext)
+			if(n-- == 0) return true;
+		return false;
+	}
+
+	void allocTrees(){
+		drzewa = new Tree*[BUCKETS];
+		for(size_type i=0; i<BUCKETS; i++) drzewa[i] = NULL;
+	}
+
+	//zamiana dlugiej minilisty na drzewo. Minilista zostaje - po niej usuwa sie wezly
+	//i z niej odtwarza sie komorke po untreeify. Drzewa budowane w watkach build_from
+	//(zPuli == false) biora pamiec z operator new - pula nie jest bezpieczna dla watkow
+	void treeify(size_type Index, bool zPuli = true){
+		Tree* t = new Tree(TreeOrder(), TreeAlloc(zPuli ? &wezlyDrzew : NULL));
+		for(HNode* skoczek = tablica[Index]; skoczek != NULL; skoczek = skoczek->lnext)
+			t->insert(TreeEntry(_fullHash(skoczek->dane.first), &skoczek->dane.first, skoczek));
+		drzewa[Index] = t;
+	}
+
+	//wezel kopii odpowiadajacy wezlowi w mapy a, z ktorej pula wezlow zostala skopiowana
+	HNode* rebase(const AISDIHashMap& a, const HNode* w) const{
+		return w == a.Sentinel ? Sentinel : wezly.rebase(w);
+	}
+
+	//drzewo komorki Index kopii: te same hashe, wezly kopii w tych samych miejscach puli co w a
+	void copyTree(const AISDIHashMap& a, size_type Index){
+		if(drzewa == NULL) allocTrees();
+		Tree* t = new Tree(TreeOrder(), TreeAlloc(&wezlyDrzew));
+		for(typename Tree::const_iterator it = a.drzewa[Index]->begin(); it != a.drzewa[Index]->end(); ++it){
+			HNode* w = wezly.rebase(it->node);
+			t->insert(t->end(), TreeEntry(it->hash, &w->dane.first, w));
+		}
+		drzewa[Index] = t;
+	}
+
+	void untreeify(size_type Index){
+		delete drzewa[Index];
+		drzewa[Index] = NULL;
+	}
+
+	//buduje filtr Blooma od nowa z elementow pierscienia, z zapasem na dwa razy tyle kluczy
+	void rebuildBloom(){
+		bloom->reset(2*ile + 64);
+		bloomStale = 0;
+		for(HNode* skoczek = Sentinel->pnext; skoczek != Sentinel; skoczek = skoczek->pnext)
+			bloom->add(_fullHash(skoczek->dane.first));
+	}
 };
 
 
+/// hashF before the reduction modulo MAX, for policies that pick the
+/// bucket themselves (AISDIPow2Buckets, AISDIPrimeBuckets).
 template<class K>
-inline unsigned hashF(const K& k){
+inline unsigned hashRaw(const K& k){
 	unsigned h=static_cast<unsigned int>(k.size()); 
 	for(int i=0;i<static_cast<unsigned int>(k.size());i++){
 		h=(h<<5)^(h>>27)^k[i];
 	}
-return h%MAX; 
+	return h;
+};
+
+template<class K>
+inline unsigned hashF(const K& k){
+return hashRaw(k)%MAX; 
 };
+
+#endif
@@ -0,0 +1,385 @@
+/**
+@file aisdistrhashmap.h
+
+AISDIStrHashMap - a string-keyed hash map whose nodes keep the key bytes
+inline, and the arena the nodes are allocated from.
+
+Every node is a single block: the ring links, the value, then the bucket
+list link, a length prefix and the key bytes right behind the node. There is no separate std::string buffer,
+so a lookup compares length + memcmp without leaving the node.
+
+Copying a map copies its arena chunk by chunk and then only rebases the
+pointers inside the nodes; no key is hashed or compared again.
+*******************************************************************************/
+
+#ifndef AISDI_STR_HASH_MAP_H_
+#define AISDI_STR_HASH_MAP_H_
+
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <vector>
+#include <type_traits>
+#include "aisdihashmap.h"
+
+/// A key stored inline in a node (or borrowed from a std::string).
+/// It has size() and operator[], so hashF and _fullHash work on it.
+struct AISDIKeyRef
+{
+	const char* p;
+	unsigned n;
+	AISDIKeyRef(const char* d, unsigned len):p(d),n(len){}
+	AISDIKeyRef(const std::string& s):p(s.data()),n(static_cast<unsigned>(s.size())){}
+	inline unsigned size() const { return n; }
+	inline char operator[](unsigned i) const { return p[i]; }
+	inline bool operator==(const AISDIKeyRef& a) const{
+		return n == a.n && memcmp(p, a.p, n) == 0;
+	}
+	std::string str() const { return std::string(p, n); }
+};
+
+
+/// Bump allocator for map nodes. Memory is taken from the system in big
+/// chunks and given back only all at once, by release().
+/// Chunks are aligned to CHUNK and numbered, so after copyFrom() an address
+/// from the source arena is translated by rebase() in O(1).
+class AISDIArena
+{
+public:
+	enum { CHUNK = 64*1024, ALIGN = 16 };
+
+	AISDIArena():cur(NULL),last(NULL),used(0){}
+	~AISDIArena(){ release(); }
+
+	/// Returns n bytes aligned to align (a power of two, at least ALIGN).
+	void* alloc(size_t n, size_t align = ALIGN){
+		n = (n + ALIGN-1) & ~static_cast<size_t>(ALIGN-1);
+		size_t pad = cur == NULL ? 0 : (align - reinterpret_cast<uintptr_t>(cur)) & (align-1);
+		if(cur == NULL || static_cast<size_t>(last-cur) < pad + n){
+			grow(n + align - ALIGN);
+			pad = (align - reinterpret_cast<uintptr_t>(cur)) & (align-1);
+		}
+		void* wyn = cur + pad;
+		cur += pad + n;
+		used += pad + n;
+		return wyn;
+	}
+
+	/// Frees all chunks at once.
+	void release(){
+		for(size_t i=0; i<chunks.size(); i++)
+			::operator delete(chunks[i], std::align_val_t(CHUNK));
+		chunks.clear();
+		cur = last = NULL;
+		used = 0;
+	}
+
+	/// Bytes handed out since the last release().
+	size_t bytesUsed() const{
+		return used;
+	}
+
+	/// Makes this arena a byte-for-byte copy of a: same chunks, same offsets.
+	/// Pointers stored in the copied memory still point into a - see rebase().
+	void copyFrom(const AISDIArena& a){
+		release();
+		chunks.reserve(a.chunks.size());
+		for(size_t i=0; i<a.chunks.size(); i++){
+			const Chunk* z = a.chunks[i];
+			Chunk* c = static_cast<Chunk*>(::operator new(z->size, std::align_val_t(CHUNK)));
+			c->size = z->size;
+			//zrodlo tylko czytamy - koniec jego biezacego bloku wyznacza a.cur
+			c->end = i+1 == a.chunks.size() ? static_cast<size_t>(a.cur - reinterpret_cast<const char*>(z)) : z->end;
+			c->nr = i;
+			memcpy(reinterpret_cast<char*>(c) + head(), reinterpret_cast<const char*>(z) + head(), c->end - head());
+			chunks.push_back(c);
+		}
+		if(a.cur != NULL){
+			cur = reinterpret_cast<char*>(chunks.back()) + (a.cur - reinterpret_cast<char*>(a.chunks.back()));
+			last = reinterpret_cast<char*>(chunks.back()) + chunks.back()->size;
+		}
+		used = a.used;
+	}
+
+	/// Translates an address inside the arena this one was copied from
+	/// into the same place in this arena. NULL stays NULL.
+	template<class T>
+	T* rebase(T* p) const{
+		if(p == NULL) return NULL;
+		//wezel zaczyna sie w pierwszych CHUNK bajtach swojego bloku, wiec naglowek
+		//bloku zrodlowego jest pod adresem wyrownanym w dol do CHUNK
+		uintptr_t a = reinterpret_cast<uintptr_t>(p);
+		const Chunk* z = reinterpret_cast<const Chunk*>(a & ~static_cast<uintptr_t>(CHUNK-1));
+		return reinterpret_cast<T*>(reinterpret_cast<char*>(chunks[z->nr]) + (a - reinterpret_cast<uintptr_t>(z)));
+	}
+
+private:
+	struct Chunk{
+		size_t size;
+		size_t end;		//koniec zajetej czesci (dla biezacego bloku - cur)
+		size_t nr;		//numer bloku w chunks
+	};
+	std::vector<Chunk*> chunks;		//pobrane bloki pamieci, w kolejnosci pobrania
+	char* cur;			//pierwszy wolny bajt w biezacym bloku
+	char* last;			//koniec biezacego bloku
+	size_t used;
+
+	static size_t head(){
+		return (sizeof(Chunk) + ALIGN-1) & ~static_cast<size_t>(ALIGN-1);
+	}
+
+	void grow(size_t n){
+		if(cur != NULL) chunks.back()->end = static_cast<size_t>(cur - reinterpret_cast<char*>(chunks.back()));
+		size_t size = n + head() > CHUNK ? n + head() : CHUNK;
+		Chunk* c = static_cast<Chunk*>(::operator new(size, std::align_val_t(CHUNK)));
+		c->size = size;
+		c->end = head();
+		c->nr = chunks.size();
+		chunks.push_back(c);
+		cur = reinterpret_cast<char*>(c) + head();
+		last = reinterpret_cast<char*>(c) + size;
+	}
+
+	AISDIArena(const AISDIArena&);
+	AISDIArena& operator=(const AISDIArena&);
+};
+
+
+/// A std::string -> V hash map with the same interface as AISDIHashMap,
+/// except that iterators expose key() and value() instead of a std::pair.
+template<class V, unsigned hashFunc(const AISDIKeyRef&) = &hashF<AISDIKeyRef> >
+class AISDIStrHashMap
+{
+public:
+	typedef std::string key_type;
+	typedef V value_type;
+	typedef unsigned size_type;
+
+	//wezel trzymany w jednym kawalku pamieci z areny. Pola uzywane przy wyszukiwaniu
+	//(lnext, len) sa na koncu, a klucz (len bajtow, bez zera na koncu) lezy zaraz
+	//za wezlem - przy wyrownaniu V do 8 bajtow bez przerwy po len
+	struct SNode{
+		SNode* pnext;		//nastepny w pierscieniu
+		SNode* pprev;		//poprzedni w pierscieniu
+		V value;
+		SNode* lnext;		//nastepny na miniliscie
+		size_type idx;		//numer komorki tablicy - erase nie musi liczyc hasha
+		size_type len;		//dlugosc klucza
+
+		inline char* key() { return reinterpret_cast<char*>(this + 1); }
+		inline const char* key() const { return reinterpret_cast<const char*>(this + 1); }
+		inline AISDIKeyRef keyRef() const { return AISDIKeyRef(key(), len); }
+	};
+
+protected:
+	SNode* tablica[MAX];	//tablica wskaznikow na poczatki minilist
+	SNode* Sentinel;		//straznik pierscienia (bez klucza)
+	size_type ile;
+	AISDIArena arena;
+
+	SNode* newNode(const AISDIKeyRef& k, const V& v){
+		SNode* tmp = static_cast<SNode*>(arena.alloc(sizeof(SNode) + k.n, alignof(SNode) > AISDIArena::ALIGN ? alignof(SNode) : AISDIArena::ALIGN));
+		new(&tmp->value) V(v);
+		tmp->len = k.n;
+		if(k.n) memcpy(tmp->key(), k.p, k.n);
+		tmp->lnext = NULL;
+		return tmp;
+	}
+
+	SNode* findNode(const AISDIKeyRef& k) const{
+		for(SNode* skoczek = tablica[hashFunc(k)]; skoczek != NULL; skoczek = skoczek->lnext)
+			if(skoczek->len == k.n && memcmp(skoczek->key(), k.p, k.n) == 0)
+				return skoczek;
+		return Sentinel;
+	}
+
+public:
+	AISDIStrHashMap():ile(0){
+		Sentinel = newNode(AISDIKeyRef(NULL, 0), V());
+		Sentinel->pnext = Sentinel;
+		Sentinel->pprev = Sentinel;
+		for(size_type i=0; i<MAX; i++) tablica[i] = NULL;
+	}
+
+	/// Copies the map by copying its whole arena at once. Only the links
+	/// are rewritten (and, unless V is trivially copyable, the values
+	/// copy-constructed); the keys and bucket numbers are taken as they are.
+	AISDIStrHashMap(const AISDIStrHashMap& a):ile(a.ile){
+		arena.copyFrom(a.arena);
+		Sentinel = arena.rebase(a.Sentinel);
+		memcpy(tablica, a.tablica, sizeof(tablica));
+		for(size_type i=0; i<MAX; i++)
+			if(tablica[i] != NULL) tablica[i] = arena.rebase(tablica[i]);
+		//usuniete wezly tez zostaly skopiowane, ale nic na nie nie wskazuje
+		SNode* z = a.Sentinel;
+		do{
+			SNode* w = arena.rebase(z);
+			w->lnext = arena.rebase(z->lnext);
+			w->pnext = arena.rebase(z->pnext);
+			w->pprev = arena.rebase(z->pprev);
+			if(!std::is_trivially_copyable<V>::value) new(&w->value) V(z->value);
+			z = z->pnext;
+		}while(z != a.Sentinel);
+	}
+
+	~AISDIStrHashMap(){
+		destroyValues();
+		Sentinel->value.~V();
+	}
+
+	/// const_iterator.
+	class const_iterator
+	{
+		friend class AISDIStrHashMap;
+	protected:
+		SNode* node;
+	public:
+		const_iterator():node(NULL){}
+		const_iterator(SNode* x):node(x){}
+
+		inline std::string key() const { return node->keyRef().str(); }
+		inline AISDIKeyRef keyRef() const { return node->keyRef(); }
+		inline const V& value() const { return node->value; }
+
+		inline bool operator==(const const_iterator& a) const{
+			return node == a.node;
+		}
+		inline bool operator!=(const const_iterator& a) const{
+			return node != a.node;
+		}
+		const_iterator& operator++(){
+			node = node->pnext;
+			return *this;
+		}
+		const_iterator operator++(int){
+			SNode* tmp = node;
+			node = node->pnext;
+			return tmp;
+		}
+		const_iterator& operator--(){
+			node = node->pprev;
+			return *this;
+		}
+		const_iterator operator--(int){
+			SNode* tmp = node;
+			node = node->pprev;
+			return tmp;
+		}
+	};
+
+	/// iterator.
+	class iterator : public const_iterator
+	{
+		friend class AISDIStrHashMap;
+	public:
+		using const_iterator::node;
+		iterator(){}
+		iterator(SNode* x):const_iterator(x){}
+
+		inline V& value() const { return node->value; }
+
+		iterator& operator++(){
+			node = node->pnext;
+			return *this;
+		}
+		iterator operator++(int){
+			SNode* tmp = node;
+			node = node->pnext;
+			return tmp;
+		}
+	};
+
+	inline iterator begin() { return iterator(Sentinel->pnext); }
+	inline const_iterator begin() const { return const_iterator(Sentinel->pnext); }
+	inline iterator end() { return iterator(Sentinel); }
+	inline const_iterator end() const { return const_iterator(Sentinel); }
+
+	/// Inserts an element into the map.
+	/// @returns A pair whose bool component is true if an insertion was made.
+	std::pair<iterator, bool> insert(const std::pair<std::string, V>& entry){
+		return insert(AISDIKeyRef(entry.first), entry.second);
+	}
+
+	std::pair<iterator, bool> insert(const AISDIKeyRef& k, const V& v){
+		size_type Index = hashFunc(k);
+		for(SNode* skoczek = tablica[Index]; skoczek != NULL; skoczek = skoczek->lnext)
+			if(skoczek->len == k.n && memcmp(skoczek->key(), k.p, k.n) == 0)
+				return std::make_pair(iterator(skoczek), false);
+		SNode* tmp = newNode(k, v);
+		tmp->idx = Index;
+		tmp->lnext = tablica[Index];
+		tablica[Index] = tmp;
+		//wstawienie na poczatku pierscienia
+		tmp->pnext = Sentinel->pnext;
+		tmp->pprev = Sentinel;
+		Sentinel->pnext->pprev = tmp;
+		Sentinel->pnext = tmp;
+		++ile;
+		return std::make_pair(iterator(tmp), true);
+	}
+
+	iterator find(const std::string& k) { return iterator(findNode(AISDIKeyRef(k))); }
+	const_iterator find(const std::string& k) const { return const_iterator(findNode(AISDIKeyRef(k))); }
+	iterator find(const AISDIKeyRef& k) { return iterator(findNode(k)); }
+
+	/// Inserts a default value if the key is absent.
+	/// @returns Reference to the value component of the element defined by the key.
+	V& operator[](const std::string& k){
+		return insert(AISDIKeyRef(k), V()).first.value();
+	}
+
+	bool empty() const { return ile == 0; }
+	size_type size() const { return ile; }
+
+	/// Bytes of node memory taken from the arena.
+	size_t memoryUsed() const { return arena.bytesUsed(); }
+
+	/// Removes an element from the map. The node's memory goes back to the
+	/// system only on clear() or destruction of the map.
+	/// @returns The iterator that designates the first element remaining beyond the removed one.
+	iterator erase(iterator i){
+		if(i.node == Sentinel) return i;
+		SNode** skoczek = &tablica[i.node->idx];
+		while(*skoczek != i.node) skoczek = &(*skoczek)->lnext;
+		*skoczek = i.node->lnext;
+		i.node->pprev->pnext = i.node->pnext;
+		i.node->pnext->pprev = i.node->pprev;
+		SNode* nast = i.node->pnext;
+		i.node->value.~V();
+		--ile;
+		return iterator(nast);
+	}
+
+	size_type erase(const std::string& k){
+		iterator it = find(k);
+		if(it == end()) return 0;
+		erase(it);
+		return 1;
+	}
+
+	/// Erases all the elements of a map and returns the node memory.
+	void clear(){
+		destroyValues();
+		for(size_type i=0; i<MAX; i++) tablica[i] = NULL;
+		//straznik tez lezy w arenie - przenosimy jego wartosc do nowej areny
+		V v = Sentinel->value;
+		Sentinel->value.~V();
+		arena.release();
+		Sentinel = newNode(AISDIKeyRef(NULL, 0), v);
+		Sentinel->pnext = Sentinel;
+		Sentinel->pprev = Sentinel;
+		ile = 0;
+	}
+
+private:
+	void destroyValues(){
+		if(std::is_trivially_destructible<V>::value) return;
+		for(SNode* skoczek = Sentinel->pnext; skoczek != Sentinel; skoczek = skoczek->pnext)
+			skoczek->value.~V();
+	}
+
+	AISDIStrHashMap& operator=(const AISDIStrHashMap&);
+};
+
+#endif
@@ -4,12 +4,548 @@
 // Plik asd.cc przeznaczony jest tylko do wpisania wlasnych testow.
 // Cala implementacja powinna znajdowac sie w pliku aisdihashmap.h
 
+#include<cstdlib>
 #include<iostream>
+#include<map>
+#include<sstream>
 #include<string>
+#include<vector>
 #include "aisdihashmap.h"
+#include "aisdistrhashmap.h"
+#include "aisdicompactmap.h"
+#include "tracefile.h"
 
 using namespace std;
 
+// klucze zaczynajace sie od 'k' trafiaja do czterech komorek rozlozonych po calej tablicy,
+// wiec build_from z czterema watkami dostaje po jednej do kazdego
+unsigned hashKolizje(const string& k)
+{
+   return k[0] == 'k' ? atoi(k.c_str()+1) % 4 * (MAX/4) : hashF(k);
+}
+
+string klucz(char c, int i)
+{
+   ostringstream s;
+   s << c << i;
+   return s.str();
+}
+
+// build_from na mapie, ktora juz ma komorke z drzewem
+bool testBuildFrom()
+{
+   typedef AISDIHashMap<string, int, hashKolizje> KolizyjnaMapa;
+   KolizyjnaMapa m;
+   for(int i=0; i<80; i++) m.insert(make_pair(klucz('k', i), -1));
+   vector<pair<string, int> > pary;
+   for(int i=0; i<20000; i++) pary.push_back(make_pair(klucz('x', i), i));
+   for(int i=0; i<2000; i++) pary.push_back(make_pair(klucz('k', i), i));
+   for(int i=0; i<6000; i++) pary.push_back(make_pair(klucz('x', i), -2));   // duplikaty w ostatnim kawalku wejscia
+   if(m.build_from(pary.begin(), pary.end(), 4) != 20000 + 2000 - 80) return false;
+   if(m.size() != 20000 + 2000) return false;
+   for(int i=0; i<80; i++)
+      if(m.find(klucz('k', i))->second != -1) return false;   // pierwsza para wygrywa
+   for(int i=0; i<6000; i++)
+      if(m.find(klucz('x', i))->second != i) return false;
+   for(size_t j=0; j<pary.size(); j++)
+      if(m.find(pary[j].first) == m.end()) return false;
+   size_t n = 0;
+   for(KolizyjnaMapa::iterator it = m.begin(); it != m.end(); ++it) ++n;
+   return n == m.size();
+}
+
+// mapa z dostepem do drzew komorek
+class MapaZDrzewami : public AISDIHashMap<string, int, hashF>
+{
+public:
+   enum { PROG = TREEIFY_THRESHOLD, PROG_POWROTU = UNTREEIFY_THRESHOLD };
+
+   MapaZDrzewami() {}
+   MapaZDrzewami(const MapaZDrzewami& a):AISDIHashMap<string, int, hashF>(a) {}
+
+   // rozmiar drzewa komorki z kluczem k (0 - komorka nie ma drzewa)
+   size_t drzewo(const string& k) const
+   {
+      if(drzewa == NULL) return 0;
+      size_t n = 0;
+      for(unsigned i=0; i<MAX; i++)
+         if(drzewa[i] != NULL)
+            for(Tree::const_iterator it = drzewa[i]->begin(); it != drzewa[i]->end(); ++it)
+               if(*it->klucz == k) n = drzewa[i]->size();
+      return n;
+   }
+};
+
+// klucz postaci XX, |X| = 32: rotacja o 5*32 bitow w hashF jest identycznoscia, wiec
+// polowki sie znosza i wszystkie takie klucze trafiaja do jednej komorki (jak w workgen)
+string kolidujacy(int i)
+{
+   ostringstream s;
+   s.fill('0');
+   s.width(32);
+   s << i;
+   return s.str() + s.str();
+}
+
+// find, iteracja i kopia mapy z n kolidujacymi kluczami (0..n-1), z drzewem komorki
+// dokladnie wtedy, gdy maDrzewo
+bool sprawdzKolizje(const MapaZDrzewami& m, int n, bool maDrzewo)
+{
+   const int INNE = 50;
+   MapaZDrzewami kopia(m);
+   const MapaZDrzewami* mapy[2] = { &m, &kopia };
+   for(int j=0; j<2; j++){
+      const MapaZDrzewami& x = *mapy[j];
+      if(x.size() != static_cast<size_t>(n + INNE)) return false;
+      if(x.drzewo(kolidujacy(0)) != (maDrzewo ? static_cast<size_t>(n) : 0)) return false;
+      for(int i=0; i<n+3; i++){
+         MapaZDrzewami::const_iterator it = x.find(kolidujacy(i));
+         if((it != x.end()) != (i < n)) return false;
+         if(i < n && it->second != i) return false;
+      }
+      vector<bool> widziane(n, false);
+      size_t ile = 0;
+      for(MapaZDrzewami::const_iterator it = x.begin(); it != x.end(); ++it, ++ile)
+         if(it->first.size() == 64){
+            int i = atoi(it->first.c_str() + 32);
+            if(i >= n || widziane[i]) return false;
+            widziane[i] = true;
+         }
+      if(ile != x.size()) return false;
+      for(int i=0; i<n; i++)
+         if(!widziane[i]) return false;
+   }
+   return true;
+}
+
+// komorka z kolidujacymi kluczami przechodzi przez PROG w gore (treeify) i przez
+// PROG_POWROTU w dol (untreeify); po kazdym kroku find, erase, iteracja i kopia
+bool testDrzewoKomorki()
+{
+   MapaZDrzewami m;
+   unsigned h = hashF(kolidujacy(0));
+   for(int i=0; i<MapaZDrzewami::PROG+4; i++)
+      if(hashF(kolidujacy(i)) != h) return false;
+   for(int i=0, j=0; j<50; i++)   // klucze w innych komorkach
+      if(hashF(klucz('x', i)) != h){
+         m.insert(make_pair(klucz('x', i), -1));
+         ++j;
+      }
+   int n = 0;
+   for(; n<MapaZDrzewami::PROG+4; ){
+      m.insert(make_pair(kolidujacy(n), n));
+      ++n;
+      if(!sprawdzKolizje(m, n, n > MapaZDrzewami::PROG)) return false;
+   }
+   // erase co drugi raz przez iterator, z kopii tez, zeby drzewo kopii tez sie zmienialo
+   while(n > 0){
+      --n;
+      if(n % 2){
+         MapaZDrzewami::iterator it = m.find(kolidujacy(n));
+         if(it == m.end()) return false;
+         m.erase(it);
+      }
+      else if(m.erase(kolidujacy(n)) != 1) return false;
+      if(m.erase(kolidujacy(n)) != 0) return false;
+      if(!sprawdzKolizje(m, n, n > MapaZDrzewami::PROG_POWROTU)) return false;
+      MapaZDrzewami kopia(m);
+      if(n > 0 && kopia.erase(kolidujacy(0)) != 1) return false;
+      if(kopia.find(kolidujacy(0)) != kopia.end() || (n > 1 && kopia.find(kolidujacy(1)) == kopia.end())) return false;
+   }
+   return true;
+}
+
+// klucze 'x' od 0 do n-1 sa w mapie dokladnie wtedy, gdy obecny(i); klucze 'q' nie ma nigdy,
+// a filtr odrzuca wiekszosc z nich sam (find daje wtedy end())
+bool sprawdzBloom(AISDIHashMap<string, int, hashF>& m, int n, bool obecny(int))
+{
+   typedef AISDIHashMap<string, int, hashF> Mapa;
+   for(int i=0; i<n; i++){
+      Mapa::iterator it = m.find(klucz('x', i));
+      if((it != m.end()) != obecny(i) || (it != m.end() && it->second != i)) return false;
+   }
+   Mapa::BloomStats przed = m.bloomStats();
+   for(int i=0; i<n; i++)
+      if(m.find(klucz('q', i)) != m.end()) return false;
+   const Mapa::BloomStats& po = m.bloomStats();
+   if(po.lookups - przed.lookups != static_cast<unsigned long>(n)) return false;
+   if(po.rejected - przed.rejected + po.falsePositives - przed.falsePositives != static_cast<unsigned long>(n)) return false;
+   return po.rejected - przed.rejected > static_cast<unsigned long>(n/2);
+}
+
+bool wszystkie(int) { return true; }
+bool parzyste(int i) { return i % 2 == 0; }
+bool nieparzyste(int i) { return i % 2 == 1; }
+bool zadne(int) { return false; }
+
+// filtr Blooma: trafienia zawsze przechodza, pewne chybienia daja end(); tak samo
+// po erase (bity zostaja), po przebudowie przy wstawianiu, po clear i w kopii
+bool testBloom()
+{
+   typedef AISDIHashMap<string, int, hashF> Mapa;
+   const int N = 3000;
+   Mapa m;
+   for(int i=0; i<N/2; i++) m.insert(make_pair(klucz('x', i), i));
+   m.enableBloom();   // z istniejacych elementow
+   if(!sprawdzBloom(m, N/2, wszystkie)) return false;
+   for(int i=N/2; i<N; i++) m.insert(make_pair(klucz('x', i), i));   // z przebudowami
+   if(!sprawdzBloom(m, N, wszystkie)) return false;
+   for(int i=0; i<N; i+=2) m.erase(klucz('x', i));
+   if(!sprawdzBloom(m, N, nieparzyste)) return false;
+   Mapa kopia(m);
+   if(!sprawdzBloom(kopia, N, nieparzyste)) return false;
+   kopia.insert(make_pair(klucz('x', 0), 0));
+   if(kopia.find(klucz('x', 0)) == kopia.end() || m.find(klucz('x', 0)) != m.end()) return false;
+   m.clear();
+   if(!sprawdzBloom(m, N, zadne)) return false;
+   for(int i=0; i<N; i+=2) m[klucz('x', i)] = i;
+   if(!sprawdzBloom(m, N, parzyste)) return false;
+   m.shrink_to_fit();
+   return sprawdzBloom(m, N, parzyste) && sprawdzBloom(kopia, 1, wszystkie);
+}
+
+// licznik odwiedzin kluczy przez scan
+struct Odwiedziny
+{
+   map<string, int>* ile;
+   template<class P>
+   void operator()(P& p) const { ++(*ile)[p.first]; }
+};
+
+// scan w wielu krokach, miedzy ktorymi mapa sie zmienia: klucze 'x' podzielne przez 3 sa
+// w mapie przez caly czas i musza byc odwiedzone dokladnie raz, reszta kluczy 'x' jest
+// usuwana, a klucze 'n' dochodza - takie moga byc odwiedzone najwyzej raz
+template<class Mapa>
+bool testScan()
+{
+   const int N = 6000;
+   Mapa m;
+   for(int i=0; i<N; i++) m.insert(make_pair(klucz('x', i), i));
+   map<string, int> ile;
+   Odwiedziny f = { &ile };
+   unsigned long kursor = 0;
+   int krok = 0;
+   do{
+      kursor = m.scan(kursor, 5, f);
+      for(int j=0; j<3; j++, krok++){
+         if(krok < N && krok % 3 != 0) m.erase(klucz('x', krok));
+         m.insert(make_pair(klucz('n', krok), krok));
+      }
+   }while(kursor != 0);
+   if(krok < 100) return false;   // scan w jednym kroku nic by nie sprawdzil
+   for(int i=0; i<N; i+=3)
+      if(ile[klucz('x', i)] != 1) return false;
+   for(map<string, int>::iterator it = ile.begin(); it != ile.end(); ++it)
+      if(it->second != 1) return false;
+   // scan bez zmian odwiedza wszystko
+   ile.clear();
+   do kursor = m.scan(kursor, 100, f); while(kursor != 0);
+   if(ile.size() != m.size()) return false;
+   for(typename Mapa::iterator it = m.begin(); it != m.end(); ++it)
+      if(ile[it->first] != 1) return false;
+   return true;
+}
+
+// slaby hash: tylko 7 wartosci, wiec dlugie ciagi prob przechodza przez nagrobki
+unsigned long long hashSiedem(const string& k)
+{
+   return _fullHash(k) % 7;
+}
+
+// mapa zwarta z dostepem do tablicy wpisow i indeksow
+template<unsigned long long hashFunc(const string&)>
+class TestCompactMap : public AISDICompactHashMap<string, int, hashFunc>
+{
+public:
+   using AISDICompactHashMap<string, int, hashFunc>::wpisy;
+   using AISDICompactHashMap<string, int, hashFunc>::indeksy;
+
+   // wpisy i indeksy zgodne z liczba zywych elementow, tablica zapelniona najwyzej w 2/3
+   bool sprawdz() const
+   {
+      size_t zywe = 0, numery = 0;
+      for(size_t i=0; i<wpisy.size(); i++) zywe += wpisy[i].zywy;
+      for(size_t i=0; i<indeksy.size(); i++)
+         if(indeksy[i] >= 0){
+            if(!wpisy[indeksy[i]].zywy) return false;
+            ++numery;
+         }
+      return zywe == this->size() && numery == zywe && wpisy.size()*3 <= indeksy.size()*2
+         && (indeksy.size() & (indeksy.size()-1)) == 0;
+   }
+};
+
+// losowe insert/erase na mapie zwartej porownane z std::map: zawartosc, kolejnosc wstawiania
+// przy iteracji w obie strony, zajmowanie nagrobkow i scalanie dziur przy kolejnych przebudowach
+template<unsigned long long hashFunc(const string&)>
+bool testCompactMap()
+{
+   typedef TestCompactMap<hashFunc> Mapa;
+   Mapa m;
+   map<string, int> wzor;
+   map<string, int> kolejnosc;   // numer wstawienia klucza, ktory jest w mapie
+   srand(17);
+   int przebudowy = 0, scalone = 0;
+   for(int i=0; i<40000; i++){
+      string k = klucz('c', rand() % 3000);
+      size_t tablica = m.indeksy.size(), dziury = m.wpisy.size() - m.size();
+      if(rand() % 5 < 2){
+         if(m.erase(k) != wzor.erase(k)) return false;
+         kolejnosc.erase(k);
+      }
+      else{
+         bool nowy = m.insert(make_pair(k, i)).second;
+         if(nowy != wzor.insert(make_pair(k, i)).second) return false;
+         if(nowy) kolejnosc[k] = i;
+      }
+      if(m.indeksy.size() != tablica || m.wpisy.size() - m.size() < dziury){
+         ++przebudowy;
+         if(dziury > 0 && m.wpisy.size() == m.size()) ++scalone;
+      }
+      if(m.size() != wzor.size()) return false;
+      if(i % 1000 != 0 && i != 39999) continue;
+      if(!m.sprawdz()) return false;
+      for(map<string, int>::iterator it = wzor.begin(); it != wzor.end(); ++it){
+         typename Mapa::iterator f = m.find(it->first);
+         if(f == m.end() || f->second != it->second) return false;
+      }
+      // do przodu: rosnace numery wstawienia; do tylu: to samo od konca
+      vector<int> numery;
+      for(typename Mapa::const_iterator it = m.begin(); it != m.end(); ++it)
+         numery.push_back(kolejnosc[it->first]);
+      if(numery.size() != wzor.size()) return false;
+      for(size_t j=1; j<numery.size(); j++)
+         if(numery[j-1] >= numery[j]) return false;
+      typename Mapa::iterator it = m.end();
+      for(size_t j=numery.size(); j>0; j--)
+         if(kolejnosc[(--it)->first] != numery[j-1]) return false;
+      if(it != m.begin() || --it != m.end()) return false;   // przed pierwszym nie ma nic
+   }
+   if(przebudowy < 5 || scalone < 3) return false;
+   // pierwsze elementy usuniete: dziury na poczatku tablicy wpisow
+   for(int i=0; i<3000; i++)
+      if(m.erase(klucz('c', i)) == 1 && m.size() == 2) break;
+   typename Mapa::iterator pierwszy = m.begin(), drugi = pierwszy;
+   ++drugi;
+   if(m.size() != 2 || m.wpisy[0].zywy || --drugi != pierwszy || --pierwszy != m.end()) return false;
+   m.clear();
+   return m.empty() && m.begin() == m.end() && m.sprawdz();
+}
+
+// slad z ile bajtami od pozycji poz podmienionymi na zmiana
+string zmien(string s, long poz, const void* zmiana, size_t ile)
+{
+   return s.replace(poz, ile, static_cast<const char*>(zmiana), ile);
+}
+
+// zapisuje slad do pliku i probuje go otworzyc i odtworzyc
+bool otworz(const string& s)
+{
+   const char* plik = "asd_test_slad.bin";
+   FILE* f = fopen(plik, "wb");
+   if(f == NULL) return true;   // nie da sie sprawdzic - traktujemy jak blad testu
+   fwrite(s.data(), 1, s.size(), f);
+   fclose(f);
+   TraceFile t;
+   bool ok = t.open(plik);
+   if(ok){
+      AISDIHashMap<string, int, hashF> m;
+      t.replay(m);
+   }
+   t.close();
+   remove(plik);
+   return ok;
+}
+
+// TraceFile::open przyjmuje poprawny slad, a odrzuca obciety i taki, w ktorym naglowek,
+// przesuniecia kluczy albo numery kluczy w operacjach wychodza poza plik
+bool testPlikSladu()
+{
+   TraceBuilder b;
+   for(int i=0; i<100; i++) b.add(i % OP_COUNT, klucz('t', i % 17), i);
+   const char* plik = "asd_test_slad.bin";
+   if(!b.write(plik)) return false;
+   string slad;
+   FILE* f = fopen(plik, "rb");
+   if(f == NULL) return false;
+   char buf[4096];
+   size_t n;
+   while((n = fread(buf, 1, sizeof(buf), f)) > 0) slad.append(buf, n);
+   fclose(f);
+   remove(plik);
+
+   const long NOPS = offsetof(TraceHeader, nops), NKEYS = offsetof(TraceHeader, nkeys), BLOB = offsetof(TraceHeader, blobSize);
+   const long OPS = sizeof(TraceHeader), OFFS = OPS + 100*sizeof(TraceOp);
+   const long LAST = OFFS + 17*sizeof(uint32_t);   // przesuniecie konca bloba (17 kluczy)
+   uint64_t duzo = (~0ULL)/sizeof(TraceOp) + 2;   // nops*sizeof(TraceOp) przekreca sie na mala liczbe
+   uint32_t kluczy = 1u << 28, przesuniecie = 100000, malejace = 0;
+   uint32_t zlyKod = (3u << TRACE_OP_BITS) | 7, zlyKlucz = (17u << TRACE_OP_BITS) | OP_FIND;
+   uint64_t blob = 100000;
+   if(!otworz(slad)) return false;
+   return !otworz(slad.substr(0, slad.size()-1))
+      && !otworz(slad.substr(0, sizeof(TraceHeader)-1))
+      && !otworz(zmien(slad, 0, "AISDTRC2", 8))
+      && !otworz(zmien(slad, NOPS, &duzo, sizeof(duzo)))
+      && !otworz(zmien(slad, NKEYS, &kluczy, sizeof(kluczy)))
+      && !otworz(zmien(zmien(slad, BLOB, &blob, sizeof(blob)), LAST, &przesuniecie, sizeof(uint32_t)))
+      && !otworz(zmien(slad, LAST, &przesuniecie, sizeof(uint32_t)))
+      && !otworz(zmien(slad, OFFS + 5*sizeof(uint32_t), &malejace, sizeof(uint32_t)))
+      && !otworz(zmien(slad, OPS + 40*sizeof(TraceOp), &zlyKod, sizeof(uint32_t)))
+      && !otworz(zmien(slad, OPS + 99*sizeof(TraceOp), &zlyKlucz, sizeof(uint32_t)));
+}
+
+// kopia ma te same pary w tej samej kolejnosci i jest niezalezna od oryginalu
+bool testKopia()
+{
+   typedef AISDIHashMap<string, int, hashKolizje> KolizyjnaMapa;
+   KolizyjnaMapa m;
+   for(int i=0; i<3000; i++) m.insert(make_pair(klucz(i % 3 ? 'x' : 'k', i), i));
+   for(int i=0; i<3000; i+=7) m.erase(klucz(i % 3 ? 'x' : 'k', i));   // wolne bloki w puli
+   KolizyjnaMapa kopia(m);
+   if(kopia.size() != m.size()) return false;
+   KolizyjnaMapa::iterator j = kopia.begin();
+   for(KolizyjnaMapa::iterator i = m.begin(); i != m.end(); ++i, ++j)
+      if(j == kopia.end() || i->first != j->first || i->second != j->second) return false;
+   if(j != kopia.end()) return false;
+   for(int i=0; i<3000; i++){
+      string k = klucz(i % 3 ? 'x' : 'k', i);
+      if((kopia.find(k) == kopia.end()) != (i % 7 == 0)) return false;
+   }
+   size_t zostaje = 0;
+   for(int i=0; i<3000; i++){
+      if(i % 2 == 0) m.erase(klucz(i % 3 ? 'x' : 'k', i));
+      else if(i % 7 != 0) ++zostaje;
+   }
+   kopia.clear();
+   return m.size() == zostaje && kopia.empty();
+}
+
+// mapa z bitem odwolania CLOCK w wezlach
+typedef AISDIHashMap<string, int, hashF, _compFunc, AISDIHashPolicy<AISDIFixedBuckets<MAX>, false, false, true> > MapaCache;
+
+// kopia cache usuwa te same klucze co oryginal
+bool testKopiaCache(MapaCache::CacheMode tryb)
+{
+   typedef MapaCache Cache;
+   Cache m;
+   m.setCapacity(100, tryb);
+   for(int i=0; i<150; i++){
+      m.insert(make_pair(klucz('x', i), i));
+      if(i % 3 == 0) m.find(klucz('x', i/2));
+   }
+   for(int i=50; i<150; i+=4) m.find(klucz('x', i));   // trafienia zmieniaja kolejnosc i bity CLOCK
+   Cache kopia(m);
+   m.resetCacheStats();
+   for(int i=150; i<250; i++){
+      m.insert(make_pair(klucz('x', i), i));
+      kopia.insert(make_pair(klucz('x', i), i));
+      if(i % 5 == 0){
+         m.find(klucz('x', i-40));
+         kopia.find(klucz('x', i-40));
+      }
+   }
+   if(m.cacheStats().evictions != kopia.cacheStats().evictions) return false;
+   Cache::iterator j = kopia.begin();
+   for(Cache::iterator i = m.begin(); i != m.end(); ++i, ++j)
+      if(j == kopia.end() || i->first != j->first) return false;
+   return j == kopia.end();
+}
+
+// bit CLOCK jest tylko w wezlach polityki, ktora go chce (z zapamietanym hashem miesci sie
+// obok niego); bez bitu tryb CLOCK dziala jak LRU
+bool testBitClock()
+{
+   typedef AISDIHashMap<string, int, hashF> Zwykla;
+   typedef AISDIHashMap<string, int, hashF, _compFunc, AISDIHashPolicy<AISDIFixedBuckets<MAX>, true> > ZHashem;
+   typedef AISDIHashMap<string, int, hashF, _compFunc, AISDIHashPolicy<AISDIFixedBuckets<MAX>, true, false, true> > ZHashemIBitem;
+   if(sizeof(Zwykla::HNode) != 4*sizeof(void*) + sizeof(pair<string, int>)) return false;
+   if(sizeof(MapaCache::HNode) <= sizeof(Zwykla::HNode) || sizeof(ZHashemIBitem::HNode) != sizeof(ZHashem::HNode)) return false;
+   Zwykla lru, clock;
+   MapaCache prawdziwyClock;
+   lru.setCapacity(10, Zwykla::LRU);
+   clock.setCapacity(10, Zwykla::CLOCK);
+   prawdziwyClock.setCapacity(10, MapaCache::CLOCK);
+   for(int i=0; i<30; i++){
+      lru.insert(make_pair(klucz('x', i), i));
+      clock.insert(make_pair(klucz('x', i), i));
+      prawdziwyClock.insert(make_pair(klucz('x', i), i));
+      lru.find(klucz('x', i % 3 ? i - 8 : i - 2));
+      clock.find(klucz('x', i % 3 ? i - 8 : i - 2));
+      prawdziwyClock.find(klucz('x', i % 3 ? i - 8 : i - 2));
+   }
+   bool inaczej = false;
+   for(int i=0; i<30; i++){
+      string k = klucz('x', i);
+      if((lru.find(k) == lru.end()) != (clock.find(k) == clock.end())) return false;
+      if((lru.find(k) == lru.end()) != (prawdziwyClock.find(k) == prawdziwyClock.end())) inaczej = true;
+   }
+   return inaczej;
+}
+
+// wartosc wymagajaca wyrownania wiekszego niz ALIGN areny
+struct alignas(64) Wyrownana
+{
+   int v;
+   Wyrownana(int x = 0):v(x){}
+};
+
+// usuniete wezly wracaja do puli i sa wydawane ponownie, shrink_to_fit oddaje kawalki
+// bez zajetych wezlow; wartosci wyrownane bardziej niz wskaznik musza byc wyrownane w wezlach
+bool testPulaWezlow()
+{
+   typedef AISDIHashMap<string, Wyrownana, hashF> WyrownanaMapa;
+   WyrownanaMapa m;
+   const int N = 20000;
+   for(int i=0; i<N; i++) m.insert(make_pair(klucz('x', i), Wyrownana(i)));
+   size_t pelna = m.memoryUsed();
+   if(pelna == 0) return false;
+   for(int i=0; i<N; i+=2) m.erase(klucz('x', i));
+   for(int i=0; i<N; i+=2) m.insert(make_pair(klucz('y', i), Wyrownana(-i)));
+   if(m.memoryUsed() != pelna) return false;   // wszystkie nowe wezly z listy wolnych
+   WyrownanaMapa kopia(m);
+   const WyrownanaMapa* mapy[2] = { &m, &kopia };
+   for(int j=0; j<2; j++)
+      for(WyrownanaMapa::const_iterator it = mapy[j]->begin(); it != mapy[j]->end(); ++it)
+         if(reinterpret_cast<uintptr_t>(&it->second) % alignof(Wyrownana) != 0) return false;
+   if(kopia.find(klucz('y', 10))->second.v != -10 || kopia.find(klucz('x', 11))->second.v != 11) return false;
+   m.shrink_to_fit();   // nic nie jest wolne - nic nie wraca
+   if(m.memoryUsed() != pelna) return false;
+   for(int i=0; i<N; i++) m.erase(klucz(i % 2 ? 'x' : 'y', i));
+   if(!m.empty() || m.memoryUsed() != pelna) return false;
+   m.shrink_to_fit();
+   if(m.memoryUsed() != 0) return false;
+   for(int i=0; i<N/2; i++) m.insert(make_pair(klucz('z', i), Wyrownana(i)));
+   size_t polowa = m.memoryUsed();
+   if(polowa == 0 || polowa >= pelna) return false;
+   for(int i=0; i<N/2; i+=2) m.erase(klucz('z', i));
+   m.shrink_to_fit();   // zajete wezly sa we wszystkich kawalkach
+   return m.memoryUsed() == polowa && m.find(klucz('z', 1))->second.v == 1 && kopia.size() == static_cast<size_t>(N);
+}
+
+// mapa z kluczami w wezlach: wartosci std::string, wyrownane wartosci, kopia, erase i clear
+bool testMapaNapisow()
+{
+   AISDIStrHashMap<string> m;
+   AISDIStrHashMap<Wyrownana> w;
+   for(int i=0; i<5000; i++){
+      m.insert(make_pair(klucz('x', i), string(i % 50, 'v') + klucz('w', i)));
+      w.insert(make_pair(i % 2 ? klucz('x', i) : "dluzszy klucz " + klucz('d', i), Wyrownana(i)));
+   }
+   for(int i=0; i<5000; i+=3) m.erase(klucz('x', i));
+   AISDIStrHashMap<string> kopia(m);
+   for(int i=0; i<5000; i++){
+      AISDIStrHashMap<string>::iterator it = kopia.find(klucz('x', i));
+      if((it == kopia.end()) != (i % 3 == 0)) return false;
+      if(it != kopia.end() && it.value() != string(i % 50, 'v') + klucz('w', i)) return false;
+   }
+   for(AISDIStrHashMap<Wyrownana>::iterator it = w.begin(); it != w.end(); ++it)
+      if(reinterpret_cast<uintptr_t>(&it.value()) % alignof(Wyrownana) != 0) return false;
+   if(w.find(klucz('x', 4999)).value().v != 4999) return false;
+   m.clear();
+   m["a"] = "b";
+   return m.size() == 1 && kopia.size() == 5000 - 1667 && w.size() == 5000;
+}
+
 int main()
 {
    // Miejsce na testy
@@ -24,6 +560,20 @@ int main()
    testmapa.empty();
    std::cout << "przeszedl empty\n";
    //testmapa.insert(make_pair("moj pierwszy hui",1));
+   cout << "mapa z kluczami w wezlach: " << (testMapaNapisow() ? "OK" : "BLAD") << endl;
+   cout << "kopia: " << (testKopia() ? "OK" : "BLAD") << endl;
+   cout << "pula wezlow: " << (testPulaWezlow() ? "OK" : "BLAD") << endl;
+   cout << "filtr Blooma: " << (testBloom() ? "OK" : "BLAD") << endl;
+   cout << "mapa zwarta: " << (testCompactMap<_fullHash<string> >() ? "OK" : "BLAD") << endl;
+   cout << "mapa zwarta, slaby hash: " << (testCompactMap<hashSiedem>() ? "OK" : "BLAD") << endl;
+   cout << "plik sladu: " << (testPlikSladu() ? "OK" : "BLAD") << endl;
+   cout << "scan: " << (testScan<AISDIHashMap<string, int, hashF> >() ? "OK" : "BLAD") << endl;
+   cout << "scan 2^k komorek: " << (testScan<AISDIHashMap<string, int, hashRaw, _compFunc, AISDIHashPolicy<AISDIPow2Buckets<12> > > >() ? "OK" : "BLAD") << endl;
+   cout << "kopia cache LRU: " << (testKopiaCache(MapaCache::LRU) ? "OK" : "BLAD") << endl;
+   cout << "kopia cache CLOCK: " << (testKopiaCache(MapaCache::CLOCK) ? "OK" : "BLAD") << endl;
+   cout << "bit CLOCK z polityki: " << (testBitClock() ? "OK" : "BLAD") << endl;
+   cout << "build_from z drzewami: " << (testBuildFrom() ? "OK" : "BLAD") << endl;
+   cout << "drzewo komorki: " << (testDrzewoKomorki() ? "OK" : "BLAD") << endl;
    
    return 0;
 }
@@ -0,0 +1,48 @@
+//
+// Odtwarza binarny slad operacji MapTester (patrz tracefile.h i trace2bin.cc)
+// na mapie i mierzy tylko czas operacji na mapie.
+//
+// uzycie: replay slad.bin
+
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <map>
+
+#include "timer.h"
+#include "tracefile.h"
+
+using namespace std;
+
+#if defined(AISDI_STRMAP)
+ #include "aisdistrhashmap.h"
+ static AISDIStrHashMap<int> m;
+#elif defined(AISDI_COMPACT)
+ #include "aisdicompactmap.h"
+ static AISDICompactHashMap<string, int> m;
+#elif 1
+ #include "aisdihashmap.h"
+ static AISDIHashMap<string, int, hashF, _compFunc> m;
+#else
+ static map<string, int> m;
+#endif
+
+int main(int argc, char* argv[])
+{
+	if(argc != 2){
+		cerr << "uzycie: " << argv[0] << " slad.bin" << endl;
+		return EXIT_FAILURE;
+	}
+	TraceFile slad;
+	if(!slad.open(argv[1])){
+		cerr << "niepoprawny plik sladu: " << argv[1] << endl;
+		return EXIT_FAILURE;
+	}
+	struct time_m czasstart = timer_start();
+	unsigned long suma = slad.replay(m);
+	double czas = timer_stop(czasstart);
+	cout << slad.size() << " operacji, " << slad.keyCount() << " kluczy, rozmiar mapy " << m.size() << endl;
+	cout << "suma kontrolna: " << suma << endl;
+	cout << "Czas odtwarzania: " << czas << " s." << endl;
+	return EXIT_SUCCESS;
+}
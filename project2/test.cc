@@ -2,7 +2,13 @@
 
 using namespace std;
  
-#if 1
+#if defined(AISDI_STRMAP)
+ #include "aisdistrhashmap.h"
+ static AISDIStrHashMap<int> m;
+#elif defined(AISDI_COMPACT)
+ #include "aisdicompactmap.h"
+ static AISDICompactHashMap<string, int> m;
+#elif 1
  #include "aisdihashmap.h"
  static AISDIHashMap<string, int, hashF, _compFunc> m;
 #else
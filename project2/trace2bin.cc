@@ -0,0 +1,57 @@
+//
+// Konwerter tekstowego sladu operacji MapTester na format binarny (tracefile.h).
+//
+// uzycie: trace2bin wejscie.txt wyjscie.bin
+
+#include <stdlib.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "tracefile.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+	if(argc != 3){
+		cerr << "uzycie: " << argv[0] << " slad.txt slad.bin" << endl;
+		return EXIT_FAILURE;
+	}
+	ifstream in(argv[1]);
+	if(!in){
+		cerr << "nie moge otworzyc " << argv[1] << endl;
+		return EXIT_FAILURE;
+	}
+
+	TraceBuilder slad;
+	string linia, komenda, klucz;
+	unsigned long nr = 0;
+	while(getline(in, linia)){
+		++nr;
+		if(linia.empty() || linia[0] == '#') continue;
+		istringstream ss(linia);
+		int val = 0;
+		if(!(ss >> komenda >> klucz)){
+			cerr << argv[1] << ":" << nr << ": brak klucza" << endl;
+			return EXIT_FAILURE;
+		}
+		int op = traceOpcode(komenda);
+		if(op < 0 || ((op == OP_INSERT || op == OP_MODIFY) && !(ss >> val))){
+			cerr << argv[1] << ":" << nr << ": niepoprawna komenda" << endl;
+			return EXIT_FAILURE;
+		}
+		if(!slad.add(op, klucz, val)){
+			cerr << "za duzo roznych kluczy" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(!slad.write(argv[2])){
+		cerr << "blad zapisu " << argv[2] << endl;
+		return EXIT_FAILURE;
+	}
+	cout << slad.size() << " operacji, " << slad.keyCount() << " kluczy" << endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,249 @@
+/**
+@file tracefile.h
+
+Compact binary MapTester traces and the replay engine that drives a map
+with them.
+
+Text trace (input of trace2bin), one command per line:
+   insert <key> <value>
+   remove <key>
+   modify <key> <value>      (MapTester::modifyOrAdd)
+   read <key>
+   find <key>
+Keys contain no whitespace. Empty lines and lines starting with '#' are skipped.
+
+Binary trace: TraceHeader, then nops TraceOp records, then nkeys+1 offsets
+into the key blob, then the key blob. Keys are interned - every distinct
+key is stored once and ops refer to it by index.
+*******************************************************************************/
+
+#ifndef TRACE_FILE_H_
+#define TRACE_FILE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <stdio.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/// Operations of MapTester.
+enum TraceOpcode { OP_INSERT = 0, OP_REMOVE, OP_MODIFY, OP_READ, OP_FIND, OP_COUNT };
+
+#define TRACE_MAGIC "AISDTRC1"
+#define TRACE_OP_BITS 3
+
+/// Command names of the text trace, indexed by TraceOpcode.
+static const char* const traceOpNames[OP_COUNT] = { "insert", "remove", "modify", "read", "find" };
+
+/// @returns The TraceOpcode of a text command, or -1.
+inline int traceOpcode(const std::string& s)
+{
+	for(int i=0; i<OP_COUNT; i++)
+		if(s == traceOpNames[i]) return i;
+	return -1;
+}
+
+struct TraceHeader
+{
+	char magic[8];
+	uint32_t nkeys;		///< number of distinct keys
+	uint32_t reserved;
+	uint64_t nops;		///< number of operations
+	uint64_t blobSize;	///< size of the key blob in bytes
+};
+
+/// One operation: opcode in the low TRACE_OP_BITS bits, key index above them.
+struct TraceOp
+{
+	uint32_t code;
+	int32_t val;
+	inline unsigned op() const { return code & ((1u<<TRACE_OP_BITS)-1); }
+	inline uint32_t key() const { return code >> TRACE_OP_BITS; }
+};
+
+/// Collects operations, interning their keys, and writes a binary trace.
+class TraceBuilder
+{
+public:
+	TraceBuilder() {}
+
+	/// Appends an operation. @returns false if there are too many distinct keys.
+	bool add(int op, const std::string& key, int val){
+		std::map<std::string, uint32_t>::iterator it = indeksy.find(key);
+		if(it == indeksy.end()){
+			if(indeksy.size() >= (1u << (32-TRACE_OP_BITS))) return false;
+			it = indeksy.insert(std::make_pair(key, static_cast<uint32_t>(indeksy.size()))).first;
+			offs.push_back(static_cast<uint32_t>(blob.size()));
+			blob += key;
+		}
+		TraceOp o;
+		o.code = (it->second << TRACE_OP_BITS) | op;
+		o.val = val;
+		ops.push_back(o);
+		return true;
+	}
+
+	uint64_t size() const { return ops.size(); }
+	uint32_t keyCount() const { return static_cast<uint32_t>(indeksy.size()); }
+
+	/// @returns false if the file could not be written.
+	bool write(const char* path) const{
+		TraceHeader h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, TRACE_MAGIC, 8);
+		h.nkeys = keyCount();
+		h.nops = ops.size();
+		h.blobSize = blob.size();
+		uint32_t koniec = static_cast<uint32_t>(blob.size());
+
+		FILE* out = fopen(path, "wb");
+		if(out == NULL) return false;
+		fwrite(&h, sizeof(h), 1, out);
+		if(!ops.empty()) fwrite(&ops[0], sizeof(TraceOp), ops.size(), out);
+		if(!offs.empty()) fwrite(&offs[0], sizeof(uint32_t), offs.size(), out);
+		fwrite(&koniec, sizeof(uint32_t), 1, out);
+		fwrite(blob.data(), 1, blob.size(), out);
+		return fclose(out) == 0;
+	}
+
+private:
+	std::map<std::string, uint32_t> indeksy;	//internowanie kluczy
+	std::string blob;
+	std::vector<uint32_t> offs;
+	std::vector<TraceOp> ops;
+};
+
+/// A binary trace mapped into memory. All keys are materialized once in
+/// open(), so replaying does no parsing and no allocation per operation.
+class TraceFile
+{
+public:
+	TraceFile():base(NULL),length(0),ops(NULL),nops(0){}
+	~TraceFile(){ close(); }
+
+	/// Maps the file. @returns false if it can't be read or is not a trace:
+	/// a wrong magic, sections that do not fit in the file, key offsets that
+	/// decrease or point past the blob, or an op with an unknown opcode or a
+	/// key index of nkeys or more. A file that opens replays within its bounds.
+	bool open(const char* path){
+		close();
+		int fd = ::open(path, O_RDONLY);
+		if(fd < 0) return false;
+		struct stat st;
+		if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(TraceHeader)){
+			::close(fd);
+			return false;
+		}
+		length = st.st_size;
+		void* p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(p == MAP_FAILED){
+			length = 0;
+			return false;
+		}
+		base = static_cast<const char*>(p);
+		const TraceHeader* h = reinterpret_cast<const TraceHeader*>(base);
+		if(!valid(h)){
+			close();
+			return false;
+		}
+		madvise(const_cast<char*>(base), length, MADV_SEQUENTIAL);
+		nops = h->nops;
+		ops = reinterpret_cast<const TraceOp*>(base + sizeof(TraceHeader));
+		const uint32_t* offs = reinterpret_cast<const uint32_t*>(ops + nops);
+		const char* blob = reinterpret_cast<const char*>(offs + h->nkeys + 1);
+		keys.resize(h->nkeys);
+		for(uint32_t i=0; i<h->nkeys; i++)
+			keys[i].first.assign(blob + offs[i], offs[i+1] - offs[i]);
+		return true;
+	}
+
+	void close(){
+		if(base != NULL) munmap(const_cast<char*>(base), length);
+		base = NULL;
+		length = 0;
+		ops = NULL;
+		nops = 0;
+		keys.clear();
+	}
+
+	uint64_t size() const { return nops; }
+	const TraceOp* begin() const { return ops; }
+	const TraceOp* end() const { return ops + nops; }
+	const std::string& key(uint32_t i) const { return keys[i].first; }
+	uint32_t keyCount() const { return static_cast<uint32_t>(keys.size()); }
+
+	/// Replays ops [from, to) on m with the semantics of MapTester in test.cc.
+	/// @returns A checksum of the results, equal for every correct map.
+	template<class Map>
+	unsigned long replay(Map& m, uint64_t from, uint64_t to){
+		unsigned long wyn = 0;
+		for(const TraceOp* o = ops + from; o != ops + to; ++o){
+			std::pair<std::string, int>& e = keys[o->key()];
+			switch(o->op()){
+			case OP_INSERT:
+				e.second = o->val;		//para z gotowym kluczem - bez kopiowania stringa
+				wyn += m.insert(e).second;
+				break;
+			case OP_REMOVE:
+				wyn += 3*m.erase(e.first);
+				break;
+			case OP_MODIFY:
+				m[e.first] = o->val;
+				break;
+			case OP_READ:
+				wyn = wyn*31 + m[e.first];
+				break;
+			case OP_FIND:
+				wyn += 7*(m.find(e.first) != m.end());
+				break;
+			}
+		}
+		return wyn;
+	}
+
+	template<class Map>
+	unsigned long replay(Map& m){
+		return replay(m, 0, nops);
+	}
+
+private:
+	//naglowek i zawartosc pliku zmapowanego pod base: kazda sekcja miesci sie w tym, co zostalo
+	//po poprzednich (dzielenie zamiast mnozenia - nops z pliku moze byc dowolne), przesuniecia
+	//kluczy rosna i koncza sie w blobie, ops odwoluja sie tylko do istniejacych kluczy
+	bool valid(const TraceHeader* h) const{
+		if(memcmp(h->magic, TRACE_MAGIC, 8) != 0) return false;
+		uint64_t zostalo = length - sizeof(TraceHeader);
+		if(h->nops > zostalo/sizeof(TraceOp)) return false;
+		zostalo -= h->nops*sizeof(TraceOp);
+		if(static_cast<uint64_t>(h->nkeys) + 1 > zostalo/sizeof(uint32_t)) return false;
+		zostalo -= (static_cast<uint64_t>(h->nkeys) + 1)*sizeof(uint32_t);
+		if(h->blobSize > zostalo) return false;
+		const TraceOp* o = reinterpret_cast<const TraceOp*>(base + sizeof(TraceHeader));
+		const uint32_t* offs = reinterpret_cast<const uint32_t*>(o + h->nops);
+		for(uint32_t i=0; i<h->nkeys; i++)
+			if(offs[i] > offs[i+1]) return false;
+		if(offs[h->nkeys] > h->blobSize) return false;
+		for(uint64_t i=0; i<h->nops; i++)
+			if(o[i].op() >= OP_COUNT || o[i].key() >= h->nkeys) return false;
+		return true;
+	}
+
+	const char* base;
+	size_t length;
+	const TraceOp* ops;
+	uint64_t nops;
+	std::vector<std::pair<std::string, int> > keys;
+
+	TraceFile(const TraceFile&);
+	TraceFile& operator=(const TraceFile&);
+};
+
+#endif
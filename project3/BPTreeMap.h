@@ -0,0 +1,642 @@
+/**
+@file BPTreeMap.h
+
+BPTreeMap - a B+tree with the interface of TreeMap (int keys, std::string values).
+
+Inner nodes hold up to INNER_KEYS separator keys in one 128-byte array, so a
+lookup touches two cache lines per level instead of one TreeNode per binary
+level; the array is searched by counting the keys smaller than the wanted one,
+four at a time with SSE2 (a plain branch-free loop without it). All pairs live
+in the leaves, which are linked in both directions, so iterating is a
+sequential walk over arrays of LEAF_SIZE pairs.
+
+Unlike TreeMap, inserting or erasing may move pairs between leaves, which
+invalidates iterators (like in std::vector). insert() overwrites the value of
+an existing key, as TreeMap::insert does.
+*******************************************************************************/
+
+#ifndef BP_TREE_MAP_H_
+#define BP_TREE_MAP_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <climits>
+#include <iterator>
+#include <string>
+#include <utility>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/// A map with a similar interface to std::map, implemented as a B+tree.
+class BPTreeMap
+{
+public:
+	typedef int Key;
+	typedef std::string Val;
+	typedef size_t size_type;
+	typedef std::pair<Key, Val> P;
+
+	enum { INNER_KEYS = 31, LEAF_SIZE = 32, MAX_HEIGHT = 16 };
+
+protected:
+	//wezel wewnetrzny: n kluczy rozdzielajacych i n+1 dzieci. W dziecku i sa klucze
+	//z przedzialu [keys[i-1], keys[i]). Wolne pola keys maja INT_MAX
+	struct alignas(64) Inner{
+		Key keys[INNER_KEYS+1];
+		void* child[INNER_KEYS+1];
+		int n;
+		Inner():n(0){ for(int i=0; i<=INNER_KEYS; i++) keys[i] = INT_MAX; }
+	};
+	//lisc: n par posortowanych po kluczu, klucze osobno (do wyszukiwania) i razem z wartosciami
+	struct alignas(64) Leaf{
+		Key keys[LEAF_SIZE];
+		int n;
+		Leaf* prev;
+		Leaf* next;
+		P data[LEAF_SIZE];
+		Leaf():n(0),prev(NULL),next(NULL){ for(int i=0; i<LEAF_SIZE; i++) keys[i] = INT_MAX; }
+	};
+
+	void* korzen;		//Leaf, gdy wysokosc == 0, wpp. Inner. NULL - pusta mapa
+	int wysokosc;		//liczba poziomow wezlow wewnetrznych
+	size_type ile;
+	Leaf* pierwszy;		//poczatek i koniec listy lisci
+	Leaf* ostatni;
+
+	//liczba kluczy mniejszych od k wsrod pierwszych n (wolne pola maja INT_MAX, wiec
+	//mozna brac po cztery naraz bez sprawdzania granicy)
+	static inline int countLess(const Key* keys, int n, Key k){
+#ifdef __SSE2__
+		__m128i kv = _mm_set1_epi32(k);
+		__m128i suma = _mm_setzero_si128();
+		for(int i=0; i<n; i+=4)		//cmpgt daje -1 tam, gdzie keys[i] < k
+			suma = _mm_sub_epi32(suma, _mm_cmpgt_epi32(kv, _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys+i))));
+		suma = _mm_add_epi32(suma, _mm_shuffle_epi32(suma, 0x4E));
+		suma = _mm_add_epi32(suma, _mm_shuffle_epi32(suma, 0xB1));
+		return _mm_cvtsi128_si32(suma);
+#else
+		int c = 0;
+		for(int i=0; i<n; i++) c += keys[i] < k;
+		return c;
+#endif
+	}
+
+	//numer dziecka, w ktorym moze byc klucz k
+	static inline int childFor(const Inner* w, Key k){
+		return k == INT_MAX ? w->n : countLess(w->keys, w->n, k+1);
+	}
+
+	//zejscie do liscia, ktory moze zawierac k. Jesli sciezka != NULL, zapisuje na niej
+	//wezly wewnetrzne i numery dzieci, w ktore schodzilo
+	Leaf* descend(Key k, Inner** sciezka, int* poz) const{
+		void* w = korzen;
+		for(int d=0; d<wysokosc; d++){
+			Inner* in = static_cast<Inner*>(w);
+			int c = childFor(in, k);
+			if(sciezka != NULL){
+				sciezka[d] = in;
+				poz[d] = c;
+			}
+			w = in->child[c];
+			__builtin_prefetch(static_cast<char*>(w)+64);	//druga linia kluczy dziecka razem z pierwsza
+		}
+		return static_cast<Leaf*>(w);
+	}
+
+public:
+	BPTreeMap():korzen(NULL),wysokosc(0),ile(0),pierwszy(NULL),ostatni(NULL){}
+
+	/// Content of existing BPTreeMap object is copied into the new object.
+	/// The copy has the same structure.
+	BPTreeMap(const BPTreeMap& m):korzen(NULL),wysokosc(0),ile(0),pierwszy(NULL),ostatni(NULL){
+		copyFrom(m);
+	}
+
+	~BPTreeMap(){
+		clear();
+	}
+
+	/// A const_iterator.
+	/// It also serves as a base for the (not const) iterator.
+	class const_iterator : public std::iterator<std::bidirectional_iterator_tag, P>
+	{
+	public:
+		typedef P T;
+
+	protected:
+		const BPTreeMap* mapa;
+		Leaf* lisc;			//NULL - end()
+		int i;
+		friend class BPTreeMap;
+
+		const_iterator(const BPTreeMap* m, Leaf* l, int p):mapa(m),lisc(l),i(p){}
+	public:
+		const_iterator():mapa(NULL),lisc(NULL),i(0){}
+
+		inline const T& operator*() const { return lisc->data[i]; }
+		inline const T* operator->() const { return &(lisc->data[i]); }
+
+		const_iterator& operator++(){
+			if(++i >= lisc->n){
+				lisc = lisc->next;
+				i = 0;
+			}
+			return *this;
+		}
+		const_iterator operator++(int){
+			const_iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+		const_iterator& operator--(){
+			if(lisc == NULL){
+				lisc = mapa->ostatni;
+				i = lisc->n-1;
+			}
+			else if(i == 0){
+				lisc = lisc->prev;
+				i = lisc->n-1;
+			}
+			else --i;
+			return *this;
+		}
+		const_iterator operator--(int){
+			const_iterator tmp = *this;
+			--*this;
+			return tmp;
+		}
+
+		inline bool operator==(const const_iterator& a) const { return lisc == a.lisc && i == a.i; }
+		inline bool operator!=(const const_iterator& a) const { return !(*this == a); }
+	};
+
+	/// An iterator.
+	class iterator : public const_iterator
+	{
+		iterator(const BPTreeMap* m, Leaf* l, int p):const_iterator(m, l, p){}
+		friend class BPTreeMap;
+	public:
+		using const_iterator::lisc;
+		using const_iterator::i;
+		typedef P T;
+		iterator(){}
+		iterator(const const_iterator& a):const_iterator(a){}
+
+		inline T& operator*() const { return lisc->data[i]; }
+		inline T* operator->() const { return &(lisc->data[i]); }
+
+		iterator& operator++(){
+			++(*(const_iterator*)this);
+			return *this;
+		}
+		iterator operator++(int){
+			iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+		iterator& operator--(){
+			--(*(const_iterator*)this);
+			return *this;
+		}
+		iterator operator--(int){
+			iterator tmp = *this;
+			--*this;
+			return tmp;
+		}
+	};
+
+	/// Returns an iterator addressing the first element in the map
+	iterator begin() { return iterator(this, pierwszy, 0); }
+	const_iterator begin() const { return const_iterator(this, pierwszy, 0); }
+
+	/// Returns an iterator that addresses the location succeeding the last element in a map
+	iterator end() { return iterator(this, NULL, 0); }
+	const_iterator end() const { return const_iterator(this, NULL, 0); }
+
+	/// Inserts an element into the map; an existing key gets the new value.
+	/// @returns A pair whose bool component is true if an insertion was
+	///          made and false if the map already contained an element
+	///          associated with that key, and whose iterator component coresponds to
+	///          the address where a new element was inserted or where the element
+	///          was already located.
+	std::pair<iterator, bool> insert(const P& entry){
+		if(korzen == NULL){
+			Leaf* l = new Leaf();
+			korzen = pierwszy = ostatni = l;
+		}
+		Inner* sciezka[MAX_HEIGHT];
+		int poz[MAX_HEIGHT];
+		Leaf* l = descend(entry.first, sciezka, poz);
+		int i = countLess(l->keys, l->n, entry.first);
+		if(i < l->n && l->keys[i] == entry.first){
+			l->data[i].second = entry.second;
+			return std::make_pair(iterator(this, l, i), false);
+		}
+		if(l->n == LEAF_SIZE){
+			Leaf* r = splitLeaf(l);
+			insertSeparator(sciezka, poz, wysokosc-1, r->keys[0], r);
+			if(i > l->n){
+				i -= l->n;
+				l = r;
+			}
+		}
+		for(int j=l->n; j>i; j--){
+			l->keys[j] = l->keys[j-1];
+			l->data[j] = std::move(l->data[j-1]);
+		}
+		l->keys[i] = entry.first;
+		l->data[i] = entry;
+		++l->n;
+		++ile;
+		return std::make_pair(iterator(this, l, i), true);
+	}
+
+	/// Inserts an element into the map.
+	/// This method assumes there is no value asociated with
+	/// such a key in the map.
+	iterator unsafe_insert(const P& entry){
+		return insert(entry).first;
+	}
+
+	/// Returns an iterator addressing the location of the entry in the map
+	/// that has a key equivalent to the specified one or the location succeeding the
+	/// last element in the map if there is no match for the key.
+	iterator find(const Key& k){
+		return iterator(findPos(k));
+	}
+	const_iterator find(const Key& k) const{
+		return findPos(k);
+	}
+
+	/// Inserts an element into a map with a specified key value
+	/// if one with such a key value does not exist.
+	/// @returns Reference to the value component of the element defined by the key.
+	Val& operator[](const Key& k){
+		iterator it = find(k);
+		if(it == end()) it = unsafe_insert(std::make_pair(k, Val()));
+		return it->second;
+	}
+
+	/// Tests if a map is empty.
+	bool empty() const { return ile == 0; }
+
+	/// Returns the number of elements in the map.
+	size_type size() const { return ile; }
+
+	/// Returns the number of elements in a map whose key matches a parameter-specified key.
+	size_type count(const Key& k) const { return find(k) != end(); }
+
+	/// Removes an element from the map.
+	/// @returns The iterator that designates the first element remaining beyond the removed one.
+	iterator erase(iterator it){
+		if(it.lisc == NULL) return it;
+		const_iterator nast = it;
+		++nast;
+		bool koniec = (nast.lisc == NULL);
+		Key k = koniec ? 0 : nast->first;
+		eraseKey(it->first);
+		return koniec ? end() : iterator(findPos(k));
+	}
+
+	/// Removes a range of elements from the map.
+	/// The range is defined by the first and last iterators
+	/// first is the first element removed and last is the element just beyond the last elemnt removed.
+	/// @returns The iterator that designates the first element remaining beyond any elements removed.
+	iterator erase(iterator first, iterator last){
+		if(last.lisc == NULL){
+			while(first != end()) first = erase(first);
+			return end();
+		}
+		Key k = last->first;		//iteratory moga sie uniewaznic - granica to klucz
+		while(first->first != k) first = erase(first);
+		return first;
+	}
+
+	/// Removes an element from the map.
+	/// @returns The number of elements that have been removed from the map (1 or 0).
+	size_type erase(const Key& key){
+		return eraseKey(key) ? 1 : 0;
+	}
+
+	/// Erases all the elements of a map.
+	void clear(){
+		if(korzen != NULL) deleteNode(korzen, wysokosc);
+		korzen = NULL;
+		wysokosc = 0;
+		ile = 0;
+		pierwszy = ostatni = NULL;
+	}
+
+	/// Returns true if this map's internal structure is identical to another map's structure.
+	bool struct_eq(const BPTreeMap& another) const{
+		if(korzen == NULL || another.korzen == NULL) return korzen == another.korzen;
+		return wysokosc == another.wysokosc && sameNode(korzen, another.korzen, wysokosc);
+	}
+	/// Returns true if this map contains exactly the same key-value pairs as the another map.
+	bool info_eq(const BPTreeMap& another) const{
+		if(ile != another.ile) return false;
+		const_iterator a = begin(), b = another.begin();
+		for(; a != end(); ++a, ++b)
+			if(*a != *b) return false;
+		return true;
+	}
+
+	/// Returns true if this map contains exactly the same key-value pairs as the another map.
+	inline bool operator==(const BPTreeMap& a) const { return info_eq(a); }
+
+	/// Assignment operator copy the source elements into this object.
+	BPTreeMap& operator=(const BPTreeMap& other){
+		if(&other != this){
+			clear();
+			copyFrom(other);
+		}
+		return *this;
+	}
+
+protected:
+	//iterator na element o kluczu k albo end()
+	const_iterator findPos(Key k) const{
+		if(korzen == NULL) return end();
+		Leaf* l = descend(k, NULL, NULL);
+		int i = countLess(l->keys, l->n, k);
+		if(i < l->n && l->keys[i] == k) return const_iterator(this, l, i);
+		return end();
+	}
+
+	//przenosi gorna polowe pelnego liscia l do nowego liscia za nim
+	Leaf* splitLeaf(Leaf* l){
+		Leaf* r = new Leaf();
+		int pol = LEAF_SIZE/2;
+		for(int j=pol; j<LEAF_SIZE; j++){
+			r->keys[j-pol] = l->keys[j];
+			r->data[j-pol] = std::move(l->data[j]);
+			l->keys[j] = INT_MAX;
+		}
+		r->n = LEAF_SIZE-pol;
+		l->n = pol;
+		r->next = l->next;
+		r->prev = l;
+		if(l->next != NULL) l->next->prev = r;
+		else ostatni = r;
+		l->next = r;
+		return r;
+	}
+
+	//wstawia klucz rozdzielajacy k i prawe dziecko r (powstale z podzialu) do wezla sciezka[d],
+	//na prawo od dziecka poz[d]. Pelny wezel dzieli sie dalej; d < 0 - nowy korzen
+	void insertSeparator(Inner** sciezka, int* poz, int d, Key k, void* r){
+		if(d < 0){
+			Inner* nowy = new Inner();
+			nowy->keys[0] = k;
+			nowy->child[0] = korzen;
+			nowy->child[1] = r;
+			nowy->n = 1;
+			korzen = nowy;
+			++wysokosc;
+			return;
+		}
+		Inner* w = sciezka[d];
+		int c = poz[d];
+		if(w->n < INNER_KEYS){
+			insertAt(w, c, k, r);
+			return;
+		}
+		//podzial: lewa polowa zostaje w w, srodkowy klucz idzie w gore
+		Key keys[INNER_KEYS+1];
+		void* child[INNER_KEYS+2];
+		for(int j=0, s=0; j<=INNER_KEYS; j++) keys[j] = (j == c) ? k : w->keys[s++];
+		for(int j=0, s=0; j<=INNER_KEYS+1; j++) child[j] = (j == c+1) ? r : w->child[s++];
+		int pol = (INNER_KEYS+1)/2;
+		Inner* prawy = new Inner();
+		for(int j=0; j<pol; j++){
+			w->keys[j] = keys[j];
+			w->child[j] = child[j];
+		}
+		w->child[pol] = child[pol];
+		for(int j=pol; j<=INNER_KEYS; j++) w->keys[j] = INT_MAX;
+		w->n = pol;
+		for(int j=pol+1; j<=INNER_KEYS; j++){
+			prawy->keys[j-pol-1] = keys[j];
+			prawy->child[j-pol-1] = child[j];
+		}
+		prawy->child[INNER_KEYS-pol] = child[INNER_KEYS+1];
+		prawy->n = INNER_KEYS-pol;
+		insertSeparator(sciezka, poz, d-1, keys[pol], prawy);
+	}
+
+	//wstawia klucz k na pozycje c i dziecko r na pozycje c+1 niepelnego wezla
+	static void insertAt(Inner* w, int c, Key k, void* r){
+		for(int j=w->n; j>c; j--){
+			w->keys[j] = w->keys[j-1];
+			w->child[j+1] = w->child[j];
+		}
+		w->keys[c] = k;
+		w->child[c+1] = r;
+		++w->n;
+	}
+
+	//usuwa klucz c i dziecko c+1 wezla
+	static void removeAt(Inner* w, int c){
+		for(int j=c; j<w->n-1; j++){
+			w->keys[j] = w->keys[j+1];
+			w->child[j+1] = w->child[j+2];
+		}
+		--w->n;
+		w->keys[w->n] = INT_MAX;
+	}
+
+	//usuwa klucz k; zbyt puste wezly pozyczaja od sasiada albo sie z nim lacza
+	bool eraseKey(Key k){
+		if(korzen == NULL) return false;
+		Inner* sciezka[MAX_HEIGHT];
+		int poz[MAX_HEIGHT];
+		Leaf* l = descend(k, sciezka, poz);
+		int i = countLess(l->keys, l->n, k);
+		if(i >= l->n || l->keys[i] != k) return false;
+		for(int j=i; j<l->n-1; j++){
+			l->keys[j] = l->keys[j+1];
+			l->data[j] = std::move(l->data[j+1]);
+		}
+		--l->n;
+		l->keys[l->n] = INT_MAX;
+		l->data[l->n] = P();		//zwolnienie pamieci napisu od razu
+		--ile;
+		if(wysokosc == 0){
+			if(l->n == 0) clear();
+			return true;
+		}
+		if(l->n >= LEAF_SIZE/2) return true;
+		fixLeaf(l, sciezka[wysokosc-1], poz[wysokosc-1]);
+		for(int d=wysokosc-1; d>0 && sciezka[d]->n < INNER_KEYS/2; d--)
+			fixInner(sciezka[d], sciezka[d-1], poz[d-1]);
+		Inner* k0 = static_cast<Inner*>(korzen);
+		if(k0->n == 0){		//korzen z jednym dzieckiem - drzewo sie obniza
+			korzen = k0->child[0];
+			--wysokosc;
+			delete k0;
+		}
+		return true;
+	}
+
+	//lisc l (dziecko c wezla p) ma za malo par: pozyczka od brata albo polaczenie z nim
+	void fixLeaf(Leaf* l, Inner* p, int c){
+		if(c > 0){
+			Leaf* lewy = static_cast<Leaf*>(p->child[c-1]);
+			if(lewy->n > LEAF_SIZE/2){
+				for(int j=l->n; j>0; j--){
+					l->keys[j] = l->keys[j-1];
+					l->data[j] = std::move(l->data[j-1]);
+				}
+				--lewy->n;
+				l->keys[0] = lewy->keys[lewy->n];
+				l->data[0] = std::move(lewy->data[lewy->n]);
+				lewy->keys[lewy->n] = INT_MAX;
+				++l->n;
+				p->keys[c-1] = l->keys[0];
+			}
+			else mergeLeaves(lewy, l, p, c-1);
+			return;
+		}
+		Leaf* prawy = static_cast<Leaf*>(p->child[c+1]);
+		if(prawy->n > LEAF_SIZE/2){
+			l->keys[l->n] = prawy->keys[0];
+			l->data[l->n] = std::move(prawy->data[0]);
+			++l->n;
+			for(int j=0; j<prawy->n-1; j++){
+				prawy->keys[j] = prawy->keys[j+1];
+				prawy->data[j] = std::move(prawy->data[j+1]);
+			}
+			--prawy->n;
+			prawy->keys[prawy->n] = INT_MAX;
+			p->keys[c] = prawy->keys[0];
+		}
+		else mergeLeaves(l, prawy, p, c);
+	}
+
+	//dolacza lisc r do lisca l (dzieci c i c+1 wezla p) i usuwa r
+	void mergeLeaves(Leaf* l, Leaf* r, Inner* p, int c){
+		for(int j=0; j<r->n; j++){
+			l->keys[l->n+j] = r->keys[j];
+			l->data[l->n+j] = std::move(r->data[j]);
+		}
+		l->n += r->n;
+		l->next = r->next;
+		if(r->next != NULL) r->next->prev = l;
+		else ostatni = l;
+		removeAt(p, c);
+		delete r;
+	}
+
+	//wezel wewnetrzny w (dziecko c wezla p) ma za malo kluczy
+	void fixInner(Inner* w, Inner* p, int c){
+		if(c > 0){
+			Inner* lewy = static_cast<Inner*>(p->child[c-1]);
+			if(lewy->n > INNER_KEYS/2){		//klucz z p schodzi do w, ostatni klucz lewego idzie do p
+				w->child[w->n+1] = w->child[w->n];
+				for(int j=w->n; j>0; j--){
+					w->keys[j] = w->keys[j-1];
+					w->child[j] = w->child[j-1];
+				}
+				w->keys[0] = p->keys[c-1];
+				w->child[0] = lewy->child[lewy->n];
+				++w->n;
+				p->keys[c-1] = lewy->keys[lewy->n-1];
+				--lewy->n;
+				lewy->keys[lewy->n] = INT_MAX;
+			}
+			else mergeInner(lewy, w, p, c-1);
+			return;
+		}
+		Inner* prawy = static_cast<Inner*>(p->child[c+1]);
+		if(prawy->n > INNER_KEYS/2){
+			w->keys[w->n] = p->keys[c];
+			w->child[w->n+1] = prawy->child[0];
+			++w->n;
+			p->keys[c] = prawy->keys[0];
+			for(int j=0; j<prawy->n-1; j++){
+				prawy->keys[j] = prawy->keys[j+1];
+				prawy->child[j] = prawy->child[j+1];
+			}
+			prawy->child[prawy->n-1] = prawy->child[prawy->n];
+			--prawy->n;
+			prawy->keys[prawy->n] = INT_MAX;
+		}
+		else mergeInner(w, prawy, p, c);
+	}
+
+	//laczy wezly l i r (dzieci c i c+1 wezla p) razem z kluczem rozdzielajacym z p
+	void mergeInner(Inner* l, Inner* r, Inner* p, int c){
+		l->keys[l->n] = p->keys[c];
+		for(int j=0; j<r->n; j++){
+			l->keys[l->n+1+j] = r->keys[j];
+			l->child[l->n+1+j] = r->child[j];
+		}
+		l->child[l->n+1+r->n] = r->child[r->n];
+		l->n += r->n+1;
+		removeAt(p, c);
+		delete r;
+	}
+
+	static void deleteNode(void* w, int d){
+		if(d == 0){
+			delete static_cast<Leaf*>(w);
+			return;
+		}
+		Inner* in = static_cast<Inner*>(w);
+		for(int j=0; j<=in->n; j++) deleteNode(in->child[j], d-1);
+		delete in;
+	}
+
+	//kopia poddrzewa o wysokosci d; liscie sa dolaczane na koniec listy lisci
+	void* copyNode(const void* w, int d){
+		if(d == 0){
+			const Leaf* z = static_cast<const Leaf*>(w);
+			Leaf* l = new Leaf();
+			for(int j=0; j<z->n; j++){
+				l->keys[j] = z->keys[j];
+				l->data[j] = z->data[j];
+			}
+			l->n = z->n;
+			l->prev = ostatni;
+			if(ostatni != NULL) ostatni->next = l;
+			else pierwszy = l;
+			ostatni = l;
+			return l;
+		}
+		const Inner* z = static_cast<const Inner*>(w);
+		Inner* in = new Inner();
+		for(int j=0; j<z->n; j++) in->keys[j] = z->keys[j];
+		for(int j=0; j<=z->n; j++) in->child[j] = copyNode(z->child[j], d-1);
+		in->n = z->n;
+		return in;
+	}
+
+	void copyFrom(const BPTreeMap& m){
+		if(m.korzen == NULL) return;
+		korzen = copyNode(m.korzen, m.wysokosc);
+		wysokosc = m.wysokosc;
+		ile = m.ile;
+	}
+
+	static bool sameNode(const void* a, const void* b, int d){
+		if(d == 0){
+			const Leaf* x = static_cast<const Leaf*>(a);
+			const Leaf* y = static_cast<const Leaf*>(b);
+			if(x->n != y->n) return false;
+			for(int j=0; j<x->n; j++)
+				if(x->data[j] != y->data[j]) return false;
+			return true;
+		}
+		const Inner* x = static_cast<const Inner*>(a);
+		const Inner* y = static_cast<const Inner*>(b);
+		if(x->n != y->n) return false;
+		for(int j=0; j<x->n; j++)
+			if(x->keys[j] != y->keys[j]) return false;
+		for(int j=0; j<=x->n; j++)
+			if(!sameNode(x->child[j], y->child[j], d-1)) return false;
+		return true;
+	}
+};
+
+#endif
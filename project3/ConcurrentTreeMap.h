@@ -0,0 +1,569 @@
+/**
+@file ConcurrentTreeMap.h
+
+ConcurrentTreeMap - a binary search tree of int keys and std::string values
+that many threads can read and change at the same time, using optimistic
+lock coupling (OLC) in the style of Bronson et al.'s concurrent AVL tree.
+
+Every node has a version word: bit 0 is a write lock, and every change of the
+node (its children, its value, unlinking it) adds 2 when the lock is let go.
+Readers take no locks. They remember a node's version, read its fields, and
+check that the version is still the same; when stepping from a node to its
+child they check the parent again after reading the child's version (lock
+coupling), and start over from the root if anything moved under them.
+Writers lock only the nodes they change: the parent of a new leaf, the node
+whose value is replaced, or the (at most four) nodes taking part in a
+rotation; locks are always taken from the top of the tree down.
+
+- Erasing a key that has two children only clears its value; the node stays
+  as a routing node and is unlinked later, once it has at most one child.
+- The tree is rebalanced after every change by a relaxed AVL pass that walks
+  up from the changed node; under concurrent changes heights can be briefly
+  stale, but with one writer the tree is an exact AVL tree.
+- Unlinked nodes and replaced values are freed by epoch-based reclamation,
+  only after every thread that could still see them has finished its call.
+  Garbage left by a thread that has exited is freed by the next reclamation
+  pass of any other thread in the same map.
+
+There are no iterators: find() and lower_bound() copy the value out, and
+scan() visits a range of keys in order by one optimistic lower_bound() descent
+per key (a descent that meets a changed node starts over from the root).
+At most MAX_THREADS threads may use ConcurrentTreeMaps at the same time; a
+call from one more thread throws std::length_error (and succeeds again once
+some other thread using the maps has exited).
+*******************************************************************************/
+
+#ifndef CONCURRENT_TREE_MAP_H_
+#define CONCURRENT_TREE_MAP_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// An ordered map for concurrent use, with optimistic lock coupling.
+class ConcurrentTreeMap
+{
+public:
+	typedef int Key;
+	typedef std::string Val;
+	typedef size_t size_type;
+	typedef std::pair<Key, Val> P;
+
+	enum { MAX_THREADS = 64, RETIRE_BATCH = 128 };
+
+protected:
+	struct Node{
+		std::atomic<uint64_t> wersja;	//bit 0 - zamkniety, kazda zmiana dodaje 2
+		const Key key;
+		std::atomic<const Val*> val;	//NULL - wezel trasujacy (klucz usuniety, wezel jeszcze w drzewie)
+		std::atomic<Node*> left;
+		std::atomic<Node*> right;
+		std::atomic<Node*> parent;
+		std::atomic<int> h;				//wysokosc poddrzewa (lisc - 1)
+		std::atomic<bool> odlaczony;	//wezel usuniety z drzewa, czeka na zwolnienie
+		Node(Key k, const Val* v, Node* p):wersja(0),key(k),val(v),left(NULL),right(NULL),parent(p),h(1),odlaczony(false){}
+	};
+
+	//element do zwolnienia, gdy skonczy sie epoka, w ktorej zostal odlaczony
+	struct Smiec{
+		void* p;
+		void (*usun)(void*);
+		uint64_t epoka;
+	};
+
+	//dane jednego watku. epoka - epoka ogloszona na czas operacji, 0 - watek poza mapa
+	struct alignas(64) Slot{
+		std::atomic<uint64_t> epoka;
+		std::vector<Smiec> smieci;		//uzywane tylko przez watek, do ktorego nalezy slot
+		Slot():epoka(0){}
+	};
+
+	Node* straznik;		//drzewo wisi na straznik->left, prawe dziecko zawsze NULL
+	std::atomic<size_type> ile;
+	std::atomic<uint64_t> epoka;
+	Slot sloty[MAX_THREADS];
+
+	////////// wersje wezlow
+
+	static inline void czekaj(){
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	}
+
+	//wersja wezla, gdy nie jest zamkniety
+	static uint64_t readLock(const Node* n){
+		uint64_t v;
+		while((v = n->wersja.load(std::memory_order_acquire)) & 1) czekaj();
+		return v;
+	}
+	//czy od odczytu wersji v nikt nie zmienil wezla
+	static bool validate(const Node* n, uint64_t v){
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return n->wersja.load(std::memory_order_relaxed) == v;
+	}
+	//zamyka wezel, jesli nadal ma wersje v
+	static bool upgrade(Node* n, uint64_t v){
+		if(!n->wersja.compare_exchange_strong(v, v | 1, std::memory_order_acquire)) return false;
+		std::atomic_thread_fence(std::memory_order_release);
+		return true;
+	}
+	static void lock(Node* n){
+		while(!upgrade(n, readLock(n))) {}
+	}
+	//otwiera wezel z nowa wersja (czytelnicy, ktorzy go widzieli, zaczna od nowa)
+	static void unlock(Node* n){
+		n->wersja.fetch_add(1, std::memory_order_release);
+	}
+	//otwiera wezel bez zmiany wersji - nic, co widza czytelnicy, sie nie zmienilo
+	static void unlockUnchanged(Node* n){
+		n->wersja.fetch_sub(1, std::memory_order_release);
+	}
+
+	////////// odzyskiwanie pamieci (epoki)
+
+	static std::atomic<bool>* zajete(){
+		static std::atomic<bool> t[MAX_THREADS];
+		return t;
+	}
+	//numer slotu watku, staly przez cale zycie watku i wspolny dla wszystkich map.
+	//Gdy wszystkie sloty sa zajete, rzuca std::length_error; nastepne wywolanie probuje znowu
+	static int slotWatku(){
+		struct Rejestracja{
+			int nr;
+			Rejestracja():nr(-1){ zajmij(); }
+			void zajmij(){
+				for(int i=0; i<MAX_THREADS; i++){
+					bool wolny = false;
+					if(zajete()[i].compare_exchange_strong(wolny, true)){
+						nr = i;
+						return;
+					}
+				}
+			}
+			~Rejestracja(){ if(nr >= 0) zajete()[nr].store(false, std::memory_order_release); }
+		};
+		static thread_local Rejestracja r;
+		if(r.nr < 0) r.zajmij();
+		if(r.nr < 0) throw std::length_error("ConcurrentTreeMap: more than MAX_THREADS threads");
+		return r.nr;
+	}
+
+	//na czas operacji watek oglasza biezaca epoke; nic, co widzi, nie zostanie zwolnione
+	struct Ochrona{
+		Slot& s;
+		Ochrona(const ConcurrentTreeMap& m):s(const_cast<ConcurrentTreeMap&>(m).sloty[slotWatku()]){
+			s.epoka.store(m.epoka.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+		~Ochrona(){ s.epoka.store(0, std::memory_order_release); }
+	};
+
+	static void usunWezel(void* p) { delete static_cast<Node*>(p); }
+	static void usunWartosc(void* p) { delete static_cast<const Val*>(p); }
+
+	void retire(void* p, void (*usun)(void*)){
+		Slot& s = sloty[slotWatku()];
+		s.smieci.push_back(Smiec{p, usun, epoka.load(std::memory_order_relaxed)});
+		if(s.smieci.size() % RETIRE_BATCH == 0) sprzatnij(s);
+	}
+
+	//przesuwa epoke, jesli wszystkie aktywne watki ja juz widza, i zwalnia smieci
+	//starsze o dwie epoki - zaden watek nie moze ich juz miec w reku
+	void sprzatnij(Slot& s){
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		uint64_t e = epoka.load(std::memory_order_seq_cst);
+		bool wszyscy = true;
+		for(int i=0; i<MAX_THREADS && wszyscy; i++){
+			uint64_t x = sloty[i].epoka.load(std::memory_order_seq_cst);
+			wszyscy = (x == 0 || x == e);
+		}
+		if(wszyscy) epoka.compare_exchange_strong(e, e+1, std::memory_order_seq_cst);
+		uint64_t g = epoka.load(std::memory_order_seq_cst);
+		zwolnij(s, g);
+		//smieci watkow, ktore juz sie skonczyly. Wolny slot jest na ten czas zajmowany,
+		//zeby nowy watek go nie dostal, a zajecie widzi wszystko, co zrobil poprzedni wlasciciel
+		for(int i=0; i<MAX_THREADS; i++){
+			bool wolny = false;
+			if(zajete()[i].compare_exchange_strong(wolny, true, std::memory_order_acquire)){
+				zwolnij(sloty[i], g);
+				zajete()[i].store(false, std::memory_order_release);
+			}
+		}
+	}
+
+	//zwalnia smieci slotu s odlaczone przed epoka g-1
+	static void zwolnij(Slot& s, uint64_t g){
+		size_t j = 0;
+		for(size_t i=0; i<s.smieci.size(); i++){
+			if(s.smieci[i].epoka + 2 <= g) s.smieci[i].usun(s.smieci[i].p);
+			else s.smieci[j++] = s.smieci[i];
+		}
+		s.smieci.resize(j);
+	}
+
+	////////// struktura drzewa (wezly zamkniete przez wywolujacego)
+
+	Node* child(const Node* p, const Key& k) const{
+		return (p == straznik || k < p->key) ? p->left.load(std::memory_order_acquire)
+		                                     : p->right.load(std::memory_order_acquire);
+	}
+
+	static int height(const Node* n) { return n != NULL ? n->h.load(std::memory_order_relaxed) : 0; }
+
+	static void updateHeight(Node* n){
+		int hl = height(n->left.load(std::memory_order_relaxed));
+		int hr = height(n->right.load(std::memory_order_relaxed));
+		n->h.store((hl > hr ? hl : hr) + 1, std::memory_order_relaxed);
+	}
+
+	static void replaceChild(Node* p, Node* stary, Node* nowy){
+		if(p->left.load(std::memory_order_relaxed) == stary) p->left.store(nowy, std::memory_order_release);
+		else p->right.store(nowy, std::memory_order_release);
+		if(nowy != NULL) nowy->parent.store(p, std::memory_order_release);
+	}
+
+	//rotacja w prawo: lewe dziecko c wchodzi na miejsce n (p - rodzic n)
+	static void rotateRight(Node* p, Node* n, Node* c){
+		Node* b = c->right.load(std::memory_order_relaxed);
+		n->left.store(b, std::memory_order_release);
+		if(b != NULL) b->parent.store(n, std::memory_order_release);
+		c->right.store(n, std::memory_order_release);
+		n->parent.store(c, std::memory_order_release);
+		replaceChild(p, n, c);
+		updateHeight(n);
+		updateHeight(c);
+	}
+
+	//rotacja w lewo: prawe dziecko c wchodzi na miejsce n
+	static void rotateLeft(Node* p, Node* n, Node* c){
+		Node* b = c->left.load(std::memory_order_relaxed);
+		n->right.store(b, std::memory_order_release);
+		if(b != NULL) b->parent.store(n, std::memory_order_release);
+		c->left.store(n, std::memory_order_release);
+		n->parent.store(c, std::memory_order_release);
+		replaceChild(p, n, c);
+		updateHeight(n);
+		updateHeight(c);
+	}
+
+	//idzie od n w gore: poprawia wysokosci, wywaza rotacjami i odlacza wezly trasujace
+	//z najwyzej jednym dzieckiem. Zamyka rodzica, wezel i ewentualnie dziecko i wnuka
+	void fixUp(Node* n){
+		Node* wymus = NULL;		//wezel, do ktorego trzeba dojsc, nawet jesli wysokosci po drodze sie nie zmienia
+		while(n != straznik){
+			if(n == wymus) wymus = NULL;
+			Node* p = n->parent.load(std::memory_order_acquire);
+			lock(p);
+			if(n->parent.load(std::memory_order_relaxed) != p){		//n przeniesiony w miedzyczasie
+				unlockUnchanged(p);
+				continue;
+			}
+			lock(n);
+			if(n->odlaczony.load(std::memory_order_relaxed)){
+				unlockUnchanged(n);
+				unlockUnchanged(p);
+				return;
+			}
+			Node* l = n->left.load(std::memory_order_relaxed);
+			Node* r = n->right.load(std::memory_order_relaxed);
+			if(n->val.load(std::memory_order_relaxed) == NULL && (l == NULL || r == NULL)){
+				replaceChild(p, n, l != NULL ? l : r);
+				n->odlaczony.store(true, std::memory_order_relaxed);
+				unlock(n);
+				unlock(p);
+				retire(n, usunWezel);
+				n = p;
+				continue;
+			}
+			int b = height(r) - height(l);
+			if(b >= -1 && b <= 1){
+				int stara = n->h.load(std::memory_order_relaxed);
+				updateHeight(n);
+				bool zmiana = (n->h.load(std::memory_order_relaxed) != stara);
+				unlockUnchanged(n);
+				unlockUnchanged(p);
+				if(!zmiana && wymus == NULL) return;
+				n = p;
+				continue;
+			}
+			Node* c = (b > 0) ? r : l;
+			lock(c);
+			Node* cl = c->left.load(std::memory_order_relaxed);
+			Node* cr = c->right.load(std::memory_order_relaxed);
+			Node* g = NULL;
+			if(b > 0 ? height(cl) > height(cr) : height(cr) > height(cl)){		//podwojna rotacja
+				g = (b > 0) ? cl : cr;
+				lock(g);
+				if(b > 0){
+					rotateRight(n, c, g);
+					rotateLeft(p, n, g);
+				}
+				else{
+					rotateLeft(n, c, g);
+					rotateRight(p, n, g);
+				}
+			}
+			else if(b > 0) rotateLeft(p, n, c);
+			else rotateRight(p, n, c);
+			//zepchniete w dol n (i c przy podwojnej rotacji) mogly stracic dziecko. Wezel trasujacy
+			//z jednym dzieckiem trzeba odlaczyc od razu - pozostawiony pozwolilby pozniej ubyc
+			//dwom poziomom naraz, czego jedna rotacja juz nie naprawi
+			Node* gora = (g != NULL) ? g : c;
+			Node* usuniete[3];
+			int ileUsunietych = 0;
+			if(g != NULL && odlaczTrasujacy(g, c)) usuniete[ileUsunietych++] = c;
+			if(odlaczTrasujacy(gora, n)) usuniete[ileUsunietych++] = n;
+			Node* dalej = p;
+			if(ileUsunietych > 0){
+				if(odlaczTrasujacy(p, gora)) usuniete[ileUsunietych++] = gora;
+				else{		//jeszcze raz gora, a potem w gore co najmniej do p
+					updateHeight(gora);
+					wymus = p;
+					dalej = gora;
+				}
+			}
+			if(g != NULL) unlock(g);
+			unlock(c);
+			unlock(n);
+			unlock(p);
+			for(int i=0; i<ileUsunietych; i++) retire(usuniete[i], usunWezel);
+			n = dalej;
+		}
+	}
+
+	//odlacza dziecko x zamknietego rodzica p, jesli x (tez zamkniety) jest wezlem
+	//trasujacym z najwyzej jednym dzieckiem
+	static bool odlaczTrasujacy(Node* p, Node* x){
+		Node* l = x->left.load(std::memory_order_relaxed);
+		Node* r = x->right.load(std::memory_order_relaxed);
+		if(x->val.load(std::memory_order_relaxed) != NULL || (l != NULL && r != NULL)) return false;
+		replaceChild(p, x, l != NULL ? l : r);
+		x->odlaczony.store(true, std::memory_order_relaxed);
+		return true;
+	}
+
+public:
+	ConcurrentTreeMap():straznik(new Node(0, NULL, NULL)),ile(0),epoka(1){}
+
+	/// Must not run concurrently with any other call on this map.
+	~ConcurrentTreeMap(){
+		//jak TreeMapDetail::delete_all - rotacje zamiast stosu
+		Node* n = straznik->left.load();
+		while(n != NULL){
+			Node* l = n->left.load();
+			if(l != NULL){
+				n->left.store(l->right.load());
+				l->right.store(n);
+				n = l;
+			}
+			else{
+				Node* r = n->right.load();
+				delete n->val.load();
+				delete n;
+				n = r;
+			}
+		}
+		delete straznik;
+		for(int i=0; i<MAX_THREADS; i++)
+			for(size_t j=0; j<sloty[i].smieci.size(); j++) sloty[i].smieci[j].usun(sloty[i].smieci[j].p);
+	}
+
+	/// Looks k up. If it is in the map and wynik != NULL, copies its value there.
+	/// @returns true if the map contains k.
+	bool find(const Key& k, Val* wynik = NULL) const{
+		Ochrona o(*this);
+		for(;;){		//kazdy obrot - zejscie od korzenia
+			const Node* p = straznik;
+			uint64_t pv = readLock(p);
+			for(;;){
+				const Node* c = child(p, k);
+				if(!validate(p, pv)) break;
+				if(c == NULL) return false;
+				uint64_t cv = readLock(c);
+				if(!validate(p, pv)) break;		//c nadal jest dzieckiem p
+				if(c->key == k){
+					const Val* v = c->val.load(std::memory_order_acquire);
+					if(!validate(c, cv)) break;
+					if(v == NULL) return false;
+					if(wynik != NULL) *wynik = *v;		//wartosci sie nie zmieniaja, tylko sa wymieniane
+					return true;
+				}
+				p = c;
+				pv = cv;
+			}
+		}
+	}
+
+	/// Returns the number of elements whose key matches k (1 or 0).
+	size_type count(const Key& k) const { return find(k) ? 1 : 0; }
+
+	/// Looks up the smallest key not less than k. If there is one, stores it
+	/// in klucz and, if wynik != NULL, its value in wynik.
+	/// @returns true if the map contains a key >= k.
+	bool lower_bound(Key k, Key* klucz, Val* wynik = NULL) const{
+		Ochrona o(*this);
+		for(;;){		//kazdy obrot - zejscie od korzenia
+			const Node* p = straznik;
+			uint64_t pv = readLock(p);
+			const Node* kand = NULL;		//najmniejszy klucz >= k na sciezce do k
+			const Val* kandV = NULL;
+			bool zgodne = false;			//zejscie doszlo do konca bez zmian po drodze
+			for(;;){
+				const Node* c = child(p, k);
+				if(!validate(p, pv)) break;
+				if(c == NULL){
+					zgodne = true;
+					break;
+				}
+				uint64_t cv = readLock(c);
+				if(!validate(p, pv)) break;
+				if(c->key >= k){
+					const Val* v = c->val.load(std::memory_order_acquire);
+					if(!validate(c, cv)) break;
+					kand = c;
+					kandV = v;		//wartosc nie zostanie zwolniona do konca wywolania (Ochrona)
+					if(c->key == k){
+						zgodne = true;
+						break;
+					}
+				}
+				p = c;
+				pv = cv;
+			}
+			if(!zgodne) continue;
+			if(kand == NULL) return false;
+			if(kandV == NULL){		//wezel trasujacy - szukamy dalej za jego kluczem
+				if(kand->key == INT_MAX) return false;
+				k = kand->key + 1;
+				continue;
+			}
+			*klucz = kand->key;
+			if(wynik != NULL) *wynik = *kandV;
+			return true;
+		}
+	}
+
+	/// Calls f(key, value) for the keys in [lo, hi) in ascending order. Every
+	/// key is looked up by its own lower_bound(), so a key that is in the map
+	/// for the whole scan is visited exactly once, with a value it had during
+	/// the scan; keys inserted or erased meanwhile may be visited or not.
+	/// f runs outside of the map and may call it.
+	template<class F>
+	void scan(Key lo, Key hi, F f) const{
+		Key k;
+		Val v;
+		while(lo < hi && lower_bound(lo, &k, &v) && k < hi){
+			f(k, v);
+			if(k == INT_MAX) return;
+			lo = k + 1;
+		}
+	}
+
+	/// Inserts an element into the map; an existing key gets the new value
+	/// (as in TreeMap::insert).
+	/// @returns true if the key was not in the map before.
+	bool insert(const P& entry){
+		Ochrona o(*this);
+		const Key& k = entry.first;
+		for(;;){
+			Node* p = straznik;
+			uint64_t pv = readLock(p);
+			for(;;){
+				Node* c = child(p, k);
+				if(!validate(p, pv)) break;
+				if(c == NULL){		//nowy lisc - zamykany jest tylko rodzic
+					if(!upgrade(p, pv)) break;
+					Node* n = new Node(k, new Val(entry.second), p);
+					if(p == straznik || k < p->key) p->left.store(n, std::memory_order_release);
+					else p->right.store(n, std::memory_order_release);
+					unlock(p);
+					ile.fetch_add(1, std::memory_order_relaxed);
+					fixUp(p);
+					return true;
+				}
+				uint64_t cv = readLock(c);
+				if(!validate(p, pv)) break;
+				if(c->key == k){		//klucz jest (albo byl) w drzewie - wymiana wartosci
+					if(!upgrade(c, cv)) break;
+					const Val* stara = c->val.load(std::memory_order_relaxed);
+					c->val.store(new Val(entry.second), std::memory_order_release);
+					unlock(c);
+					if(stara != NULL){
+						retire(const_cast<Val*>(stara), usunWartosc);
+						return false;
+					}
+					ile.fetch_add(1, std::memory_order_relaxed);
+					return true;
+				}
+				p = c;
+				pv = cv;
+			}
+		}
+	}
+
+	/// Removes an element from the map.
+	/// @returns The number of elements that have been removed from the map (1 or 0).
+	size_type erase(const Key& k){
+		Ochrona o(*this);
+		for(;;){
+			Node* p = straznik;
+			uint64_t pv = readLock(p);
+			for(;;){
+				Node* c = child(p, k);
+				if(!validate(p, pv)) break;
+				if(c == NULL) return 0;
+				uint64_t cv = readLock(c);
+				if(!validate(p, pv)) break;
+				if(c->key == k){
+					if(c->val.load(std::memory_order_acquire) == NULL){
+						if(!validate(c, cv)) break;
+						return 0;
+					}
+					bool dwoje = c->left.load(std::memory_order_relaxed) != NULL
+					          && c->right.load(std::memory_order_relaxed) != NULL;
+					if(dwoje){		//zostaje wezel trasujacy, zamykany jest tylko c
+						if(!upgrade(c, cv)) break;
+						const Val* stara = c->val.load(std::memory_order_relaxed);
+						c->val.store(NULL, std::memory_order_release);
+						unlock(c);
+						retire(const_cast<Val*>(stara), usunWartosc);
+					}
+					else{		//najwyzej jedno dziecko - odlaczenie, zamykani sa p i c
+						if(!upgrade(p, pv)) break;
+						if(!upgrade(c, cv)){
+							unlockUnchanged(p);
+							break;
+						}
+						const Val* stara = c->val.load(std::memory_order_relaxed);
+						c->val.store(NULL, std::memory_order_release);
+						Node* l = c->left.load(std::memory_order_relaxed);
+						replaceChild(p, c, l != NULL ? l : c->right.load(std::memory_order_relaxed));
+						c->odlaczony.store(true, std::memory_order_relaxed);
+						unlock(c);
+						unlock(p);
+						retire(const_cast<Val*>(stara), usunWartosc);
+						retire(c, usunWezel);
+						fixUp(p);
+					}
+					ile.fetch_sub(1, std::memory_order_relaxed);
+					return 1;
+				}
+				p = c;
+				pv = cv;
+			}
+		}
+	}
+
+	/// The number of elements; exact when no other thread is changing the map.
+	size_type size() const { return ile.load(std::memory_order_relaxed); }
+	bool empty() const { return size() == 0; }
+};
+
+#endif
@@ -0,0 +1,103 @@
+/**
+@file FrozenTreeMap.h
+
+FrozenTreeMap - an immutable snapshot of a TreeMap for read-only lookups
+(see TreeMap::freeze()).
+
+The keys are stored in Eytzinger (BFS) order in one contiguous int array:
+slot 1 is the root and slot i has its children in slots 2i and 2i+1. The
+values sit in a parallel array under the same slot numbers. A lookup is a
+branch-free descent, i = 2i + (key[i] < k), and the answer is recovered
+from the bits of the final i. The array is 64-byte aligned, so the 16
+slots 16i..16i+15 - all the descendants of slot i four levels down - share
+one cache line, which is prefetched while the search is still at slot i.
+
+A snapshot does not change when the TreeMap it was made from does.
+*******************************************************************************/
+
+#ifndef FROZEN_TREE_MAP_H_
+#define FROZEN_TREE_MAP_H_
+
+#include <stddef.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// A read-only map of int keys to std::string values laid out in Eytzinger order.
+class FrozenTreeMap
+{
+public:
+	typedef int Key;
+	typedef std::string Val;
+	typedef size_t size_type;
+	typedef std::pair<Key, Val> P;
+
+	enum { LINE_KEYS = 16 };		//klucze w jednej linii pamieci podrecznej
+
+protected:
+	struct alignas(64) Linia{
+		Key k[LINE_KEYS];
+	};
+
+	size_type n;
+	std::vector<Linia> linie;		//klucze w polach 1..n, pole 0 nieuzywane
+	std::vector<Val> wartosci;		//wartosci pod tymi samymi numerami pol
+
+	Key* klucze() { return linie[0].k; }
+	const Key* klucze() const { return linie[0].k; }
+
+public:
+	/// An empty snapshot.
+	FrozenTreeMap():n(0),linie(1),wartosci(1){}
+
+	/// Builds the snapshot from count pairs sorted by key, starting at first
+	/// (e.g. TreeMap::begin()).
+	template<class It>
+	FrozenTreeMap(It first, size_type count):n(count),linie(count/LINE_KEYS+1),wartosci(count+1){
+		if(n == 0) return;
+		Key* keys = klucze();
+		//pola odwiedzane w kolejnosci inorder niejawnego drzewa: zaczynamy od skrajnie lewego
+		size_t i = 1;
+		while(2*i <= n) i *= 2;
+		for(size_type j=0; j<n; j++, ++first){
+			keys[i] = first->first;
+			wartosci[i] = first->second;
+			if(2*i+1 <= n){		//nastepnik: skrajnie lewy w prawym poddrzewie
+				i = 2*i+1;
+				while(2*i <= n) i *= 2;
+			}
+			else{		//albo pierwszy przodek, do ktorego przychodzimy z lewej strony
+				while(i & 1) i >>= 1;
+				i >>= 1;
+			}
+		}
+	}
+
+	/// Returns a pointer to the value associated with k or NULL if there is none.
+	const Val* find(const Key& k) const{
+		const Key* keys = klucze();
+		size_t i = 1;
+		while(i <= n){
+			__builtin_prefetch(keys + LINE_KEYS*i);
+			i = 2*i + (keys[i] < k);
+		}
+		//i przeszlo za lisc; zdjecie koncowych jedynek i jeszcze jednego bitu daje
+		//ostatnie pole, w ktorym poszlismy w lewo, czyli pierwszy klucz >= k (0 - brak)
+		i >>= __builtin_ffsll(~static_cast<long long>(i));
+		return (i != 0 && keys[i] == k) ? &wartosci[i] : NULL;
+	}
+
+	/// Returns the number of elements whose key matches k (1 or 0).
+	size_type count(const Key& k) const { return find(k) != NULL; }
+
+	bool empty() const { return n == 0; }
+	size_type size() const { return n; }
+
+	/// Bytes taken by the key and value arrays (not counting the characters
+	/// the strings keep outside of themselves).
+	size_type memory() const{
+		return linie.capacity()*sizeof(Linia) + wartosci.capacity()*sizeof(Val);
+	}
+};
+
+#endif
@@ -0,0 +1,444 @@
+/**
+@file PersistentTreeMap.h
+
+PersistentTreeMap - a persistent (path-copying) AVL tree with the interface of
+TreeMap (int keys, std::string values).
+
+Nodes are never changed once another map can see them. An update copies the
+O(log n) nodes on the path from the root to the changed key and shares every
+other subtree with the previous version, so copying a map (a snapshot) is
+O(1): the copy just takes another reference to the root. Each node counts
+the references to it (from parent nodes and from map roots) atomically, and
+it is freed when the last version that contains it goes away.
+Only the shared part of a path is copied: the nodes from the root down to the
+first one with more than one reference belong to this map alone, so insert,
+operator[] and erase change them in place. With no snapshot outstanding an
+update allocates nothing but the inserted node, as in TreeMap.
+
+A snapshot can be handed to reader threads while the writer keeps changing
+its own map; they share only immutable nodes and the atomic counters, so
+neither side ever waits for the other. A single PersistentTreeMap object
+must still not be read and written at the same time.
+
+Nodes have no parent pointers (one node may have many parents), so the
+iterators keep the ancestors to come back to on a small stack. Only the
+ITER_STACK deepest ones are kept; when they run out and more were dropped,
+++ walks down from the root of the version again to find them. The iterators
+are forward-only and stay valid as long as the map version they came from.
+*******************************************************************************/
+
+#ifndef PERSISTENT_TREE_MAP_H_
+#define PERSISTENT_TREE_MAP_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <atomic>
+#include <iterator>
+#include <string>
+#include <utility>
+
+/// A map with a similar interface to std::map, implemented as a persistent AVL tree.
+class PersistentTreeMap
+{
+public:
+	typedef int Key;
+	typedef std::string Val;
+	typedef size_t size_type;
+	typedef std::pair<Key, Val> P;
+
+	enum { MAX_HEIGHT = 64 };		//wysokosc AVL dla 2^32 wezlow to mniej niz 47
+	enum { ITER_STACK = 8 };		//przodkow pamietanych przez iterator
+
+protected:
+	struct Node{
+		P data;
+		Node* left;
+		Node* right;
+		int h;						//wysokosc poddrzewa (lisc - 1)
+		std::atomic<int> ref;		//liczba wskaznikow na wezel (z wezlow i z korzeni map)
+		//przejmuje po jednej referencji do l i r
+		Node(const P& d, Node* l, Node* r):data(d),left(l),right(r),ref(1){ update(); }
+		void update(){
+			int hl = height(left), hr = height(right);
+			h = (hl > hr ? hl : hr) + 1;
+		}
+	};
+
+	Node* korzen;
+	size_type ile;
+
+	static int height(const Node* n) { return n != NULL ? n->h : 0; }
+
+	static Node* retain(Node* n){
+		if(n != NULL) n->ref.fetch_add(1, std::memory_order_relaxed);
+		return n;
+	}
+
+	//oddaje referencje do n i zwalnia wszystkie wezly, ktore przestaly byc uzywane.
+	//Bez stosu: martwy wezel nalezy juz tylko do nas, wiec mozna go obracac jak w
+	//TreeMapDetail::delete_all. Martwy wezel podwieszony pod martwe lewe dziecko dostaje
+	//ref = 1, zeby dalej byl traktowany jak kazde inne prawe dziecko
+	static void release(Node* n){
+		if(n == NULL || n->ref.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+		while(n != NULL){
+			if(n->left != NULL){
+				Node* l = n->left;
+				if(l->ref.fetch_sub(1, std::memory_order_acq_rel) == 1){		//l tez umiera - rotacja w prawo
+					n->left = l->right;
+					n->ref.store(1, std::memory_order_relaxed);
+					l->right = n;
+					n = l;
+				}
+				else n->left = NULL;		//l zyje w innej wersji
+			}
+			else{
+				Node* r = n->right;
+				delete n;
+				n = (r != NULL && r->ref.fetch_sub(1, std::memory_order_acq_rel) == 1) ? r : NULL;
+			}
+		}
+	}
+
+	//wezel x (wskazywany przez swiezy, niewspoldzielony wezel) do zmiany w miejscu:
+	//x, jesli nikt poza nim go nie widzi, wpp. jego kopia
+	static Node* own(Node* x){
+		if(x->ref.load(std::memory_order_acquire) == 1) return x;
+		Node* kopia = new Node(x->data, retain(x->left), retain(x->right));
+		release(x);
+		return kopia;
+	}
+
+	static Node* rotateLeft(Node* x){
+		Node* y = own(x->right);
+		x->right = y->left;
+		y->left = x;
+		x->update();
+		y->update();
+		return y;
+	}
+
+	static Node* rotateRight(Node* x){
+		Node* y = own(x->left);
+		x->left = y->right;
+		y->right = x;
+		x->update();
+		y->update();
+		return y;
+	}
+
+	//wywaza swiezy wezel n, ktorego poddrzewa sa juz drzewami AVL. Zwraca nowy korzen poddrzewa
+	static Node* balance(Node* n){
+		int b = height(n->right) - height(n->left);
+		if(b > 1){
+			if(height(n->right->left) > height(n->right->right)) n->right = rotateRight(own(n->right));
+			return rotateLeft(n);
+		}
+		if(b < -1){
+			if(height(n->left->right) > height(n->left->left)) n->left = rotateLeft(own(n->left));
+			return rotateRight(n);
+		}
+		return n;
+	}
+
+	//sciezka od korzenia: wezly i kierunki, w ktore z nich poszlismy
+	struct Sciezka{
+		Node* w[MAX_HEIGHT];
+		bool prawo[MAX_HEIGHT];
+		int d;
+		Sciezka():d(0){}
+		void push(Node* n, bool p){
+			assert(d < MAX_HEIGHT);
+			w[d] = n;
+			prawo[d++] = p;
+		}
+	};
+
+	//poprawia sciezke od dolu: nowe poddrzewo nowy zastepuje dziecko ostatniego wezla sciezki.
+	//Pierwsze wlasne wezly sciezki (ref == 1 az od korzenia - nie widzi ich zadna inna wersja)
+	//sa zmieniane w miejscu, glebsze kopiowane. zastapione - czy stare dziecko traci referencje
+	//od rodzica (bylo skopiowane albo usuniete), a nie zostalo zmienione w miejscu; na wyjsciu
+	//to samo dla starego korzenia poddrzewa. Zwraca nowy korzen
+	static Node* rebuild(Sciezka& s, Node* nowy, int wlasne, bool& zastapione){
+		while(s.d > 0){
+			--s.d;
+			Node* p = s.w[s.d];
+			if(s.d < wlasne){
+				Node*& dziecko = s.prawo[s.d] ? p->right : p->left;
+				if(zastapione) release(dziecko);
+				dziecko = nowy;
+				p->update();
+				nowy = balance(p);
+				zastapione = false;
+			}
+			else{
+				Node* kopia = s.prawo[s.d] ? new Node(p->data, retain(p->left), nowy)
+				                           : new Node(p->data, nowy, retain(p->right));
+				nowy = balance(kopia);
+				zastapione = true;
+			}
+		}
+		return nowy;
+	}
+
+	//konczy zmiane: poprawia sciezke s i ustawia nowy korzen mapy
+	void setRoot(Sciezka& s, Node* nowy, int wlasne, bool zastapione){
+		nowy = rebuild(s, nowy, wlasne, zastapione);
+		Node* stary = korzen;
+		korzen = nowy;
+		if(zastapione) release(stary);
+	}
+
+	void setRoot(Node* n){
+		Node* stary = korzen;
+		korzen = n;
+		release(stary);
+	}
+
+	//wspolna czesc insert i operator[]: zwraca wezel z kluczem, ktorego nie widzi zadna inna wersja.
+	//Jesli cala sciezka do istniejacego klucza nalezy tylko do tej mapy (ref == 1 az od korzenia),
+	//wartosc zmienia sie w miejscu; wpp. kopiowana jest wspoldzielona czesc sciezki
+	Node* store(const P& entry, bool nadpisz, bool& dodany){
+		Sciezka s;
+		Node* n = korzen;
+		bool wylaczna = true;
+		int wlasne = 0;
+		while(n != NULL){
+			wylaczna = wylaczna && n->ref.load(std::memory_order_acquire) == 1;
+			if(n->data.first == entry.first) break;
+			if(wylaczna) ++wlasne;
+			bool prawo = n->data.first < entry.first;
+			s.push(n, prawo);
+			n = prawo ? n->right : n->left;
+		}
+		dodany = (n == NULL);
+		if(!dodany && wylaczna){
+			if(nadpisz) n->data.second = entry.second;
+			return n;
+		}
+		Node* nowy;
+		if(dodany){
+			nowy = new Node(entry, NULL, NULL);
+			++ile;
+		}
+		else nowy = new Node(nadpisz ? entry : n->data, retain(n->left), retain(n->right));
+		setRoot(s, nowy, wlasne, !dodany);
+		return nowy;
+	}
+
+	const Node* findNode(const Key& k) const{
+		const Node* n = korzen;
+		while(n != NULL && n->data.first != k)
+			n = (n->data.first < k) ? n->right : n->left;
+		return n;
+	}
+
+public:
+	PersistentTreeMap():korzen(NULL),ile(0){}
+
+	/// O(1): the copy shares all the nodes with m.
+	PersistentTreeMap(const PersistentTreeMap& m):korzen(retain(m.korzen)),ile(m.ile){}
+
+	~PersistentTreeMap(){
+		release(korzen);
+	}
+
+	/// O(1) assignment; the nodes of the old contents are freed when no other version uses them.
+	PersistentTreeMap& operator=(const PersistentTreeMap& m){
+		if(&m != this){
+			Node* n = retain(m.korzen);
+			setRoot(n);
+			ile = m.ile;
+		}
+		return *this;
+	}
+
+	/// Returns an O(1) snapshot: a map that keeps the current contents
+	/// whatever happens to this one later.
+	PersistentTreeMap snapshot() const { return *this; }
+
+	/// A forward const_iterator.
+	class const_iterator : public std::iterator<std::forward_iterator_tag, P>
+	{
+		friend class PersistentTreeMap;
+	protected:
+		//przodkowie node, z ktorych zeszlismy w lewo, czyli wezly, ktore jeszcze trzeba
+		//odwiedzic. Jest ich g, ale w stos (cyklicznie, pod numerem % ITER_STACK) mieszcza
+		//sie tylko te od numeru od; plycej polozonych szuka sie od nowa od korzenia
+		const Node* korzen;
+		const Node* node;
+		const Node* stos[ITER_STACK];
+		unsigned g, od;
+
+		explicit const_iterator(const Node* k):korzen(k),node(NULL),g(0),od(0){}
+
+		void push(const Node* n){
+			stos[g++ % ITER_STACK] = n;
+			if(g - od > ITER_STACK) ++od;
+		}
+
+		void leftmost(const Node* n){
+			for(; n->left != NULL; n = n->left) push(n);
+			node = n;
+		}
+	public:
+		typedef P T;
+		const_iterator():korzen(NULL),node(NULL),g(0),od(0){}
+
+		inline const T& operator*() const { return node->data; }
+		inline const T* operator->() const { return &(node->data); }
+
+		inline bool operator==(const const_iterator& a) const { return node == a.node; }
+		inline bool operator!=(const const_iterator& a) const { return !(*this == a); }
+
+		const_iterator& operator++(){
+			if(node->right != NULL) leftmost(node->right);
+			else if(g == 0) node = NULL;
+			else{
+				if(g == od){
+					//zapamietani przodkowie sie skonczyli - zejscie od korzenia odtwarza najglebszych
+					const Node* cel = node;
+					g = od = 0;
+					for(const Node* n = korzen; n != cel; )
+						if(cel->data.first < n->data.first){
+							push(n);
+							n = n->left;
+						}
+						else n = n->right;
+				}
+				node = stos[--g % ITER_STACK];
+			}
+			return *this;
+		}
+		const_iterator operator++(int){
+			const_iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+	};
+	typedef const_iterator iterator;
+
+	/// Returns an iterator addressing the first element in the map.
+	const_iterator begin() const{
+		const_iterator it(korzen);
+		if(korzen != NULL) it.leftmost(korzen);
+		return it;
+	}
+
+	/// Returns an iterator that addresses the location succeeding the last element in a map.
+	const_iterator end() const { return const_iterator(); }
+
+	/// Returns an iterator addressing the element with key k or end().
+	const_iterator find(const Key& k) const{
+		const_iterator it(korzen);
+		const Node* n = korzen;
+		while(n != NULL && n->data.first != k){
+			if(k < n->data.first){
+				it.push(n);
+				n = n->left;
+			}
+			else n = n->right;
+		}
+		if(n == NULL) return end();
+		it.node = n;
+		return it;
+	}
+
+	/// Inserts an element into the map; an existing key gets the new value
+	/// (as in TreeMap::insert). Copies the shared part of the path to the key.
+	/// @returns A pair whose iterator component addresses the element and whose
+	///          bool component is true if the key was not in the map before.
+	std::pair<const_iterator, bool> insert(const P& entry){
+		bool dodany;
+		store(entry, true, dodany);
+		return std::make_pair(find(entry.first), dodany);
+	}
+
+	/// Inserts an element with a default value if the key is not in the map.
+	/// The returned reference is valid until the next change of this map; the
+	/// node it points to is private to this version, so snapshots never see
+	/// writes made through it.
+	Val& operator[](const Key& k){
+		bool dodany;
+		return store(P(k, Val()), false, dodany)->data.second;
+	}
+
+	/// Removes an element from the map. Copies the shared part of the path to the key.
+	/// @returns The number of elements that have been removed from the map (1 or 0).
+	size_type erase(const Key& k){
+		Sciezka s;
+		Node* n = korzen;
+		bool wylaczna = true;
+		int wlasne = 0;
+		while(n != NULL && n->data.first != k){
+			wylaczna = wylaczna && n->ref.load(std::memory_order_acquire) == 1;
+			if(wylaczna) ++wlasne;
+			bool prawo = n->data.first < k;
+			s.push(n, prawo);
+			n = prawo ? n->right : n->left;
+		}
+		if(n == NULL) return 0;
+		wylaczna = wylaczna && n->ref.load(std::memory_order_acquire) == 1;
+		Node* zastepca;
+		bool zastapione = true;
+		if(n->left == NULL || n->right == NULL)
+			zastepca = retain(n->left != NULL ? n->left : n->right);
+		else{
+			//dwoje dzieci: na miejsce n wchodzi nastepnik m, usuniety z prawego poddrzewa
+			Sciezka s2;
+			Node* m = n->right;
+			bool wylacznyM = wylaczna;
+			int wlasne2 = 0;
+			while(m->left != NULL){
+				wylacznyM = wylacznyM && m->ref.load(std::memory_order_acquire) == 1;
+				if(wylacznyM) ++wlasne2;
+				s2.push(m, false);
+				m = m->left;
+			}
+			wylacznyM = wylacznyM && m->ref.load(std::memory_order_acquire) == 1;
+			if(wylaczna){
+				//n zostaje na miejscu z para m; m zwolni rebuild albo ponizsze release
+				if(wylacznyM) std::swap(n->data, m->data);
+				else n->data = m->data;
+				bool z2 = true;
+				Node* prawe = rebuild(s2, retain(m->right), wlasne2, z2);
+				if(z2) release(n->right);
+				n->right = prawe;
+				n->update();
+				zastepca = balance(n);
+				zastapione = false;
+			}
+			else{
+				bool z2 = true;
+				Node* prawe = rebuild(s2, retain(m->right), 0, z2);
+				zastepca = balance(new Node(m->data, retain(n->left), prawe));
+			}
+		}
+		setRoot(s, zastepca, wlasne, zastapione);
+		--ile;
+		return 1;
+	}
+
+	/// Returns the number of elements whose key matches k (1 or 0).
+	size_type count(const Key& k) const { return findNode(k) != NULL; }
+
+	bool empty() const { return ile == 0; }
+	size_type size() const { return ile; }
+
+	/// Erases all the elements of this version.
+	void clear(){
+		setRoot(NULL);
+		ile = 0;
+	}
+
+	/// Returns true if both maps contain the same key-value pairs.
+	bool operator==(const PersistentTreeMap& a) const{
+		if(ile != a.ile) return false;
+		if(korzen == a.korzen) return true;		//ta sama wersja albo migawka bez zmian
+		const_iterator i = begin(), j = a.begin();
+		for(; i != end(); ++i, ++j)
+			if(*i != *j) return false;
+		return true;
+	}
+};
+
+#endif
@@ -31,19 +31,26 @@ ALL RIGHTS RESERVED
 #include <stdlib.h>
 #include <iterator>
 
+#include <atomic>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 /// A simple instance counter for detecting memory leaks.
+/// Nodes may be created and freed by several threads at once (parallel set
+/// operations), so the counter is changed atomically.
 class CCount
 {
 private:
   static int count;
-  CCount() {count++;}
+  CCount() {__atomic_add_fetch(&count, 1, __ATOMIC_RELAXED);}
   ~CCount()
   {
-     assert(count>0);
+     assert(__atomic_load_n(&count, __ATOMIC_RELAXED)>0);
      //if(count>0) 
-        count--;
+        __atomic_sub_fetch(&count, 1, __ATOMIC_RELAXED);
      //else
      //   cerr<<"ERROR (CCount): More destructors than constructors called!"<<std::endl;
   }
@@ -65,17 +72,31 @@ struct TreeNode : CCount
    TreeNode* parent;  ///< Parent node
    TreeNode* left;    ///< The left child in the tree
    TreeNode* right;   ///< The right child in the tree
+#ifdef TREEMAP_THREADED
+   TreeNode* next = NULL;   ///< In-order successor (thread); the last node links to the root sentinel
+   TreeNode* prev = NULL;   ///< In-order predecessor (thread); the first node links to the root sentinel
+#endif
    T data;            ///< User's data
    short b;            ///< balance
-   TreeNode(const T& d) : parent(NULL), left(NULL), right(NULL), data(d), b(0) {}
-   TreeNode(const T& d, TreeNode* l, TreeNode* r) : parent(NULL), left(l), right(r), data(d), b(0) {}
-   TreeNode(const T& d, TreeNode* p) : parent(p), left(NULL), right(NULL), data(d), b(0) {}
-   TreeNode(const T& d, TreeNode* p, TreeNode* l, TreeNode* r) : parent(p), left(l), right(r), data(d), b(0) {}
-   TreeNode(const T& d, short bal, TreeNode* p) : parent(p), left(NULL), right(NULL), data(d), b(bal) {} 
+   unsigned s;         ///< number of nodes in the subtree rooted here
+   TreeNode(const T& d) : parent(NULL), left(NULL), right(NULL), data(d), b(0), s(1) {}
+   TreeNode(const T& d, TreeNode* l, TreeNode* r) : parent(NULL), left(l), right(r), data(d), b(0), s(1) {}
+   TreeNode(const T& d, TreeNode* p) : parent(p), left(NULL), right(NULL), data(d), b(0), s(1) {}
+   TreeNode(const T& d, TreeNode* p, TreeNode* l, TreeNode* r) : parent(p), left(l), right(r), data(d), b(0), s(1) {}
+   TreeNode(const T& d, short bal, TreeNode* p) : parent(p), left(NULL), right(NULL), data(d), b(bal), s(1) {} 
 };
 class TreeMapDetail;
+class FrozenTreeMap;
 /// A map with a similar interface to std::map.
 /// This map should be implemented as a binary tree.
+///
+/// ++ and -- climb the parent links. Compiled with TREEMAP_THREADED (in every
+/// translation unit that uses TreeMap), the nodes are also threaded in key
+/// order (TreeNode::next/prev): begin() is O(1) and ++/-- follow one pointer,
+/// at 16 more bytes per node. Iterating scattered nodes is faster for it (30k
+/// keys: 13-24 instead of 24-38 ns per element), but when the nodes lie in key
+/// order in memory (keys inserted sorted) the bigger nodes cost more than the
+/// parent climbing saves: 15-17 instead of 12-15 ns per element.
 class TreeMap
 {
    friend class TreeMapDetail;
@@ -91,7 +112,10 @@ public:
    typedef size_t size_type;
    typedef std::pair<Key, Val> P;
 
+   enum { FOR_EACH_GRAIN = 1024 };   ///< parallel_for_each walks subtrees this small in one go
+
    TreeMap();
+   /// Big trees are copied by as many threads as the hardware has, one subtree each.
    TreeMap( const TreeMap& );
    ~TreeMap();
 
@@ -123,12 +147,30 @@ public:
          return &(node->data);
       }
 
+#ifdef TREEMAP_THREADED
+      // preincrement - one step along the successor thread
+      inline const_iterator& operator++()
+      {
+         node = node->next;
+         return *this;
+      }
+#else
       // preincrement
       /*inline*/ const_iterator& operator++();
+#endif
       // postincrement
       /*inline*/ const_iterator operator++(int);
+#ifdef TREEMAP_THREADED
+      // predecrement - one step along the predecessor thread
+      inline const_iterator& operator--()
+      {
+         node = node->prev;
+         return *this;
+      }
+#else
       // predecrement
       /*inline*/ const_iterator& operator--();
+#endif
       // postdecrement
       /*inline*/ const_iterator operator--(int);
 
@@ -235,6 +277,136 @@ public:
    /// Returns the number of elements in a map whose key matches a parameter-specified key.
    size_type count(const Key& _Key) const;
 
+   /// Returns the number of elements whose keys are less than k.
+   size_type rank(const Key& k) const;
+
+   /// Returns an iterator addressing the k-th smallest element (counting from 0)
+   /// or end() if k >= size().
+   iterator select(size_type k);
+   const_iterator select(size_type k) const;
+
+   /// Returns the number of elements whose keys lie in [lo, hi).
+   size_type count_range(const Key& lo, const Key& hi) const;
+
+   /// Returns an iterator addressing the first element whose key is not less than k
+   /// or end() if there is none.
+   iterator lower_bound(const Key& k);
+   const_iterator lower_bound(const Key& k) const;
+
+   /// Returns an iterator addressing the first element whose key is greater than k
+   /// or end() if there is none.
+   iterator upper_bound(const Key& k);
+   const_iterator upper_bound(const Key& k) const;
+
+   /// Returns the pair (lower_bound(k), upper_bound(k)).
+   std::pair<iterator, iterator> equal_range(const Key& k);
+   std::pair<const_iterator, const_iterator> equal_range(const Key& k) const;
+
+   /// Calls f(entry) for every element whose key lies in [lo, hi), in key order.
+   /// Descends once to lo and then follows successors, so it costs O(log n + k)
+   /// for k visited elements.
+   /// @returns The number of elements passed to f.
+   template<class F>
+   size_type scan(const Key& lo, const Key& hi, F f) const
+   {
+      size_type n = 0;
+      if(!(lo < hi)) return n;
+      const_iterator it = lower_bound(lo);
+      const const_iterator koniec = end();
+      while(it != koniec && it->first < hi){
+         const Node* x = it.node;
+         ++it;
+         if(it != koniec){
+            const Node* y = it.node;
+#ifdef TREEMAP_THREADED
+            __builtin_prefetch(y->next);   //nastepnik nastepnika - wskazuje go watek in-order
+#endif
+            __builtin_prefetch(y->data.second.data());
+         }
+         f(x->data);
+         ++n;
+      }
+      return n;
+   }
+
+   /// Calls f(entry) for every element, from watki threads at once (0 - as many as
+   /// the hardware has), in no particular order; f must be safe to call concurrently.
+   /// The tree is handed out by subtrees through a work-stealing pool: every thread
+   /// takes subtrees from the back of its own queue and, when that is empty, steals
+   /// the oldest (biggest) one from the front of another thread's queue. A subtree
+   /// bigger than FOR_EACH_GRAIN is split: its root is visited, its right subtree
+   /// queued and its left subtree taken next; a smaller one is walked in key
+   /// order from its smallest node.
+   template<class F>
+   void parallel_for_each(F f, unsigned watki = 0) const
+   {
+      size_type n = size();
+      if(n > FOR_EACH_GRAIN && watki == 0) watki = std::thread::hardware_concurrency();
+      if(n <= FOR_EACH_GRAIN || watki <= 1){
+         for(const_iterator it = begin(); it != end(); ++it) f(*it);
+         return;
+      }
+      struct Kolejka
+      {
+         std::mutex m;
+         std::deque<const Node*> d;
+      };
+      std::vector<Kolejka> kolejki(watki);
+      std::atomic<size_type> zostalo(n);   //elementy jeszcze nieodwiedzone
+      kolejki[0].d.push_back(root->left);
+      auto praca = [&](unsigned nr){
+         Kolejka& moja = kolejki[nr];
+         while(zostalo.load(std::memory_order_acquire) > 0){
+            const Node* t = NULL;
+            {
+               std::lock_guard<std::mutex> l(moja.m);
+               if(!moja.d.empty()){
+                  t = moja.d.back();
+                  moja.d.pop_back();
+               }
+            }
+            for(unsigned i=1; t == NULL && i<watki; i++){   //podkradanie
+               Kolejka& inna = kolejki[(nr+i) % watki];
+               std::lock_guard<std::mutex> l(inna.m);
+               if(!inna.d.empty()){
+                  t = inna.d.front();
+                  inna.d.pop_front();
+               }
+            }
+            if(t == NULL){
+               std::this_thread::yield();
+               continue;
+            }
+            size_type zrobione = 0;
+            for(; t != NULL && t->s > FOR_EACH_GRAIN; t = t->left){
+               if(t->right != NULL){
+                  std::lock_guard<std::mutex> l(moja.m);
+                  moja.d.push_back(t->right);
+               }
+               f(t->data);
+               ++zrobione;
+            }
+            if(t != NULL){   //male poddrzewo - po kolei od najmniejszego wezla
+               Node* x = const_cast<Node*>(t);
+               while(x->left != NULL) x = x->left;
+               const_iterator it(x);
+               for(unsigned i=0; i<t->s; i++, ++it) f(*it);
+               zrobione += t->s;
+            }
+            zostalo.fetch_sub(zrobione, std::memory_order_acq_rel);
+         }
+      };
+      std::vector<std::thread> pula;
+      for(unsigned i=1; i<watki; i++) pula.push_back(std::thread(praca, i));
+      praca(0);
+      for(size_t i=0; i<pula.size(); i++) pula[i].join();
+   }
+
+   /// Replaces the contents of the map with the pairs [first, last), which must be
+   /// sorted by strictly increasing keys. Builds a perfectly balanced tree in O(n),
+   /// its halves in parallel by watki threads (0 - as many as the hardware has).
+   void build_balanced(const P* first, const P* last, unsigned watki = 0);
+
    /// Removes an element from the map.
    /// @returns The iterator that designates the first element remaining beyond any elements removed.
    iterator erase(iterator i);
@@ -252,6 +424,28 @@ public:
 
    /// Erases all the elements of a map.
    void clear( );
+
+   /// Moves the elements whose keys are not less than k to right (replacing its
+   /// contents); this map keeps the smaller ones. O(log n), no element is copied.
+   void split(const Key& k, TreeMap& right);
+
+   /// Moves all the elements of right to this map; right becomes empty.
+   /// All the keys of right must be greater than the keys of this map. O(log n).
+   void join(TreeMap& right);
+
+   /// Adds the elements of other whose keys are not in this map yet; the keys
+   /// already here keep their values.
+   /// The set operations are built on split and join: the tree of this map is split
+   /// by the keys of other, so they cost O(m log(n/m + 1)) for maps of sizes n and
+   /// m <= n (plus the elements copied from other). Big trees are processed by
+   /// watki threads at once, forking on their two halves (0 - as many as the hardware has).
+   void merge_union(const TreeMap& other, unsigned watki = 0);
+
+   /// Removes the elements whose keys are not in other (see merge_union).
+   void intersection(const TreeMap& other, unsigned watki = 0);
+
+   /// Removes the elements whose keys are in other (see merge_union).
+   void difference(const TreeMap& other, unsigned watki = 0);
    
    /// Returns true if this map's internal structure is identical to another map's structure.
    bool struct_eq(const TreeMap& another) const;
@@ -259,9 +453,13 @@ public:
    bool info_eq(const TreeMap& another) const;
 
    /// Returns true if this map contains exactly the same key-value pairs as the another map. 
-   inline bool TreeMap::operator==(const TreeMap& a) const { return info_eq(a); }
+   inline bool operator==(const TreeMap& a) const { return info_eq(a); }
    
    /// Assignment operator copy the source elements into this object.
    TreeMap& operator=(const TreeMap& );
+
+   /// Returns an immutable snapshot of the map for fast read-only lookups
+   /// (see FrozenTreeMap.h). Later changes to the map do not affect it.
+   FrozenTreeMap freeze() const;
 };
 
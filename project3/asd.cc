@@ -31,6 +31,7 @@ ALL RIGHTS RESERVED
 #include <algorithm>
 #include <climits> 		//INT_MAX
 #include <iostream>
+#include <thread>
 
 
 #define PRINT(x) std::cout << #x"\n";
@@ -41,6 +42,7 @@ ALL RIGHTS RESERVED
 #else
 #include "TreeMap.h"
 #endif
+#include "FrozenTreeMap.h"
 
 /// A helper class.
 class TreeMapDetail //Helper
@@ -51,112 +53,705 @@ protected:
 	typedef std::string Val;
 	
 public:
-	//Kopiuje cale poddrzewo danego wezla
+	//Kopiuje cale poddrzewo danego wezla (razem ze wspolczynnikami wywazenia).
+	//Bez rekurencji: oryginal i kopia sa obchodzone rownolegle w gore i w dol po wskaznikach parent
 	static TreeNode* insert_all(TreeNode* current)
 	{
-		if(current == NULL) return NULL;		//puste drzewo albo trafilismy na koniec galezi
-		TreeNode* tmp = new TreeNode(current->data);
-		tmp->left = insert_all(current->left);	//wstawia lewe poddrzewo do lewego dziecka utworzonego elementu
-		if(tmp->left != NULL)	//jesli byl jakis element po lewej stronie od aktualnego
-			tmp->left->parent = tmp;
-		if(current->right != current){
-			tmp->right = insert_all(current->right);	//wstawia prawe poddrzewo do prawego dziecka wstawionego elementu
-			if(tmp->right != NULL)
-				tmp->right->parent = tmp;
+		if(current == NULL) return NULL;		//puste drzewo
+		TreeNode* kopia = new TreeNode(current->data, current->b, NULL);
+		kopia->s = current->s;
+		TreeNode* z = current;		//wezel oryginalu
+		TreeNode* k = kopia;		//jego kopia
+		for(;;){
+			if(z->left != NULL && k->left == NULL){		//lewe poddrzewo jeszcze nie skopiowane
+				k->left = new TreeNode(z->left->data, z->left->b, k);
+				k->left->s = z->left->s;
+				z = z->left;
+				k = k->left;
+			}
+			else if(z->right != NULL && z->right != z && k->right == NULL){		//prawe poddrzewo
+				k->right = new TreeNode(z->right->data, z->right->b, k);
+				k->right->s = z->right->s;
+				z = z->right;
+				k = k->right;
+			}
+			else{		//oba poddrzewa skopiowane - powrot do rodzica
+				if(z == current) return kopia;
+				z = z->parent;
+				k = k->parent;
+			}
 		}
-		return tmp;
 	}
 	
-	static TreeNode* uns_insert(TreeNode* &current, TreeNode* &procreator, const std::pair<Key, Val>& entry)
+	//Wstawia nowy lisc w drzewie o korzeniu root->left (root - straznik). Bez sprawdzania, czy klucz juz jest
+	static TreeNode* uns_insert(TreeNode* root, const std::pair<Key, Val>& entry)
 	{
-		if(current == NULL){	//wezel nie istnieje 
-			current = new TreeNode(entry);
-			current->parent = procreator;
-			return current;
+		TreeNode* rodzic = root;
+		TreeNode** miejsce = &root->left;
+		while(*miejsce != NULL){
+			rodzic = *miejsce;
+			//klucz w wezle jest mniejszy od klucza, ktory chcemy wstawic, wiec wstawiamy na prawo od niego, wpp. na lewo
+			miejsce = (rodzic->data.first < entry.first) ? &rodzic->right : &rodzic->left;
 		}
-		//klucz w wezle jest mniejszy od klucza, ktory chcemy wstawic, wiec musimy wstawic na prawo od niego
-		else if(current->data.first < entry.first) return uns_insert(current->right,current,entry);
-		//klucz w wezle jest wiekszy od klucza, ktory chcemy wstawic, wiec wstawiamy na prawo od niego
-		else return uns_insert(current->left,current,entry);
+		*miejsce = new TreeNode(entry, rodzic);
+		return *miejsce;
 	}
 	
 	static TreeNode* find_key(TreeNode* current, const Key& k)
 	{
-		if(current == NULL || current->data.first == k) return current;	//rodzic byl lisciem, czyli nie znaleziono wezla o podanym kluczu, albo dany wezel ma szukany klucz
-		if(current->data.first < k) return find_key(current->right, k);	//klucz jest wiekszy od aktualnego wezla. Trzeba szukac w prawym poddrzewie
-		if(current->data.first > k) return find_key(current->left, k);		//klucz jest mniejszy od aktualnego wezla. Trzeba szukac w lewym poddrzewie
-		return current;						//klucze sa rowne - odnaleziono wezel o takim kluczu
+		while(current != NULL && current->data.first != k)
+			current = (current->data.first < k) ? current->right : current->left;
+		return current;		//NULL - nie znaleziono wezla o podanym kluczu
 	}
 	
-	static TreeNode* find_previous(TreeNode* current)
-	{
-		if(current->left != NULL){
-			current = current->left;
-			while(current->right != NULL) current = current->right;
-			return current;
-		}
-		if(current->right == current) return current;
-		
-		TreeNode* tmp;
-		if(current->parent->right != current->parent){
-			tmp = current->parent;
-			while(tmp->left == current){
-				current = tmp;
-				tmp = tmp->parent;
-			}
-			return tmp;
+	//Z TREEMAP_THREADED watki next/prev lacza wezly w kolejnosci kluczy w liste cykliczna przez
+	//straznika (straznik->next - pierwszy, straznik->prev - ostatni), wiec ++ i -- to jeden odczyt.
+	//Rotacje nie zmieniaja kolejnosci kluczy, wiec watkow nie dotykaja. Bez TREEMAP_THREADED
+	//nastepnik i poprzednik sa szukane po wskaznikach parent, a funkcje utrzymujace watki
+	//(link, link_leaf, unlink, thread_all) nic nie robia - reszta kodu wola je w obu trybach.
+
+#ifdef TREEMAP_THREADED
+	static TreeNode* next_node(TreeNode* n) { return n->next; }
+	static TreeNode* prev_node(TreeNode* n) { return n->prev; }
+
+	//pierwszy i ostatni wezel drzewa pod straznikiem root (sam straznik, gdy drzewo jest puste)
+	static TreeNode* first(TreeNode* root) { return root->next; }
+	static TreeNode* last(TreeNode* root) { return root->prev; }
+
+	//a tuz przed z na liscie watkow
+	static void link(TreeNode* a, TreeNode* z)
+	{
+		a->next = z;
+		z->prev = a;
+	}
+
+	//Wlacza swiezo dopiety lisc n do listy watkow: lewe dziecko jest tuz przed rodzicem, prawe tuz za nim
+	static void link_leaf(TreeNode* n)
+	{
+		TreeNode* p = n->parent;
+		TreeNode* a = (p->left == n) ? p->prev : p;		//poprzednik n
+		TreeNode* z = a->next;							//nastepnik n
+		link(n, z);
+		link(a, n);
+	}
+
+	static void unlink(TreeNode* n)
+	{
+		link(n->prev, n->next);
+	}
+#else
+	//Nastepnik: najmniejszy w prawym poddrzewie albo pierwszy przodek, do ktorego przychodzimy
+	//z lewej strony. Ostatni wezel (caly poddrzewem lewym straznika) dochodzi tak do straznika
+	static TreeNode* next_node(TreeNode* n)
+	{
+		if(n->right != NULL) return find_min(n->right);
+		TreeNode* p = n->parent;
+		while(p != NULL && p->right == n){
+			n = p;
+			p = p->parent;
 		}
-		else
-			return current;
-	}
-	static TreeNode* find_next(TreeNode* current)
-	{
-		if(current->right != NULL){
-			if(current->right == current) return current;
-			current = current->right;
-			while(current->left != NULL) current = current->left;
-			return current;
-		}
-		TreeNode* tmp;
-		if(current->parent->right != current->parent){
-			tmp = current->parent;
-			while(tmp->right == current){
-				current = tmp;
-				tmp = tmp->parent;
+		return p;
+	}
+
+	//Poprzednik, symetrycznie; poprzednikiem straznika jest ostatni wezel, a pierwszego - straznik
+	static TreeNode* prev_node(TreeNode* n)
+	{
+		if(n->left != NULL) return find_max(n->left);
+		TreeNode* p = n->parent;
+		while(p != NULL && p->left == n){
+			n = p;
+			p = p->parent;
+		}
+		return (p != NULL) ? p : n;
+	}
+
+	static TreeNode* first(TreeNode* root) { return find_min(root); }
+	static TreeNode* last(TreeNode* root) { return prev_node(root); }
+
+	static void link(TreeNode*, TreeNode*) {}
+	static void link_leaf(TreeNode*) {}
+	static void unlink(TreeNode*) {}
+#endif
+
+	//Laczy watkami wezly poddrzewa t w kolejnosci inorder; obchod konczy sie na rodzicu t
+	//(straznik albo NULL). Zwraca pierwszy wezel, a ostatni przez parametr - prev pierwszego
+	//i next ostatniego zostaja bez zmian
+	static TreeNode* thread_subtree(TreeNode* t, TreeNode*& ostatni)
+	{
+#ifndef TREEMAP_THREADED
+		ostatni = find_max(t);		//bez watkow wystarcza konce
+		return find_min(t);
+#endif
+		TreeNode* granica = t->parent;
+		TreeNode* pierwszy = find_min(t);
+		TreeNode* poprzedni = NULL;
+		TreeNode* current = pierwszy;
+		while(current != granica){
+			if(poprzedni != NULL) link(poprzedni, current);
+			poprzedni = current;
+			if(current->right != NULL) current = find_min(current->right);
+			else{		//w gore, dopoki przychodzimy z prawej strony
+				TreeNode* p = current->parent;
+				while(p != granica && p->right == current){
+					current = p;
+					p = p->parent;
+				}
+				current = p;
 			}
-			return tmp;
 		}
-		else
-			return current->parent;
-	}	
-	
+		ostatni = poprzedni;
+		return pierwszy;
+	}
+
+	//Odtwarza watki calego drzewa z jego ksztaltu (po skopiowaniu)
+	static void thread_all(TreeNode* root)
+	{
+		if(root->left == NULL){
+			link(root, root);
+			return;
+		}
+		TreeNode* ostatni;
+		TreeNode* pierwszy = thread_subtree(root->left, ostatni);
+		link(root, pierwszy);
+		link(ostatni, root);
+	}
+
 	static TreeNode* find_min(TreeNode* current)
 	{
-		if(current->left != NULL) find_min(current->left);
+		while(current->left != NULL) current = current->left;
 		return current;
 	}
 	static TreeNode* find_max(TreeNode* current)
 	{
-		if(current->right != NULL) find_max(current->right);
+		while(current->right != NULL) current = current->right;
 		return current;
 	}
 
-	static void delete_all(const TreeNode* current){
-		if(current != NULL){
-			delete_all(current->left);
-			delete_all(current->right);
-			delete current;
+	//Usuwa cale poddrzewo. Bez stosu: dopoki wezel ma lewe dziecko, rotacja w prawo przenosi je
+	//na gore; wezel bez lewego dziecka mozna usunac i przejsc do prawego
+	static void delete_all(TreeNode* current){
+		while(current != NULL){
+			if(current->left != NULL){
+				TreeNode* l = current->left;
+				current->left = l->right;
+				l->right = current;
+				current = l;
+			}
+			else{
+				TreeNode* r = current->right;
+				delete current;
+				current = r;
+			}
 		}
 	}
 	
+	//Drzewo jest drzewem AVL: b = wysokosc prawego poddrzewa - wysokosc lewego, zawsze -1, 0 albo 1.
+	//Straznik (root) nie ma wspolczynnika - petle poprawiajace koncza sie na nim.
+	//Kazdy wezel pamieta tez liczbe wezlow swojego poddrzewa (s); u straznika s nie jest uzywane.
+
+	static unsigned subtree_size(const TreeNode* n)
+	{
+		return (n != NULL) ? n->s : 0;
+	}
+
+	//Dodaje d do rozmiarow wszystkich wezlow od n w gore do straznika (po wstawieniu albo usunieciu liscia)
+	static void add_size(TreeNode* root, TreeNode* n, int d)
+	{
+		for(; n != root; n = n->parent) n->s += d;
+	}
+
+	//Liczba kluczy mniejszych od k
+	static unsigned rank(const TreeNode* current, const Key& k)
+	{
+		unsigned r = 0;
+		while(current != NULL){
+			if(current->data.first < k){		//current i cale jego lewe poddrzewo sa mniejsze od k
+				r += subtree_size(current->left) + 1;
+				current = current->right;
+			}
+			else current = current->left;
+		}
+		return r;
+	}
+
+	//Pierwszy wezel o kluczu >= k (przy scisle: > k) albo straznik, jesli takiego nie ma
+	static TreeNode* lower_bound(TreeNode* root, const Key& k, bool scisle)
+	{
+		TreeNode* wyn = root;
+		TreeNode* current = root->left;
+		while(current != NULL){
+			if(scisle ? (k < current->data.first) : !(current->data.first < k)){		//current pasuje - moze jest mniejszy po lewej
+				wyn = current;
+				current = current->left;
+			}
+			else current = current->right;
+		}
+		return wyn;
+	}
+
+	//k-ty (od 0) wezel w kolejnosci kluczy albo NULL
+	static TreeNode* select(TreeNode* current, unsigned k)
+	{
+		while(current != NULL){
+			unsigned l = subtree_size(current->left);
+			if(k == l) return current;
+			if(k < l) current = current->left;
+			else{
+				k -= l + 1;
+				current = current->right;
+			}
+		}
+		return NULL;
+	}
+
+	//Wstawia wezel n w miejsce wezla x u rodzica x (straznik tez jest rodzicem - korzen drzewa to jego lewe dziecko).
+	//Rodzic NULL - x jest korzeniem odlaczonego poddrzewa (split/join), n po prostu zostaje nowym korzeniem
+	static void replace_child(TreeNode* x, TreeNode* n)
+	{
+		TreeNode* p = x->parent;
+		if(p != NULL){
+			if(p->left == x) p->left = n;
+			else p->right = n;
+		}
+		if(n != NULL) n->parent = p;
+	}
+
+	//Rotacja w lewo: prawe dziecko x staje na jego miejscu, x zostaje jego lewym dzieckiem
+	static TreeNode* rotate_left(TreeNode* x)
+	{
+		TreeNode* y = x->right;
+		replace_child(x, y);
+		x->right = y->left;
+		if(y->left != NULL) y->left->parent = x;
+		y->left = x;
+		x->parent = y;
+		y->s = x->s;
+		x->s = subtree_size(x->left) + subtree_size(x->right) + 1;
+		return y;
+	}
+
+	//Rotacja w prawo: lewe dziecko x staje na jego miejscu, x zostaje jego prawym dzieckiem
+	static TreeNode* rotate_right(TreeNode* x)
+	{
+		TreeNode* y = x->left;
+		replace_child(x, y);
+		x->left = y->right;
+		if(y->right != NULL) y->right->parent = x;
+		y->right = x;
+		x->parent = y;
+		y->s = x->s;
+		x->s = subtree_size(x->left) + subtree_size(x->right) + 1;
+		return y;
+	}
+
+	//Wywaza wezel x o wspolczynniku 2 albo -2 jedna albo dwiema rotacjami.
+	//Zwraca nowy korzen poddrzewa (na miejscu x)
+	static TreeNode* rebalance(TreeNode* x)
+	{
+		if(x->b > 0){
+			TreeNode* y = x->right;
+			if(y->b >= 0){		//prawe-prawe: jedna rotacja
+				rotate_left(x);
+				if(y->b == 0){ x->b = 1; y->b = -1; }	//tylko po usunieciu - wysokosc bez zmian
+				else{ x->b = 0; y->b = 0; }
+				return y;
+			}
+			TreeNode* z = y->left;		//prawe-lewe: dwie rotacje, z wchodzi na gore
+			rotate_right(y);
+			rotate_left(x);
+			x->b = (z->b > 0) ? -1 : 0;
+			y->b = (z->b < 0) ? 1 : 0;
+			z->b = 0;
+			return z;
+		}
+		TreeNode* y = x->left;
+		if(y->b <= 0){		//lewe-lewe
+			rotate_right(x);
+			if(y->b == 0){ x->b = -1; y->b = 1; }
+			else{ x->b = 0; y->b = 0; }
+			return y;
+		}
+		TreeNode* z = y->right;		//lewe-prawe
+		rotate_left(y);
+		rotate_right(x);
+		x->b = (z->b < 0) ? 1 : 0;
+		y->b = (z->b > 0) ? -1 : 0;
+		z->b = 0;
+		return z;
+	}
+
+	//Poprawia wspolczynniki na sciezce od nowego liscia n w gore. Najwyzej jedna (podwojna) rotacja
+	static void insert_fixup(TreeNode* root, TreeNode* n)
+	{
+		for(TreeNode* p = n->parent; p != root; n = p, p = p->parent){
+			if(p->left == n) --p->b;
+			else ++p->b;
+			if(p->b == 0) return;		//krotsze poddrzewo sie wyrownalo - wysokosc p bez zmian
+			if(p->b == 2 || p->b == -2){
+				rebalance(p);			//po rotacji poddrzewo ma wysokosc sprzed wstawienia
+				return;
+			}
+		}
+	}
+
+	//Poprawia wspolczynniki po usunieciu: poddrzewo p z lewej (zLewej) albo prawej strony
+	//stalo sie nizsze o 1. Idzie w gore, dopoki wysokosc kolejnych poddrzew maleje
+	static void erase_fixup(TreeNode* root, TreeNode* p, bool zLewej)
+	{
+		while(p != root){
+			TreeNode* rodzic = p->parent;
+			bool pZLewej = (rodzic->left == p);
+			if(zLewej) ++p->b;
+			else --p->b;
+			if(p->b == 1 || p->b == -1) return;		//bylo 0 - wysokosc p bez zmian
+			if(p->b == 2 || p->b == -2){
+				TreeNode* brat = (p->b > 0) ? p->right : p->left;
+				bool bezZmiany = (brat->b == 0);
+				rebalance(p);
+				if(bezZmiany) return;		//pojedyncza rotacja przy wywazonym bracie nie zmienia wysokosci
+			}
+			zLewej = pZLewej;
+			p = rodzic;
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////////
+	//split i join na odlaczonych poddrzewach (parent korzenia == NULL) i zbudowane na nich
+	//operacje na zbiorach. Wysokosci nie sa pamietane w wezlach: wysokosc korzenia liczy
+	//height, a dalej wynika ona z b wezlow na drodze w dol.
+
+	enum { PARALLEL_MIN = 1<<14 };		//mniejsze drzewa przetwarza jeden watek
+
+	//Odlaczone poddrzewo z wysokoscia i koncami swojej listy watkow. Watki wewnatrz kawalka sa
+	//poprawne; prev pierwszego i next ostatniego wezla moga wskazywac gdziekolwiek - ustawia je join
+	struct Kawalek
+	{
+		TreeNode* w;
+		int h;
+		TreeNode* pierwszy;
+		TreeNode* ostatni;
+		Kawalek():w(NULL),h(0),pierwszy(NULL),ostatni(NULL){}
+	};
+
+	//Wysokosc drzewa AVL: zejscie zawsze do wyzszego dziecka
+	static int height(const TreeNode* n)
+	{
+		int h = 0;
+		for(; n != NULL; n = (n->b < 0) ? n->left : n->right) ++h;
+		return h;
+	}
+
+	//Ustawia wezlowi k dzieci l i r, wspolczynnik b i rozmiar
+	static void set_children(TreeNode* k, TreeNode* l, TreeNode* r, int b)
+	{
+		k->left = l;
+		k->right = r;
+		if(l != NULL) l->parent = k;
+		if(r != NULL) r->parent = k;
+		k->b = b;
+		k->s = subtree_size(l) + subtree_size(r) + 1;
+	}
+
+	//Poddrzewo n uroslo o 1 (join wstawil je w miejsce nizszego). Jak insert_fixup, ale rotacja
+	//nad dzieckiem o b == 0 nie przywraca dawnej wysokosci, wiec wtedy trzeba isc dalej.
+	//Zwraca true, jesli uroslo cale drzewo
+	static bool grow_fixup(TreeNode* n)
+	{
+		for(TreeNode* p = n->parent; p != NULL; n = p, p = p->parent){
+			if(p->left == n) --p->b;
+			else ++p->b;
+			if(p->b == 0) return false;
+			if(p->b == 2 || p->b == -2){
+				p = rebalance(p);
+				if(p->b == 0) return false;
+			}
+		}
+		return true;
+	}
+
+	//Laczy drzewa l i r (wysokosci hl i hr, klucze l < k < klucze r) z wezlem k w jedno drzewo AVL.
+	//Zwraca jego korzen, a wysokosc w h. Koszt O(|hl - hr| + 1)
+	static TreeNode* join_tree(TreeNode* l, int hl, TreeNode* k, TreeNode* r, int hr, int& h)
+	{
+		if(hl <= hr+1 && hr <= hl+1){		//wysokosci prawie rowne - k zostaje korzeniem
+			set_children(k, l, r, hr-hl);
+			k->parent = NULL;
+			h = ((hl > hr) ? hl : hr) + 1;
+			return k;
+		}
+		bool wLewym = (hl > hr);		//k schodzi po prawym brzegu wyzszego l albo po lewym brzegu r
+		TreeNode* gora = wLewym ? l : r;
+		int hc = wLewym ? hl : hr;
+		int hn = wLewym ? hr : hl;
+		TreeNode* p = NULL;
+		TreeNode* c = gora;
+		while(hc > hn+1){		//do pierwszego wezla o wysokosci hn albo hn+1
+			p = c;
+			if(wLewym){
+				hc -= (c->b < 0) ? 2 : 1;
+				c = c->right;
+			}
+			else{
+				hc -= (c->b > 0) ? 2 : 1;
+				c = c->left;
+			}
+		}
+		if(wLewym){
+			set_children(k, c, r, hr-hc);
+			p->right = k;
+		}
+		else{
+			set_children(k, l, c, hc-hl);
+			p->left = k;
+		}
+		k->parent = p;
+		add_size(NULL, p, k->s - subtree_size(c));
+		h = (wLewym ? hl : hr) + (grow_fixup(k) ? 1 : 0);
+		while(gora->parent != NULL) gora = gora->parent;		//rotacja mogla zepchnac dawny korzen
+		return gora;
+	}
+
+	//Dzieli poddrzewo t o wysokosci ht na klucze < k (l) i klucze > k (r). Zwraca wezel z kluczem k
+	//(NULL - brak). Ustawia l.ostatni i r.pierwszy - watki miedzy wezlami sie nie zmieniaja, wiec
+	//to wystarcza. Rekurencja ma glebokosc drzewa, a suma kosztow laczenia to O(ht)
+	static TreeNode* split_tree(TreeNode* t, int ht, const Key& k, Kawalek& l, Kawalek& r)
+	{
+		if(t == NULL){
+			l.w = r.w = l.ostatni = r.pierwszy = NULL;
+			l.h = r.h = 0;
+			return NULL;
+		}
+		TreeNode* tl = t->left;
+		TreeNode* tr = t->right;
+		int htl = (t->b > 0) ? ht-2 : ht-1;
+		int htr = (t->b < 0) ? ht-2 : ht-1;
+		if(tl != NULL) tl->parent = NULL;
+		if(tr != NULL) tr->parent = NULL;
+		if(t->data.first == k){		//sasiedzi t na liscie to konce jego poddrzew
+			l.w = tl;
+			l.h = htl;
+			l.ostatni = (tl != NULL) ? prev_node(t) : NULL;
+			r.w = tr;
+			r.h = htr;
+			r.pierwszy = (tr != NULL) ? next_node(t) : NULL;
+			return t;
+		}
+		TreeNode* m;
+		if(k < t->data.first){
+			m = split_tree(tl, htl, k, l, r);
+			if(r.w == NULL) r.pierwszy = t;
+			r.w = join_tree(r.w, r.h, t, tr, htr, r.h);
+		}
+		else{
+			m = split_tree(tr, htr, k, l, r);
+			if(l.w == NULL) l.ostatni = t;
+			l.w = join_tree(tl, htl, t, l.w, l.h, l.h);
+		}
+		return m;
+	}
+
+	//split kawalka t
+	static TreeNode* split(const Kawalek& t, const Key& k, Kawalek& l, Kawalek& r)
+	{
+		TreeNode* m = split_tree(t.w, t.h, k, l, r);
+		l.pierwszy = (l.w != NULL) ? t.pierwszy : NULL;
+		r.ostatni = (r.w != NULL) ? t.ostatni : NULL;
+		return m;
+	}
+
+	//Laczy listy l, k, r (drzewo t jest juz z nich zlozone) i ustawia konce t
+	static void link_threads(Kawalek& t, const Kawalek& l, TreeNode* k, const Kawalek& r)
+	{
+		if(l.w != NULL){
+			link(l.ostatni, k);
+			t.pierwszy = l.pierwszy;
+		}
+		else t.pierwszy = k;
+		if(r.w != NULL){
+			link(k, r.pierwszy);
+			t.ostatni = r.ostatni;
+		}
+		else t.ostatni = k;
+	}
+
+	//join kawalkow: l, k, r w tej kolejnosci tworza jedno drzewo i jedna liste
+	static Kawalek join(const Kawalek& l, TreeNode* k, const Kawalek& r)
+	{
+		Kawalek t;
+		t.w = join_tree(l.w, l.h, k, r.w, r.h, t.h);
+		link_threads(t, l, k, r);
+		return t;
+	}
+
+	//join bez wezla posrodku: jest nim ostatni wezel l, wyciety z l
+	static Kawalek join2(const Kawalek& l, const Kawalek& r)
+	{
+		if(l.w == NULL) return r;
+		if(r.w == NULL) return l;
+		Kawalek reszta, puste;
+		TreeNode* m = split(l, l.ostatni->data.first, reszta, puste);
+		return join(reszta, m, r);
+	}
+
+	//Odlacza drzewo od straznika
+	static Kawalek take_all(TreeNode* root)
+	{
+		Kawalek t;
+		t.w = root->left;
+		if(t.w == NULL) return t;
+		t.pierwszy = first(root);
+		t.ostatni = last(root);
+		t.w->parent = NULL;
+		t.h = height(t.w);
+		root->left = NULL;
+		link(root, root);
+		return t;
+	}
+
+	//Podwiesza kawalek pod pustego straznika i zamyka liste
+	static void set_all(TreeNode* root, const Kawalek& t)
+	{
+		root->left = t.w;
+		if(t.w == NULL){
+			link(root, root);
+			return;
+		}
+		t.w->parent = root;
+		link(root, t.pierwszy);
+		link(t.ostatni, root);
+	}
+
+	//Kopia poddrzewa n jako kawalek
+	static Kawalek copy(TreeNode* n)
+	{
+		Kawalek t;
+		t.w = insert_all(n);
+		if(t.w == NULL) return t;
+		t.h = height(t.w);
+		t.pierwszy = thread_subtree(t.w, t.ostatni);
+		return t;
+	}
+
+	static unsigned threads(unsigned watki)
+	{
+		if(watki == 0) watki = std::thread::hardware_concurrency();
+		return (watki == 0) ? 1 : watki;
+	}
+
+	//Kopia poddrzewa n z tym samym ksztaltem; duze poddrzewa kopiuja rownolegle watki
+	//(0 - tyle, ile ma sprzet), lewe dziecko w nowym watku
+	static Kawalek copy_tree(TreeNode* n, unsigned watki)
+	{
+		if(n == NULL) return Kawalek();
+		if(n->s < PARALLEL_MIN || (watki = threads(watki)) <= 1) return copy(n);
+		TreeNode* k = new TreeNode(n->data, n->b, NULL);
+		Kawalek l, r;
+		std::thread lewy([&]{ l = copy_tree(n->left, watki/2); });
+		r = copy_tree(n->right, watki - watki/2);
+		lewy.join();
+		Kawalek t;
+		set_children(k, l.w, r.w, n->b);
+		t.w = k;
+		t.h = ((l.h > r.h) ? l.h : r.h) + 1;
+		link_threads(t, l, k, r);
+		return t;
+	}
+
+	//Idealnie wywazone drzewo z n posortowanych par od a: srodkowa w korzeniu, polowy
+	//rekurencyjnie (rozmiary roznia sie najwyzej o 1, wiec i wysokosci). Duze polowy rownolegle
+	static Kawalek build(const std::pair<Key, Val>* a, size_t n, unsigned watki)
+	{
+		if(n == 0) return Kawalek();
+		size_t s = n/2;
+		TreeNode* k = new TreeNode(a[s]);
+		Kawalek l, r;
+		if(watki > 1 && n >= PARALLEL_MIN){
+			std::thread lewy([&]{ l = build(a, s, watki/2); });
+			r = build(a+s+1, n-s-1, watki - watki/2);
+			lewy.join();
+		}
+		else{
+			l = build(a, s, 1);
+			r = build(a+s+1, n-s-1, 1);
+		}
+		Kawalek t;
+		set_children(k, l.w, r.w, r.h - l.h);
+		t.w = k;
+		t.h = ((l.h > r.h) ? l.h : r.h) + 1;
+		link_threads(t, l, k, r);
+		return t;
+	}
+
+	//Dzialania na zbiorach: kawalek a (wezly tej mapy) dzielony kluczem korzenia b (poddrzewa drugiej
+	//mapy, tylko czytanego), polowy rekurencyjnie z poddrzewami b i z powrotem join. Dla duzych
+	//drzew lewa polowa idzie do nowego watku; watki dziela sie wtedy miedzy polowy
+	enum Dzialanie { SUMA, ILOCZYN, ROZNICA };
+
+	static Kawalek combine(Dzialanie d, const Kawalek& a, TreeNode* b, unsigned watki)
+	{
+		if(b == NULL){
+			if(d != ILOCZYN) return a;
+			delete_all(a.w);
+			return Kawalek();
+		}
+		if(a.w == NULL) return (d == SUMA) ? copy(b) : a;
+		bool rownolegle = watki > 1 && a.w->s + b->s >= PARALLEL_MIN;
+		Kawalek l1, r1, l, r;
+		TreeNode* m = split(a, b->data.first, l1, r1);
+		if(rownolegle){
+			std::thread lewy([&]{ l = combine(d, l1, b->left, watki/2); });
+			r = combine(d, r1, b->right, watki - watki/2);
+			lewy.join();
+		}
+		else{
+			l = combine(d, l1, b->left, 1);
+			r = combine(d, r1, b->right, 1);
+		}
+		if(d == SUMA && m == NULL) m = new TreeNode(b->data);
+		if(d == ROZNICA && m != NULL){
+			delete m;
+			m = NULL;
+		}
+		return (m != NULL) ? join(l, m, r) : join2(l, r);
+	}
+
+	//Porownuje dwa poddrzewa (ksztalt i dane). Obchodzi je rownolegle w kolejnosci preorder po wskaznikach parent
 	static bool check_struct(TreeNode* first, TreeNode* second)
 	{
-		if(first==NULL && second==NULL) return true;
-		if(first==NULL || second==NULL) return false;
-		if(first->right==first && second->right==second) return true;
-		if(first->right==first || second->right==second) return false;
-		if( (first->data==second->data) && check_struct(first->left,second->left) && check_struct(first->right,second->right) ) return true;
-		return false;
+		if(first==NULL || second==NULL) return first == second;
+		TreeNode* x = first;
+		TreeNode* y = second;
+		for(;;){
+			bool xPrawe = (x->right != NULL && x->right != x);
+			bool yPrawe = (y->right != NULL && y->right != y);
+			if((x->right==x) != (y->right==y)) return false;
+			if(x->right != x && !(x->data == y->data)) return false;
+			if(x->right != x && x->s != y->s) return false;		//rozmiary poddrzew tez
+			if((x->left==NULL) != (y->left==NULL) || xPrawe != yPrawe) return false;
+			if(x->left != NULL){
+				x = x->left;
+				y = y->left;
+				continue;
+			}
+			if(xPrawe){
+				x = x->right;
+				y = y->right;
+				continue;
+			}
+			//lisc - w gore do pierwszego przodka, ktorego prawe poddrzewo jeszcze nie bylo odwiedzone
+			for(;;){
+				if(x == first) return true;
+				TreeNode* px = x->parent;
+				TreeNode* py = y->parent;
+				if(x == px->left && px->right != NULL && px->right != px){
+					x = px->right;
+					y = py->right;
+					break;
+				}
+				x = px;
+				y = py;
+			}
+		}
 	}
 };
 
@@ -170,14 +765,14 @@ public:
 TreeMap::TreeMap()
 {
 	root = new TreeNode(std::make_pair(INT_MAX,""));
+	TreeMapDetail::link(root, root);
 };
 
 /// Content of existing TreeMap object is copied into the new object. 
 TreeMap::TreeMap( const TreeMap& m )
 {
 	root = new TreeNode(std::make_pair(INT_MAX,""));
-	root->left = TreeMapDetail::insert_all(m.root->left);
-	if(root->left != NULL) root->left->parent = root;
+	TreeMapDetail::set_all(root, TreeMapDetail::copy_tree(m.root->left, 0));
 };
 
 
@@ -202,9 +797,12 @@ std::pair<TreeMap::iterator, bool> TreeMap::insert(const std::pair<Key, Val>& en
 	while(tmp != NULL){
 		if(tmp->data.first<entry.first){
 			if(tmp->right == NULL){	//nie ma prawego dziecka, wiec wstawiamy
-				tmp->right = new TreeNode(entry);
-				tmp->right->parent = tmp;
-				return std::make_pair(iterator(tmp->right), true);
+				TreeNode* nowy = new TreeNode(entry, tmp);
+				tmp->right = nowy;
+				TreeMapDetail::link_leaf(nowy);
+				TreeMapDetail::add_size(root, tmp, 1);
+				TreeMapDetail::insert_fixup(root, nowy);
+				return std::make_pair(iterator(nowy), true);
 			}
 			else{//ten weze ma prawe dziecko
 				tmp = tmp->right;	//przechodzimy do prawego dziecka
@@ -213,9 +811,12 @@ std::pair<TreeMap::iterator, bool> TreeMap::insert(const std::pair<Key, Val>& en
 		}
 		if(tmp->data.first>entry.first){
 			if(tmp->left == NULL){	//nie ma lewego dziecka, wiec wstawiamy
-				tmp->left = new TreeNode(entry);
-				tmp->left->parent = tmp;
-				return std::make_pair(iterator(tmp->left), true);
+				TreeNode* nowy = new TreeNode(entry, tmp);
+				tmp->left = nowy;
+				TreeMapDetail::link_leaf(nowy);
+				TreeMapDetail::add_size(root, tmp, 1);
+				TreeMapDetail::insert_fixup(root, nowy);
+				return std::make_pair(iterator(nowy), true);
 			}
 			else{//ten wezel ma lewe dziecko
 				tmp = tmp->left;	//przechodzimy do lewego dziecka
@@ -230,7 +831,8 @@ std::pair<TreeMap::iterator, bool> TreeMap::insert(const std::pair<Key, Val>& en
 	//oznacza to, ze nie ma zadnych elementow w drzewie, czyli wstawiamy pierwszy
 	root->left = new TreeNode(entry);
 	root->left->parent = root;
-	return std::make_pair(iterator(tmp),true);
+	TreeMapDetail::link_leaf(root->left);
+	return std::make_pair(iterator(root->left),true);
 }
 
 
@@ -239,7 +841,10 @@ std::pair<TreeMap::iterator, bool> TreeMap::insert(const std::pair<Key, Val>& en
 // such a key in the map.
 TreeMap::iterator TreeMap::unsafe_insert(const std::pair<Key, Val>& entry)
 {
-	TreeNode* tmp = TreeMapDetail::uns_insert(root->left, root, entry);
+	TreeNode* tmp = TreeMapDetail::uns_insert(root, entry);
+	TreeMapDetail::link_leaf(tmp);
+	TreeMapDetail::add_size(root, tmp->parent, 1);
+	TreeMapDetail::insert_fixup(root, tmp);
 	return iterator(tmp);
 }
 
@@ -285,10 +890,7 @@ bool TreeMap::empty( ) const
 // Returns the number of elements in the map.
 TreeMap::size_type TreeMap::size( ) const
 {
-	size_type licznik = 0;
-	iterator skoczek = begin();
-	for(;skoczek!=end();skoczek++) licznik++;
-	return licznik;
+	return TreeMapDetail::subtree_size(root->left);
 }
 
 // Returns the number of elements in a map whose key matches a parameter-specified key.
@@ -299,6 +901,65 @@ TreeMap::size_type TreeMap::count(const Key& _Key) const
 	return 1;
 }
 
+// Returns the number of elements whose keys are less than k.
+TreeMap::size_type TreeMap::rank(const Key& k) const
+{
+	return TreeMapDetail::rank(root->left, k);
+}
+
+// Returns an iterator addressing the k-th smallest element (counting from 0) or end().
+TreeMap::iterator TreeMap::select(size_type k)
+{
+	if(k >= size()) return end();
+	return iterator(TreeMapDetail::select(root->left, static_cast<unsigned>(k)));
+}
+
+TreeMap::const_iterator TreeMap::select(size_type k) const
+{
+	if(k >= size()) return end();
+	return const_iterator(TreeMapDetail::select(root->left, static_cast<unsigned>(k)));
+}
+
+// Returns the number of elements whose keys lie in [lo, hi).
+TreeMap::size_type TreeMap::count_range(const Key& lo, const Key& hi) const
+{
+	if(!(lo < hi)) return 0;
+	return TreeMapDetail::rank(root->left, hi) - TreeMapDetail::rank(root->left, lo);
+}
+
+// Returns an iterator addressing the first element whose key is not less than k or end().
+TreeMap::iterator TreeMap::lower_bound(const Key& k)
+{
+	return iterator(TreeMapDetail::lower_bound(root, k, false));
+}
+
+TreeMap::const_iterator TreeMap::lower_bound(const Key& k) const
+{
+	return const_iterator(TreeMapDetail::lower_bound(root, k, false));
+}
+
+// Returns an iterator addressing the first element whose key is greater than k or end().
+TreeMap::iterator TreeMap::upper_bound(const Key& k)
+{
+	return iterator(TreeMapDetail::lower_bound(root, k, true));
+}
+
+TreeMap::const_iterator TreeMap::upper_bound(const Key& k) const
+{
+	return const_iterator(TreeMapDetail::lower_bound(root, k, true));
+}
+
+// Returns the pair (lower_bound(k), upper_bound(k)).
+std::pair<TreeMap::iterator, TreeMap::iterator> TreeMap::equal_range(const Key& k)
+{
+	return std::make_pair(lower_bound(k), upper_bound(k));
+}
+
+std::pair<TreeMap::const_iterator, TreeMap::const_iterator> TreeMap::equal_range(const Key& k) const
+{
+	return std::make_pair(lower_bound(k), upper_bound(k));
+}
+
 
 
 // Removes an element from the map.
@@ -309,80 +970,47 @@ TreeMap::iterator TreeMap::erase(TreeMap::iterator i)
 	TreeNode* drugi;
 	pierwszy=i.node;
 	++i;
-	//brak dzieci w usuwanym
-	if(pierwszy->left==NULL&&pierwszy->right==NULL)
-	{
-		if(pierwszy->parent==root)
-			root->left=NULL;
-		else if(pierwszy->parent->left==pierwszy)
-			pierwszy->parent->left=NULL;
-		else
-			pierwszy->parent->right=NULL;
-		delete pierwszy;
-		return i;
-	}
-	//dwoje dzieci
+	TreeMapDetail::unlink(pierwszy);
+	//dwoje dzieci: na miejsce usuwanego wchodzi jego poprzednik (najwiekszy w lewym poddrzewie)
 	if(pierwszy->left!=NULL&&pierwszy->right!=NULL)
 	{
 		drugi=pierwszy->left;
 		while(drugi->right!=NULL)
 			drugi=drugi->right;
+		TreeNode* p;		//najnizszy wezel, ktorego poddrzewo sie skrocilo
+		bool zLewej;
 		if(drugi==pierwszy->left)
 		{
-			if(pierwszy->parent->left==pierwszy)
-				pierwszy->parent->left=drugi;
-			else
-				pierwszy->parent->right=drugi;
-			drugi->parent=pierwszy->parent;
-			drugi->right=pierwszy->right;
-			drugi->right->parent=drugi;
-			delete pierwszy;
+			p=drugi;
+			zLewej=true;
 		}
 		else
 		{
-			drugi->right=pierwszy->right;
-			pierwszy->right->parent=drugi;
-			drugi->parent->right=drugi->left;
+			p=drugi->parent;
+			zLewej=false;
+			p->right=drugi->left;
 			if(drugi->left!=NULL)
-				drugi->left->parent=drugi->parent;
+				drugi->left->parent=p;
 			drugi->left=pierwszy->left;
 			pierwszy->left->parent=drugi;
-			drugi->parent=pierwszy->parent;
-			if(pierwszy->parent->left==pierwszy)
-				pierwszy->parent->left=drugi;
-			else
-				pierwszy->parent->right=drugi;		
-			delete pierwszy;
 		}
-		return i;
-	}
-	//jedno dziecko
-	else
-	{
-		if(pierwszy->left!=NULL)
-			if(pierwszy->parent->left==pierwszy)
-			{
-				pierwszy->parent->left=pierwszy->left;
-				pierwszy->left->parent=pierwszy->parent;
-			}
-			else
-			{
-				pierwszy->parent->right=pierwszy->left;
-				pierwszy->left->parent=pierwszy->parent;
-			}
-		else
-			if(pierwszy->parent->left==pierwszy)
-			{
-				pierwszy->parent->left=pierwszy->right;
-				pierwszy->right->parent=pierwszy->parent;
-			}
-			else
-			{
-				pierwszy->parent->right=pierwszy->right;
-				pierwszy->right->parent=pierwszy->parent;
-			}
+		TreeMapDetail::replace_child(pierwszy,drugi);
+		drugi->right=pierwszy->right;
+		drugi->right->parent=drugi;
+		drugi->b=pierwszy->b;
+		drugi->s=pierwszy->s;
+		TreeMapDetail::add_size(root,p,-1);		//p lezy w poddrzewie drugi albo jest nim samym
 		delete pierwszy;
+		TreeMapDetail::erase_fixup(root,p,zLewej);
+		return i;
 	}
+	//najwyzej jedno dziecko - wchodzi ono na miejsce usuwanego
+	TreeNode* p=pierwszy->parent;
+	bool zLewej=(p->left==pierwszy);
+	TreeMapDetail::replace_child(pierwszy,pierwszy->left!=NULL ? pierwszy->left : pierwszy->right);
+	TreeMapDetail::add_size(root,p,-1);
+	delete pierwszy;
+	TreeMapDetail::erase_fixup(root,p,zLewej);
 	return i;
 }
 	
@@ -414,6 +1042,63 @@ void TreeMap::clear( )
 {
 	TreeMapDetail::delete_all(root->left);
 	root->left = NULL;
+	TreeMapDetail::link(root, root);
+}
+
+// Replaces the contents with the sorted pairs [first, last) in a perfectly balanced tree.
+void TreeMap::build_balanced(const P* first, const P* last, unsigned watki)
+{
+	clear();
+	size_t n = last - first;
+	TreeMapDetail::set_all(root, TreeMapDetail::build(first, n, (n >= TreeMapDetail::PARALLEL_MIN) ? TreeMapDetail::threads(watki) : 1));
+}
+
+// Moves the elements whose keys are not less than k to right.
+void TreeMap::split(const Key& k, TreeMap& right)
+{
+	if(&right == this) return;
+	right.clear();
+	TreeMapDetail::Kawalek l, r;
+	TreeNode* m = TreeMapDetail::split(TreeMapDetail::take_all(root), k, l, r);
+	if(m != NULL) r = TreeMapDetail::join(TreeMapDetail::Kawalek(), m, r);
+	TreeMapDetail::set_all(root, l);
+	TreeMapDetail::set_all(right.root, r);
+}
+
+// Moves all the elements of right (with greater keys) to this map.
+void TreeMap::join(TreeMap& right)
+{
+	if(&right == this || right.empty()) return;
+	assert(empty() || TreeMapDetail::last(root)->data.first < TreeMapDetail::first(right.root)->data.first);
+	TreeMapDetail::Kawalek l = TreeMapDetail::take_all(root);
+	TreeMapDetail::set_all(root, TreeMapDetail::join2(l, TreeMapDetail::take_all(right.root)));
+}
+
+// Adds the elements of other whose keys are not in this map yet.
+void TreeMap::merge_union(const TreeMap& other, unsigned watki)
+{
+	if(&other == this) return;
+	TreeMapDetail::Kawalek a = TreeMapDetail::take_all(root);
+	TreeMapDetail::set_all(root, TreeMapDetail::combine(TreeMapDetail::SUMA, a, other.root->left, TreeMapDetail::threads(watki)));
+}
+
+// Removes the elements whose keys are not in other.
+void TreeMap::intersection(const TreeMap& other, unsigned watki)
+{
+	if(&other == this) return;
+	TreeMapDetail::Kawalek a = TreeMapDetail::take_all(root);
+	TreeMapDetail::set_all(root, TreeMapDetail::combine(TreeMapDetail::ILOCZYN, a, other.root->left, TreeMapDetail::threads(watki)));
+}
+
+// Removes the elements whose keys are in other.
+void TreeMap::difference(const TreeMap& other, unsigned watki)
+{
+	if(&other == this){
+		clear();
+		return;
+	}
+	TreeMapDetail::Kawalek a = TreeMapDetail::take_all(root);
+	TreeMapDetail::set_all(root, TreeMapDetail::combine(TreeMapDetail::ROZNICA, a, other.root->left, TreeMapDetail::threads(watki)));
 }
 
 bool TreeMap::struct_eq(const TreeMap& another) const
@@ -434,34 +1119,36 @@ bool TreeMap::info_eq(const TreeMap& another) const
 	return false;
 }
 
+#ifndef TREEMAP_THREADED
 // preincrement
-TreeMap::const_iterator& TreeMap::const_iterator::operator ++()
+TreeMap::const_iterator& TreeMap::const_iterator::operator++()
 {
-	node = TreeMapDetail::find_next(node);
+	node = TreeMapDetail::next_node(node);
 	return *this;
 }
 
-// postincrement
-TreeMap::const_iterator TreeMap::const_iterator::operator++(int)
-{
-	TreeNode* tmp = node;
-	node = TreeMapDetail::find_next(node);
-	return const_iterator(tmp);
-}
-
 // predecrement
 TreeMap::const_iterator& TreeMap::const_iterator::operator--()
 {
-	node = TreeMapDetail::find_previous(node);
+	node = TreeMapDetail::prev_node(node);
 	return *this;
 }
+#endif
+
+// postincrement
+TreeMap::const_iterator TreeMap::const_iterator::operator++(int)
+{
+	const_iterator tmp = *this;
+	++*this;
+	return tmp;
+}
 
 // postdecrement
 TreeMap::const_iterator TreeMap::const_iterator::operator--(int)
 {
-	TreeNode* tmp = node;
-	node = TreeMapDetail::find_previous(node);
-	return const_iterator(tmp);
+	const_iterator tmp = *this;
+	--*this;
+	return tmp;
 }
 
 
@@ -470,27 +1157,26 @@ TreeMap& TreeMap::operator=(const TreeMap& other)
 {
 	if(&other != this){
 		this->clear();
-		root->left = TreeMapDetail::insert_all(other.root->left);
-		root->left->parent = root;
+		TreeMapDetail::set_all(root, TreeMapDetail::copy_tree(other.root->left, 0));
 	}
 	return *this;
 }
       
+/// Returns an immutable snapshot of the map for fast read-only lookups.
+FrozenTreeMap TreeMap::freeze() const
+{
+	return FrozenTreeMap(begin(), size());
+}
+
 /// Returns an iterator addressing the first element in the map
 TreeMap::iterator TreeMap::begin()
 {
-	TreeNode* skoczek = root;
-	while(skoczek->left != NULL)
-		skoczek = skoczek->left;
-	return iterator(skoczek);
+	return iterator(TreeMapDetail::first(root));
 }
 
 TreeMap::const_iterator TreeMap::begin() const
 {
-	TreeNode* skoczek = root;
-	while(skoczek->left != NULL)
-		skoczek = skoczek->left;
-	return const_iterator(skoczek);
+	return const_iterator(TreeMapDetail::first(root));
 }
 
 /// Returns an iterator that addresses the location succeeding the last element in a map
@@ -516,6 +1202,530 @@ void print(const std::pair<int, std::string>& p)
 }
 
 #include <map>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+#include "PersistentTreeMap.h"
+#include "BPTreeMap.h"
+
+typedef std::map<int, std::string> RefMap;
+
+/// TreeMap with access to its nodes, used by the tests to check the invariants of the tree.
+class TestTreeMap : public TreeMap
+{
+public:
+   /// Checks the order of the keys, the parent links, the AVL balance factors,
+   /// the subtree sizes and iteration both ways (along the next/prev threads with
+   /// TREEMAP_THREADED), and that the map holds exactly the pairs of ref.
+   bool check(const RefMap& ref) const
+   {
+      bool ok = true;
+      height(root->left, root, -(1L << 40), 1L << 40, ok);
+      const_iterator n = begin();
+      for(RefMap::const_iterator it = ref.begin(); ok && it != ref.end(); ++it, ++n)
+         if(n == end() || n->first != it->first || n->second != it->second) ok = false;
+      if(!ok || n != end()) return false;
+      for(RefMap::const_reverse_iterator it = ref.rbegin(); ok && it != ref.rend(); ++it)
+         if(--n == end() || n->first != it->first) ok = false;
+      if(!ok || n != begin() || --n != end()) return false;
+      return size() == ref.size() && (root->left == NULL ? 0 : root->left->s) == ref.size();
+   }
+
+   /// The key at the root of the tree; the map must not be empty.
+   Key rootKey() const { return root->left->data.first; }
+
+   /// Compares rank, select and count_range (and the subtree sizes behind them,
+   /// through check_struct on a copy) with the keys of ref.
+   bool checkOrder(const RefMap& ref) const
+   {
+      std::vector<Key> keys;
+      for(RefMap::const_iterator it = ref.begin(); it != ref.end(); ++it) keys.push_back(it->first);
+      TestTreeMap copy;
+      copy = *this;
+      if(!copy.struct_eq(*this)) return false;
+      for(size_type i=0; i<keys.size(); i++){
+         const_iterator s = select(i);
+         if(s == end() || s->first != keys[i] || rank(keys[i]) != i) return false;
+         if(rank(keys[i] + 1) != i + 1) return false;
+      }
+      if(select(keys.size()) != end() || rank(1 << 30) != keys.size() || rank(-(1 << 30)) != 0) return false;
+      for(int j=0; j<50; j++){
+         int lo = rand() % 6000 - 500, hi = rand() % 6000 - 500;
+         size_type expected = lo < hi ? std::lower_bound(keys.begin(), keys.end(), hi) - std::lower_bound(keys.begin(), keys.end(), lo) : 0;
+         if(count_range(lo, hi) != expected || count_range(lo, lo) != 0) return false;
+      }
+      return true;
+   }
+
+private:
+   static int height(const Node* n, const Node* parent, long lo, long hi, bool& ok)
+   {
+      if(n == NULL) return 0;
+      if(n->parent != parent || n->data.first <= lo || n->data.first >= hi) ok = false;
+      int l = height(n->left, n, lo, n->data.first, ok);
+      int r = height(n->right, n, n->data.first, hi, ok);
+      if(n->b != r - l || n->b < -1 || n->b > 1) ok = false;
+      if(n->s != 1 + (n->left ? n->left->s : 0) + (n->right ? n->right->s : 0)) ok = false;
+      return 1 + (l > r ? l : r);
+   }
+};
+
+/// Inserts n random keys from [0, range) into m and ref (a repeated key gets the new value).
+void fill(TestTreeMap& m, RefMap& ref, int n, int range, const char* tag)
+{
+   for(int i=0; i<n; i++){
+      std::ostringstream v;
+      v << tag << i;
+      int k = rand() % range;
+      m.insert(std::make_pair(k, v.str()));
+      ref[k] = v.str();
+   }
+}
+
+/// Splits a copy of m (holding ref) at k, checks both halves and joins them back.
+bool testSplitAt(const TestTreeMap& m, const RefMap& ref, int k)
+{
+   TestTreeMap left, right;
+   left = m;
+   right.insert(std::make_pair(-1, std::string("replaced")));
+   left.split(k, right);
+   RefMap refLeft(ref.begin(), ref.lower_bound(k)), refRight(ref.lower_bound(k), ref.end());
+   if(!left.check(refLeft) || !right.check(refRight)) return false;
+   left.join(right);
+   return left.check(ref) && right.check(RefMap());
+}
+
+/// Random inserts and erases, sorted inserts and erasing nodes with two children,
+/// compared with std::map, with the AVL invariants checked along the way.
+bool testBalance()
+{
+   srand(3);
+   TestTreeMap m;
+   RefMap ref;
+   for(int i=0; i<20000; i++){
+      int k = rand() % 2000;
+      std::ostringstream v;
+      v << i;
+      switch(rand() % 4){
+      case 0:
+         m.insert(std::make_pair(k, v.str()));
+         ref[k] = v.str();
+         break;
+      case 1:
+         m[k] = v.str();
+         ref[k] = v.str();
+         break;
+      case 2:
+         if(m.erase(k) != ref.erase(k)) return false;
+         break;
+      default:{
+         TreeMap::iterator it = m.find(k);
+         if(it != m.end()){
+            m.erase(it);
+            ref.erase(k);
+         }
+      }
+      }
+      if(i % 97 == 0 && !m.check(ref)) return false;
+   }
+   if(!m.check(ref)) return false;
+
+   // ascending and descending keys; the root of an AVL tree of 3 or more nodes has two children
+   TestTreeMap up, down;
+   RefMap refUp;
+   for(int k=0; k<4096; k++){
+      up.insert(std::make_pair(k, std::string("u")));
+      down.insert(std::make_pair(4095 - k, std::string("u")));
+      refUp[k] = "u";
+   }
+   if(!up.check(refUp) || !down.check(refUp)) return false;
+   while(up.size() > 2){
+      int k = up.rootKey();
+      up.erase(k);
+      refUp.erase(k);
+      if(!up.check(refUp)) return false;
+   }
+   return true;
+}
+
+/// rank, select and count_range after random inserts and erases (with the
+/// rotations they cause), after sorted inserts and on an empty map.
+bool testOrderStatistics()
+{
+   srand(11);
+   TestTreeMap m;
+   RefMap ref;
+   if(!m.checkOrder(ref)) return false;
+   for(int i=0; i<6000; i++){
+      int k = rand() % 5000;
+      if(rand() % 3 == 0){
+         m.erase(k);
+         ref.erase(k);
+      }
+      else{
+         m.insert(std::make_pair(k, std::string("o")));
+         ref[k] = "o";
+      }
+      if(i % 500 == 0 && (!m.check(ref) || !m.checkOrder(ref))) return false;
+   }
+   TestTreeMap sorted;
+   RefMap refSorted;
+   for(int k=0; k<3000; k++){
+      sorted.insert(std::make_pair(k, std::string("s")));
+      refSorted[k] = "s";
+   }
+   for(int k=0; k<3000; k+=3){
+      sorted.erase(k);
+      refSorted.erase(k);
+   }
+   return m.check(ref) && m.checkOrder(ref) && sorted.check(refSorted) && sorted.checkOrder(refSorted);
+}
+
+/// lower_bound, upper_bound, equal_range and scan compared with std::map for keys
+/// present, absent, below the minimum and above the maximum.
+bool testBounds()
+{
+   srand(13);
+   TestTreeMap m, empty;
+   RefMap ref;
+   fill(m, ref, 2000, 10000, "b");
+   const TestTreeMap& cm = m;
+   for(int k = ref.begin()->first - 3; k <= ref.rbegin()->first + 3; k++){
+      RefMap::const_iterator lb = ref.lower_bound(k), ub = ref.upper_bound(k);
+      TreeMap::iterator l = m.lower_bound(k), u = m.upper_bound(k);
+      TreeMap::const_iterator cl = cm.lower_bound(k), cu = cm.upper_bound(k);
+      if((l == m.end()) != (lb == ref.end()) || (u == m.end()) != (ub == ref.end())) return false;
+      if(l != m.end() && l->first != lb->first) return false;
+      if(u != m.end() && u->first != ub->first) return false;
+      if(!(cl == l) || !(cu == u)) return false;
+      std::pair<TreeMap::iterator, TreeMap::iterator> r = m.equal_range(k);
+      if(!(r.first == l) || !(r.second == u)) return false;
+   }
+   if(!(empty.lower_bound(0) == empty.end()) || !(empty.upper_bound(0) == empty.end())) return false;
+
+   // scan ranges inside, across both ends (up to the sentinel) and empty ones
+   const int ranges[][2] = { {-100, 20000}, {-100, 5}, {5000, 20000}, {3000, 3500}, {4000, 4000}, {600, 500},
+                             {ref.rbegin()->first, ref.rbegin()->first + 1}, {ref.rbegin()->first + 1, 30000} };
+   for(int i=0; i<8; i++){
+      int lo = ranges[i][0], hi = ranges[i][1];
+      RefMap seen, expected;
+      if(lo < hi) expected.insert(ref.lower_bound(lo), ref.lower_bound(hi));
+      size_t n = m.scan(lo, hi, [&](const TreeMap::P& p){ seen.insert(p); });
+      if(seen != expected || n != expected.size()) return false;
+   }
+   return empty.scan(-10, 10, [](const TreeMap::P&){}) == 0;
+}
+
+/// Every key from lo to hi is looked up in the snapshot f and in the map m it was
+/// made from; both must agree on presence and value.
+bool sameFinds(const FrozenTreeMap& f, const TreeMap& m, int lo, int hi)
+{
+   if(f.size() != m.size() || f.empty() != m.empty()) return false;
+   for(long long k = lo; k <= hi; k++){
+      TreeMap::const_iterator it = m.find(static_cast<int>(k));
+      const std::string* v = f.find(static_cast<int>(k));
+      if((v != NULL) != (it != m.end()) || f.count(static_cast<int>(k)) != (v != NULL)) return false;
+      if(v != NULL && *v != it->second) return false;
+   }
+   return true;
+}
+
+/// freeze() compared with TreeMap::find for sizes 0, 1, around and between the
+/// full trees of 16*(2^k-1) keys, for keys present, in the gaps, below the minimum
+/// and above the maximum; the snapshot does not follow later changes of the map.
+bool testFreeze()
+{
+   const int sizes[] = { 0, 1, 2, 3, 15, 16, 17, 31, 47, 48, 49, 100, 111, 112, 113, 239, 240, 241, 495, 496, 497, 1000, 4079, 4080, 4081 };
+   for(size_t s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++){
+      int n = sizes[s];
+      TreeMap m;
+      for(int i=0; i<n; i++){
+         std::ostringstream v;
+         v << "f" << i;
+         m.insert(std::make_pair(3*i - n, v.str()));      // every third key, from -n
+      }
+      FrozenTreeMap f = m.freeze();
+      if(!sameFinds(f, m, -n - 5, 2*n + 5)) return false;
+      if(n == 0) continue;
+      FrozenTreeMap copy(f);
+      m.erase(-n);
+      m[-n - 1] = "nowy";
+      if(f.find(-n) == NULL || f.find(-n - 1) != NULL || *copy.find(-n) != "f0") return false;
+   }
+   TreeMap edges;
+   edges[INT_MIN] = "min";
+   edges[INT_MAX] = "max";
+   edges[0] = "zero";
+   FrozenTreeMap f = edges.freeze();
+   if(!sameFinds(f, edges, INT_MIN, INT_MIN + 2) || !sameFinds(f, edges, -2, 2) || !sameFinds(f, edges, INT_MAX - 2, INT_MAX)) return false;
+   return FrozenTreeMap().find(0) == NULL && FrozenTreeMap().size() == 0;
+}
+
+/// split, join and the set operations, compared with std::map.
+bool testSetOperations()
+{
+   srand(5);
+   TestTreeMap m, empty;
+   RefMap ref;
+   fill(m, ref, 1000, 5000, "a");
+   int missing = 0;
+   while(ref.count(missing)) ++missing;
+   if(!testSplitAt(m, ref, ref.begin()->first) || !testSplitAt(m, ref, ref.rbegin()->first)
+      || !testSplitAt(m, ref, missing) || !testSplitAt(m, ref, ref.rbegin()->first + 1)
+      || !testSplitAt(empty, RefMap(), 0))
+      return false;
+
+   // a single node joined with 100000 nodes and the other way round
+   TestTreeMap small, big;
+   RefMap refSmall, refBig;
+   for(int k=1; k<=100000; k++){
+      big.insert(std::make_pair(k, std::string("b")));
+      refBig[k] = "b";
+   }
+   small.insert(std::make_pair(0, std::string("s")));
+   refSmall[0] = "s";
+   TestTreeMap big2(big);
+   small.join(big2);
+   refSmall.insert(refBig.begin(), refBig.end());
+   if(!small.check(refSmall) || !big2.check(RefMap())) return false;
+   TestTreeMap last;
+   last.insert(std::make_pair(200000, std::string("l")));
+   big.join(last);
+   refBig[200000] = "l";
+   if(!big.check(refBig) || !last.check(RefMap())) return false;
+   big.join(empty);
+   empty.join(big);
+   if(!big.check(RefMap()) || !empty.check(refBig)) return false;
+
+   // union, intersection and difference of maps of various sizes and overlaps
+   const int sizes[][3] = { {3000, 3000, 100000}, {5000, 50, 20000}, {50, 5000, 20000}, {2000, 2000, 2500}, {0, 100, 100} };
+   for(int s=0; s<5; s++)
+      for(int op=0; op<3; op++){
+         TestTreeMap a, b;
+         RefMap refA, refB, expected;
+         fill(a, refA, sizes[s][0], sizes[s][2], "a");
+         fill(b, refB, sizes[s][1], sizes[s][2], "b");
+         if(op == 0){
+            a.merge_union(b);
+            expected = refA;
+            expected.insert(refB.begin(), refB.end());
+         }
+         else if(op == 1){
+            a.intersection(b);
+            for(RefMap::iterator i = refA.begin(); i != refA.end(); ++i)
+               if(refB.count(i->first)) expected.insert(*i);
+         }
+         else{
+            a.difference(b);
+            for(RefMap::iterator i = refA.begin(); i != refA.end(); ++i)
+               if(!refB.count(i->first)) expected.insert(*i);
+         }
+         if(!a.check(expected) || !b.check(refB)) return false;
+      }
+   return true;
+}
+
+/// PersistentTreeMap with access to its nodes, used by the tests to check the invariants of the tree.
+class TestPersistentTreeMap : public PersistentTreeMap
+{
+public:
+   TestPersistentTreeMap() {}
+   TestPersistentTreeMap(const PersistentTreeMap& m):PersistentTreeMap(m) {}
+
+   /// Checks the order of the keys, the heights, the AVL balance and the
+   /// reference counts, and that the map (also iterated from find()) holds
+   /// exactly the pairs of ref.
+   bool check(const RefMap& ref) const
+   {
+      bool ok = true;
+      size_type n = 0;
+      height(korzen, -(1L << 40), 1L << 40, n, ok);
+      if(!ok || n != ref.size() || size() != ref.size()) return false;
+      const_iterator it = begin();
+      for(RefMap::const_iterator r = ref.begin(); r != ref.end(); ++r, ++it)
+         if(it == end() || it->first != r->first || it->second != r->second) return false;
+      if(it != end()) return false;
+      if(!ref.empty()){
+         RefMap::const_iterator r = ref.begin();
+         std::advance(r, ref.size() / 3);
+         for(it = find(r->first); r != ref.end(); ++r, ++it)
+            if(it == end() || it->first != r->first || it->second != r->second) return false;
+         if(it != end()) return false;
+      }
+      return true;
+   }
+
+private:
+   static int height(const Node* n, long lo, long hi, size_type& ile, bool& ok)
+   {
+      if(n == NULL) return 0;
+      ++ile;
+      if(n->data.first <= lo || n->data.first >= hi || n->ref.load() < 1) ok = false;
+      int l = height(n->left, lo, n->data.first, ile, ok);
+      int r = height(n->right, n->data.first, hi, ile, ok);
+      if(n->h != 1 + (l > r ? l : r) || l - r > 1 || r - l > 1) ok = false;
+      return 1 + (l > r ? l : r);
+   }
+};
+
+/// BPTreeMap with access to its nodes, used by the tests to check the invariants of the tree.
+class TestBPTreeMap : public BPTreeMap
+{
+public:
+   /// Checks the fill of every node (at least half full, except the root), the
+   /// order of the keys and the separators, the INT_MAX padding of the key arrays,
+   /// the leaf list in both directions, and that the map holds exactly the pairs of ref.
+   bool check(const RefMap& ref) const
+   {
+      if(korzen == NULL)
+         return wysokosc == 0 && ile == 0 && pierwszy == NULL && ostatni == NULL && ref.empty();
+      const Leaf* poprzedni = NULL;
+      size_type n = 0;
+      bool ok = true;
+      node(korzen, wysokosc, true, static_cast<long>(INT_MIN) - 1, static_cast<long>(INT_MAX) + 1, poprzedni, n, ok);
+      if(!ok || ostatni != poprzedni || ostatni->next != NULL || n != ile || ile != ref.size()) return false;
+      const_iterator it = begin();
+      for(RefMap::const_iterator r = ref.begin(); r != ref.end(); ++r, ++it)
+         if(it == end() || it->first != r->first || it->second != r->second) return false;
+      if(it != end()) return false;
+      for(RefMap::const_reverse_iterator r = ref.rbegin(); r != ref.rend(); ++r)
+         if((--it)->first != r->first) return false;
+      return it == begin();
+   }
+
+private:
+   //wezel wysokosci d z kluczami z przedzialu [lo, hi)
+   void node(const void* w, int d, bool korzen, long lo, long hi, const Leaf*& poprzedni, size_type& n, bool& ok) const
+   {
+      if(d == 0){
+         const Leaf* l = static_cast<const Leaf*>(w);
+         if(l->n < (korzen ? 1 : LEAF_SIZE/2) || l->n > LEAF_SIZE) ok = false;
+         for(int j=0; j<LEAF_SIZE; j++){
+            if(j >= l->n){
+               if(l->keys[j] != INT_MAX) ok = false;
+               continue;
+            }
+            if(l->keys[j] != l->data[j].first || l->keys[j] < lo || l->keys[j] >= hi) ok = false;
+            if(j > 0 && l->keys[j-1] >= l->keys[j]) ok = false;
+         }
+         if(l->prev != poprzedni || (poprzedni != NULL ? poprzedni->next != l : pierwszy != l)) ok = false;
+         poprzedni = l;
+         n += l->n;
+         return;
+      }
+      const Inner* in = static_cast<const Inner*>(w);
+      if(in->n < (korzen ? 1 : INNER_KEYS/2) || in->n > INNER_KEYS){
+         ok = false;
+         return;
+      }
+      for(int j=in->n; j<=INNER_KEYS; j++)
+         if(in->keys[j] != INT_MAX) ok = false;
+      for(int j=0; j<=in->n; j++){
+         long od = j == 0 ? lo : in->keys[j-1];
+         long dol = j == in->n ? hi : in->keys[j];
+         if(od >= dol) ok = false;
+         node(in->child[j], d-1, false, od, dol, poprzedni, n, ok);
+      }
+   }
+};
+
+/// 1.2M random inserts, operator[] writes and erases on a BPTreeMap, in phases that
+/// grow the tree to several levels and shrink it back to an empty map, so every leaf
+/// and inner node split, borrow and merge runs; compared with std::map throughout.
+bool testBPTree()
+{
+   srand(17);
+   TestBPTreeMap m;
+   RefMap ref;
+   const int zakres = 60000;
+   for(int faza=0; faza<6; faza++){
+      int wstawiane = faza % 2 == 0 ? 80 : 20;      // procent insert: na przemian rosnie i maleje
+      for(int i=0; i<200000; i++){
+         int k = (rand() * 7919LL + rand()) % zakres;
+         if(faza == 2 && i % 1000 == 0) k = i % 2000 ? INT_MIN : INT_MAX;
+         int r = rand() % 100;
+         std::ostringstream v;
+         v << i;
+         if(r < wstawiane / 2){
+            bool nowy = ref.count(k) == 0;
+            ref[k] = v.str();
+            if(m.insert(std::make_pair(k, v.str())).second != nowy) return false;
+         }
+         else if(r < wstawiane){
+            m[k] = v.str();
+            ref[k] = v.str();
+         }
+         else if(m.erase(k) != ref.erase(k)) return false;
+         if(i % 20000 == 0 && !m.check(ref)) return false;
+      }
+      if(!m.check(ref)) return false;
+      TestBPTreeMap kopia(m);
+      if(!kopia.struct_eq(m) || !kopia.check(ref)) return false;
+   }
+   while(!ref.empty()){
+      int k = ref.begin()->first;
+      if(m.erase(k) != 1) return false;
+      ref.erase(k);
+      if(ref.size() % 997 == 0 && !m.check(ref)) return false;
+   }
+   return m.check(ref) && m.empty();
+}
+
+/// Random inserts, writes through operator[] and erases on a PersistentTreeMap,
+/// with snapshots taken and dropped along the way; every version must keep
+/// exactly the contents it had when it was taken.
+bool testPersistent()
+{
+   srand(7);
+   TestPersistentTreeMap m;
+   RefMap ref;
+   std::vector<PersistentTreeMap> snapshots;
+   std::vector<RefMap> refSnapshots;
+   for(int i=0; i<30000; i++){
+      int k = rand() % 3000;
+      std::ostringstream v;
+      v << i;
+      switch(rand() % 3){
+      case 0:
+         m.insert(std::make_pair(k, v.str()));
+         ref[k] = v.str();
+         break;
+      case 1:
+         m[k] = v.str();
+         ref[k] = v.str();
+         break;
+      default:
+         if(m.erase(k) != ref.erase(k)) return false;
+      }
+      if(i % 1000 == 999){
+         snapshots.push_back(m.snapshot());
+         refSnapshots.push_back(ref);
+      }
+      if(i % 2500 == 2499){
+         // the oldest snapshot goes away while newer versions still share its nodes
+         snapshots.erase(snapshots.begin());
+         refSnapshots.erase(refSnapshots.begin());
+         if(!m.check(ref)) return false;
+      }
+   }
+   for(size_t s=0; s<snapshots.size(); s++)
+      if(!TestPersistentTreeMap(snapshots[s]).check(refSnapshots[s])) return false;
+
+   // sorted keys make a tree deeper than the stack of the iterator
+   TestPersistentTreeMap deep;
+   RefMap refDeep;
+   for(int k=0; k<100000; k++){
+      deep.insert(std::make_pair(k, std::string("d")));
+      refDeep[k] = "d";
+   }
+   TestPersistentTreeMap half(deep);
+   RefMap refHalf = refDeep;
+   for(int k=0; k<100000; k+=2){
+      half.erase(k);
+      refHalf.erase(k);
+   }
+   return m.check(ref) && deep.check(refDeep) && half.check(refHalf);
+}
 
 /// The big mean test function ;)
 void test()
@@ -535,6 +1745,14 @@ void test()
    m[4] = "Magdalena";
 
    for_each(m.begin(), m.end(), print );
+
+   std::cout << "AVL po insert/erase: " << (testBalance() ? "OK" : "BLAD") << std::endl;
+   std::cout << "rank, select, count_range: " << (testOrderStatistics() ? "OK" : "BLAD") << std::endl;
+   std::cout << "lower_bound, upper_bound, equal_range, scan: " << (testBounds() ? "OK" : "BLAD") << std::endl;
+   std::cout << "split, join, merge_union, intersection, difference: " << (testSetOperations() ? "OK" : "BLAD") << std::endl;
+   std::cout << "freeze: " << (testFreeze() ? "OK" : "BLAD") << std::endl;
+   std::cout << "BPTreeMap: " << (testBPTree() ? "OK" : "BLAD") << std::endl;
+   std::cout << "PersistentTreeMap z migawkami: " << (testPersistent() ? "OK" : "BLAD") << std::endl;
    //system("PAUSE");
 }
 
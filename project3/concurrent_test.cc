@@ -0,0 +1,330 @@
+//
+// concurrent_test - test obciazeniowy ConcurrentTreeMap: kilka watkow naraz wstawia, usuwa
+// i wyszukuje, a potem sprawdzana jest struktura drzewa i jego zawartosc.
+//
+// uzycie: concurrent_test [operacji na watek] [watki]
+//
+// 1. Jeden watek, porownanie z std::map po kazdej operacji i drzewo AVL co kilkaset operacji,
+//    a co kilka tysiecy operacji scan i lower_bound na kilku przedzialach.
+// 2. Kazdy watek ma swoje klucze (k % watki == nr), przemieszane w drzewie z kluczami innych
+//    watkow, i swoja std::map jako wzorzec. Wynik kazdej operacji musi zgadzac sie z wzorcem,
+//    a na koniec zawartosc mapy z suma wzorcow.
+// 3. Wszystkie watki na tych samych kluczach: jeden tylko czyta i sprawdza, czy widziana
+//    wartosc jest jedna z wstawionych; na koniec liczba kluczy ma sie zgadzac z size().
+//    Drugi czytelnik w kolko przeglada scan klucze rosnaco i musi widziec wszystkie klucze
+//    wstawione przed startem watkow, ktorych nikt nie zmienia.
+// 4. MAX_THREADS - 1 watkow (jeden slot ma watek glowny) trzyma sloty, nastepny watek ma
+//    dostac std::length_error, a po ich zakonczeniu nowy watek ma znowu dzialac.
+// Po fazach 2 i 3 (gdy zaden watek juz nic nie zmienia) drzewo musi byc dokladnym drzewem AVL,
+// a smieci zakonczonych watkow maja zostac zwolnione przez nastepne operacje watku glownego.
+// Test jest przeznaczony takze do uruchamiania z -fsanitize=thread (cel concurrent_test_tsan).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <atomic>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ConcurrentTreeMap.h"
+
+using namespace std;
+
+/// Dostep do wezlow drzewa na potrzeby sprawdzenia struktury.
+class Sprawdzana : public ConcurrentTreeMap
+{
+public:
+	/// Sprawdza porzadek kluczy, wskazniki na rodzicow, wysokosci i wywazenie AVL,
+	/// liczbe kluczy (wezly trasujace sie nie licza) i czy zaden wezel nie jest zamkniety
+	/// albo odlaczony. Wolac tylko, gdy zaden watek nie zmienia mapy.
+	bool poprawna() const{
+		size_t klucze = 0;
+		bool ok = true;
+		wysokosc(straznik->left.load(), straznik, -(static_cast<long>(1) << 40), static_cast<long>(1) << 40, klucze, ok);
+		if(klucze != size()){
+			printf("  size() %zu, kluczy w drzewie %zu\n", size(), klucze);
+			ok = false;
+		}
+		return ok;
+	}
+
+	/// Liczba elementow czekajacych na zwolnienie w slotach innych watkow niz biezacy.
+	size_t smieciInnych() const{
+		size_t wynik = 0;
+		for(int i=0; i<MAX_THREADS; i++)
+			if(i != slotWatku()) wynik += sloty[i].smieci.size();
+		return wynik;
+	}
+
+	/// Zawartosc drzewa w kolejnosci kluczy.
+	void zawartosc(map<int, string>& wynik) const{
+		wynik.clear();
+		dopisz(straznik->left.load(), wynik);
+	}
+
+private:
+	int wysokosc(const Node* n, const Node* rodzic, long od, long dop, size_t& klucze, bool& ok) const{
+		if(n == NULL) return 0;
+		if(n->parent.load() != rodzic || n->key <= od || n->key >= dop || (n->wersja.load() & 1) || n->odlaczony.load()){
+			printf("  zly wezel %d\n", n->key);
+			ok = false;
+		}
+		if(n->val.load() != NULL) ++klucze;
+		int l = wysokosc(n->left.load(), n, od, n->key, klucze, ok);
+		int r = wysokosc(n->right.load(), n, n->key, dop, klucze, ok);
+		int h = (l > r ? l : r) + 1;
+		if(l - r > 1 || r - l > 1 || n->h.load() != h){
+			printf("  wezel %d: lewe %d, prawe %d, zapisana wysokosc %d\n", n->key, l, r, n->h.load());
+			ok = false;
+		}
+		return h;
+	}
+
+	static void dopisz(const Node* n, map<int, string>& wynik){
+		for(; n != NULL; n = n->right.load()){
+			dopisz(n->left.load(), wynik);
+			if(n->val.load() != NULL) wynik[n->key] = *n->val.load();
+		}
+	}
+};
+
+/// Generator liczb losowych watku (LCG - jeden na watek, bez wspoldzielonego stanu).
+struct Losowe
+{
+	unsigned x;
+	Losowe(unsigned ziarno):x(ziarno){}
+	unsigned operator()(){
+		x = x*1103515245u + 12345u;
+		return x >> 8;
+	}
+};
+
+/// Jedna operacja na mapie i wzorcu. false - wynik mapy inny niz wzorca.
+static bool krok(ConcurrentTreeMap& m, map<int, string>& wzorzec, int k, unsigned rodzaj, int i)
+{
+	string v = to_string(i);
+	switch(rodzaj % 4){
+	case 0:{
+		bool nowy = (wzorzec.count(k) == 0);
+		wzorzec[k] = v;
+		return m.insert(make_pair(k, v)) == nowy;
+	}
+	case 1:
+		return m.erase(k) == wzorzec.erase(k);
+	default:{
+		string w;
+		bool jest = m.find(k, &w);
+		map<int, string>::const_iterator it = wzorzec.find(k);
+		return jest == (it != wzorzec.end()) && (!jest || w == it->second);
+	}
+	}
+}
+
+/// Czy po zakonczeniu watkow ich smieci zwalniaja operacje watku glownego.
+static bool sprzatniete(Sprawdzana& m)
+{
+	//kazde usuniecie liscia oddaje wezel i wartosc, co RETIRE_BATCH - przejscie sprzatajace
+	for(int i=0; i<4*ConcurrentTreeMap::RETIRE_BATCH; i++){
+		m.insert(make_pair(-1, string("s")));
+		m.erase(-1);
+	}
+	if(m.smieciInnych() != 0){
+		printf("  %zu niezwolnionych smieci zakonczonych watkow\n", m.smieciInnych());
+		return false;
+	}
+	return true;
+}
+
+/// Czy scan(lo, hi) i lower_bound(lo) zgadzaja sie ze wzorcem.
+static bool przedzial(const ConcurrentTreeMap& m, const map<int, string>& wzorzec, int lo, int hi)
+{
+	map<int, string> widziane;
+	bool rosnace = true;
+	int ostatni = 0;
+	m.scan(lo, hi, [&](int k, const string& v){
+		if(!widziane.empty() && k <= ostatni) rosnace = false;
+		ostatni = k;
+		widziane[k] = v;
+	});
+	map<int, string> oczekiwane(wzorzec.lower_bound(lo), lo < hi ? wzorzec.lower_bound(hi) : wzorzec.lower_bound(lo));
+	int k = 0;
+	string v;
+	bool jest = m.lower_bound(lo, &k, &v);
+	map<int, string>::const_iterator it = wzorzec.lower_bound(lo);
+	bool lbOk = jest == (it != wzorzec.end()) && (!jest || (k == it->first && v == it->second));
+	if(!rosnace || widziane != oczekiwane || !lbOk){
+		printf("  scan/lower_bound [%d, %d): inny wynik niz std::map\n", lo, hi);
+		return false;
+	}
+	return true;
+}
+
+static bool faza1(int n)
+{
+	Sprawdzana m;
+	map<int, string> wzorzec;
+	Losowe los(3);
+	for(int i=0; i<n; i++){
+		int k = static_cast<int>(los() % 2000);
+		if(!krok(m, wzorzec, k, los(), i)){
+			printf("  operacja %d, klucz %d: inny wynik niz std::map\n", i, k);
+			return false;
+		}
+		if(i % 499 == 0 && !m.poprawna()) return false;
+		if(i % 4999 == 0){
+			int lo = static_cast<int>(los() % 2200) - 100;
+			if(!przedzial(m, wzorzec, lo, lo + static_cast<int>(los() % 300))
+			   || !przedzial(m, wzorzec, lo, lo - 5) || !przedzial(m, wzorzec, INT_MIN, INT_MAX))
+				return false;
+		}
+	}
+	//rosnace klucze, potem usuniecie co drugiego - wezly z dwojgiem dzieci zostaja trasujace
+	for(int k=0; k<20000; k++) m.insert(make_pair(k + 10000, string("r")));
+	for(int k=0; k<20000; k+=2) m.erase(k + 10000);
+	for(int k=0; k<20000; k+=2) wzorzec.erase(k + 10000);
+	for(int k=1; k<20000; k+=2) wzorzec[k + 10000] = "r";
+	map<int, string> jest;
+	m.zawartosc(jest);
+	//klucze trasujace (usuniete z dwojgiem dzieci) scan musi pominac
+	return m.poprawna() && jest == wzorzec && przedzial(m, wzorzec, 9000, 31000)
+	       && przedzial(m, wzorzec, 2000, 10000) && przedzial(m, wzorzec, 29999, INT_MAX);
+}
+
+static bool faza2(int n, int watki)
+{
+	Sprawdzana m;
+	vector<map<int, string> > wzorce(watki);
+	atomic<int> bledy(0);
+	vector<thread> pula;
+	for(int t=0; t<watki; t++)
+		pula.push_back(thread([&, t]{
+			Losowe los(7919u*t + 1);
+			for(int i=0; i<n; i++){
+				int k = static_cast<int>(los() % 3000)*watki + t;
+				if(!krok(m, wzorce[t], k, los(), i)) ++bledy;
+			}
+		}));
+	for(int t=0; t<watki; t++) pula[t].join();
+	if(bledy != 0){
+		printf("  %d operacji z innym wynikiem niz wzorzec\n", bledy.load());
+		return false;
+	}
+	map<int, string> suma, jest;
+	for(int t=0; t<watki; t++) suma.insert(wzorce[t].begin(), wzorce[t].end());
+	m.zawartosc(jest);
+	if(jest != suma){
+		printf("  zawartosc mapy (%zu kluczy) inna niz suma wzorcow (%zu)\n", jest.size(), suma.size());
+		return false;
+	}
+	return m.poprawna() && sprzatniete(m);
+}
+
+static bool faza3(int n, int watki)
+{
+	Sprawdzana m;
+	//klucze [500, 1000) i [2000, 2500) sa wstawione przed startem i nikt ich nie zmienia
+	for(int k=500; k<1000; k++) m.insert(make_pair(k, string("s")));
+	for(int k=2000; k<2500; k++) m.insert(make_pair(k, string("s")));
+	atomic<int> bledy(0);
+	vector<thread> pula;
+	for(int t=0; t<watki; t++)
+		pula.push_back(thread([&, t]{
+			Losowe los(31u*t + 7);
+			string w;
+			if(t == 1){		//przeglada scan tyle razy, ile inni robia operacji na setke
+				for(int i=0; i<n/100 + 1; i++){
+					int ostatni = INT_MIN, stalych = 0;
+					m.scan(0, 3000, [&](int k, const string& v){
+						if(k <= ostatni || v.empty() || (v[0] != 'v' && v[0] != 's')) ++bledy;
+						if((k >= 500 && k < 1000) || k >= 2000) ++stalych;
+						ostatni = k;
+					});
+					if(stalych != 1000) ++bledy;
+				}
+				return;
+			}
+			for(int i=0; i<n; i++){
+				int k = static_cast<int>(los() % 500);
+				if(los() % 2 == 0) k += 1000;		//obok stalych kluczy, zeby scan trafial na zmiany
+				unsigned rodzaj = los() % 3;
+				if(t == 0 || rodzaj == 2){
+					//wartosc jest zawsze "v" i numer operacji
+					if(m.find(k, &w) && (w.empty() || w[0] != 'v')) ++bledy;
+				}
+				else if(rodzaj == 0) m.insert(make_pair(k, "v" + to_string(i)));
+				else m.erase(k);
+			}
+		}));
+	for(int t=0; t<watki; t++) pula[t].join();
+	size_t klucze = 1000;
+	for(int k=0; k<500; k++) klucze += m.count(k) + m.count(k + 1000);
+	if(bledy != 0 || klucze != m.size()){
+		printf("  bledne wartosci %d, kluczy %zu, size() %zu\n", bledy.load(), klucze, m.size());
+		return false;
+	}
+	return m.poprawna() && sprzatniete(m);
+}
+
+static bool faza4()
+{
+	ConcurrentTreeMap m;
+	const int ile = ConcurrentTreeMap::MAX_THREADS - 1;		//watek glowny juz ma slot
+	atomic<int> gotowe(0);
+	atomic<bool> koniec(false);
+	vector<thread> pula;
+	for(int t=0; t<ile; t++)
+		pula.push_back(thread([&, t]{
+			m.insert(make_pair(t, string("v")));
+			++gotowe;
+			while(!koniec.load()) this_thread::yield();
+		}));
+	while(gotowe.load() < ile) this_thread::yield();
+	bool odrzucony = false;
+	thread nadmiarowy([&]{
+		try{
+			m.find(0);
+		}
+		catch(const length_error&){
+			odrzucony = true;
+		}
+	});
+	nadmiarowy.join();
+	koniec = true;
+	for(int t=0; t<ile; t++) pula[t].join();
+	bool dziala = false;
+	thread nastepny([&]{ dziala = m.count(ile - 1) == 1; });
+	nastepny.join();
+	if(!odrzucony || !dziala){
+		printf("  watek ponad MAX_THREADS: %s, watek po zwolnieniu slotow: %s\n",
+		       odrzucony ? "odrzucony" : "nie odrzucony", dziala ? "dziala" : "nie dziala");
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 100000;
+	int watki = argc > 2 ? atoi(argv[2]) : 4;
+	if(n <= 0 || watki < 3 || watki > ConcurrentTreeMap::MAX_THREADS - 1){
+		fprintf(stderr, "uzycie: %s [operacji na watek] [watki: 3..%d]\n", argv[0], static_cast<int>(ConcurrentTreeMap::MAX_THREADS) - 1);
+		return EXIT_FAILURE;
+	}
+	bool ok = true;
+	bool wynik = faza1(n);
+	printf("jeden watek: %s\n", wynik ? "OK" : "BLAD");
+	ok = ok && wynik;
+	wynik = faza2(n, watki);
+	printf("%d watkow, rozlaczne klucze: %s\n", watki, wynik ? "OK" : "BLAD");
+	ok = ok && wynik;
+	wynik = faza3(n, watki);
+	printf("%d watkow, wspolne klucze: %s\n", watki, wynik ? "OK" : "BLAD");
+	ok = ok && wynik;
+	wynik = faza4();
+	printf("watek ponad MAX_THREADS: %s\n", wynik ? "OK" : "BLAD");
+	ok = ok && wynik;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}